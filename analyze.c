@@ -0,0 +1,464 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "batch.h"
+#include "game.h"
+#include "save.h"
+
+#define BATCH_MAGIC "NIMBATCH" // Starts a binary batch file; text input never does
+#define BUFFER_SIZE (1 << 20) // Bytes read or written at a time
+#define BLOCK_POSITIONS 1024 // Positions with the same number of rows evaluated together when there is no tablebase
+
+/**
+ * A stream of input read a large block at a time
+ */
+typedef struct {
+    FILE *file;
+    unsigned char *data; // Bytes read but not used yet start at data + start and end at data + end
+    size_t start, end, capacity;
+    int finished; // Set once the end of the file has been read
+} Input;
+
+/**
+ * Output collected in a large block and written once it fills up
+ */
+typedef struct {
+    unsigned char data[BUFFER_SIZE];
+    size_t used;
+} Output;
+
+/**
+ * Positions waiting to be evaluated together, stored row by row for evaluateBatch
+ */
+typedef struct {
+    Evaluator evaluator;
+    PositionBlock block;
+    BatchResults results;
+    long long *heaps; // Room for BLOCK_POSITIONS positions of capacity rows
+    int capacity;
+} Pending;
+
+/**
+ * Read more of the input, keeping the bytes not used yet. The buffer doubles if it is already full of them.
+ * @param input
+ * @return 1 if more bytes were read, 0 at the end of the file or if memory could not be allocated
+ */
+static int fillInput(Input *input);
+
+/**
+ * Parse one line of text, such as "3,5,7" or "3 5 7", into rows
+ * @param line start of the line
+ * @param end end of the line, not counting the newline
+ * @param heaps address of the array to store the rows in, grown as needed
+ * @param capacity address of the size of that array
+ * @return number of rows, 0 for a blank line, or -1 if the line is not a position or memory ran out
+ */
+static int parseLine(const unsigned char *line, const unsigned char *end, long long **heaps, int *capacity);
+
+/**
+ * Parse one record of a binary batch: the number of rows, then the pieces in each, all written by putNumber
+ * @param in where to read
+ * @param end the end of the data read so far
+ * @param heaps address of the array to store the rows in, grown as needed
+ * @param capacity address of the size of that array
+ * @param heapCount address to store the number of rows
+ * @return the address just past the record, or NULL if the record is not all there yet
+ */
+static const unsigned char *parseRecord(const unsigned char *in, const unsigned char *end, long long **heaps,
+                                        int *capacity, int *heapCount);
+
+/**
+ * Analyze a position and add its verdict line to the output: "win" or "loss" for the player to move, the Grundy
+ * sum of the rows, then the row and pieces of the move getAIMove would make (0 0 if the board is empty)
+ * @param game a game whose heaps are pointed at the position
+ * @param output
+ */
+static void analyzePosition(Game *game, Output *output);
+
+/**
+ * Add a position to the pending block, evaluating the block first if it is full or has a different number of rows
+ * @param pending
+ * @param heaps
+ * @param heapCount
+ * @param output
+ * @return 1 if successful, 0 if memory could not be allocated
+ */
+static int addPending(Pending *pending, const long long heaps[], int heapCount, Output *output);
+
+/**
+ * Evaluate the pending positions and add their verdict lines to the output, in the same form as analyzePosition
+ * @param pending
+ * @param output
+ */
+static void flushPending(Pending *pending, Output *output);
+
+/**
+ * Add a line to a binary batch for a position
+ * @param heaps
+ * @param heapCount
+ * @param output
+ */
+static void convertPosition(const long long heaps[], int heapCount, Output *output);
+
+/**
+ * Add text to the output, writing the buffer out first if it does not fit
+ * @param output
+ * @param text
+ * @param length
+ */
+static void putText(Output *output, const char *text, size_t length);
+
+/**
+ * Add a number in decimal to the output, without printf
+ * @param output
+ * @param value
+ */
+static void putDecimal(Output *output, long long value);
+
+/**
+ * Write out whatever is in the output buffer
+ * @param output
+ */
+static void flushOutput(Output *output);
+
+int main(int argc, char *argv[]) {
+    const char *ruleText = "1,2,3", *tablebaseFile = NULL;
+    int normalPlay = 0, convert = 0, option, heapCount = 0, capacity = 0, binary, lineNumber = 0;
+    int status = 0; // Exit status: 1 once any of the input could not be used
+    long long *heaps = NULL;
+    const unsigned char *line, *newline, *next;
+    Input input = {0};
+    Output *output = malloc(sizeof(Output));
+    Tablebase tablebase;
+    Rules rules;
+    Game game = {0};
+    Pending pending = {0};
+
+    while ((option = getopt(argc, argv, "r:nT:c")) != -1) {
+        switch (option) {
+            case 'r':
+                ruleText = optarg;
+                break;
+            case 'n':
+                normalPlay = 1;
+                break;
+            case 'T':
+                tablebaseFile = optarg;
+                break;
+            case 'c':
+                convert = 1;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-r 1,2,3|any] [-n] [-T nim.tb] [-c] [file]\n"
+                                "Reads positions (one per line, like 3,5,7 or 3 5 7, or a binary batch made with -c)\n"
+                                "from the file or stdin and prints \"win|loss grundy-sum row pieces\" for each one.\n"
+                                "Each line of text gets one line of output: blank for a blank or comment line, and\n"
+                                "\"invalid\" for one that is not a position. Exits with 1 if any input is invalid.\n"
+                                "  -n  normal play: whoever takes the last piece wins (default: they lose)\n"
+                                "  -T  look positions up in a tablebase solved for the same rules\n"
+                                "  -c  convert text positions to a binary batch instead of analyzing them\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (!parseRules(&rules, ruleText)) {
+        fprintf(stderr, "Invalid rules: %s (1 must be one of the amounts)\n", ruleText);
+        return 1;
+    }
+    rules.misere = !normalPlay;
+    game.rules = &rules;
+    if (tablebaseFile != NULL) {
+        if (!openTablebase(&tablebase, tablebaseFile) || !tablebaseMatches(&tablebase, &rules)) {
+            fprintf(stderr, "%s is not a tablebase for these rules\n", tablebaseFile);
+            return 1;
+        }
+        game.tablebase = &tablebase;
+    }
+    pending.results.sums = malloc(BLOCK_POSITIONS * sizeof(long long));
+    pending.results.winning = malloc(BLOCK_POSITIONS);
+    pending.results.rows = malloc(BLOCK_POSITIONS * sizeof(int));
+    pending.results.pieces = malloc(BLOCK_POSITIONS * sizeof(long long));
+    if (!newEvaluator(&pending.evaluator, &rules) || pending.results.sums == NULL || pending.results.winning == NULL ||
+        pending.results.rows == NULL || pending.results.pieces == NULL) {
+        fprintf(stderr, "Not enough memory\n");
+        return 1;
+    }
+
+    input.file = optind < argc ? fopen(argv[optind], "rb") : stdin;
+    input.capacity = BUFFER_SIZE;
+    input.data = malloc(input.capacity);
+    if (input.file == NULL || input.data == NULL || output == NULL) {
+        fprintf(stderr, input.file == NULL ? "Cannot open %s\n" : "Not enough memory\n", argv[optind]);
+        return 1;
+    }
+    output->used = 0;
+
+    while (input.end < sizeof(BATCH_MAGIC) - 1 && fillInput(&input)) {/* none */}
+    binary = input.end >= sizeof(BATCH_MAGIC) - 1 && memcmp(input.data, BATCH_MAGIC, sizeof(BATCH_MAGIC) - 1) == 0;
+    if (binary)
+        input.start = sizeof(BATCH_MAGIC) - 1;
+    else if (convert)
+        putText(output, BATCH_MAGIC, sizeof(BATCH_MAGIC) - 1);
+
+    // Work through whole lines or records in the buffer, and read more whenever one is cut off at the end
+    while (1) {
+        line = input.data + input.start;
+        if (binary) {
+            next = parseRecord(line, input.data + input.end, &heaps, &capacity, &heapCount);
+            if (next == NULL) {
+                if (fillInput(&input))
+                    continue;
+                if (input.start != input.end) {
+                    fprintf(stderr, "The batch ends partway through a position\n");
+                    status = 1;
+                }
+                break;
+            }
+            if (heapCount < 0) {
+                fprintf(stderr, "Invalid position in the batch\n");
+                status = 1;
+                break;
+            }
+        } else {
+            newline = memchr(line, '\n', input.end - input.start);
+            if (newline == NULL && fillInput(&input))
+                continue;
+            line = input.data + input.start; // fillInput moves what is left of the last line to the front
+            if (newline == NULL && input.start == input.end)
+                break;
+            next = newline == NULL ? input.data + input.end : newline + 1; // The last line may have no newline
+            heapCount = parseLine(line, newline == NULL ? next : newline, &heaps, &capacity);
+            lineNumber++;
+            if (heapCount < 0) {
+                fprintf(stderr, "Line %d is not a position\n", lineNumber);
+                status = 1;
+            }
+            if (heapCount <= 0 && !convert) { // Keep one line of output per line of input; a batch has no lines
+                flushPending(&pending, output); // Positions before this line come out first
+                putText(output, heapCount < 0 ? "invalid\n" : "\n", heapCount < 0 ? 8 : 1);
+            }
+        }
+        input.start = next - input.data;
+
+        if (heapCount <= 0)
+            continue;
+        if (convert) {
+            convertPosition(heaps, heapCount, output);
+        } else if (tablebaseFile == NULL) { // Without a tablebase, getAIMove's answer can be found many at a time
+            if (!addPending(&pending, heaps, heapCount, output)) {
+                fprintf(stderr, "Not enough memory\n");
+                status = 1;
+                break;
+            }
+        } else {
+            game.heaps = heaps;
+            game.heapCount = heapCount;
+            analyzePosition(&game, output);
+        }
+    }
+
+    flushPending(&pending, output);
+    flushOutput(output);
+    if (input.file != stdin)
+        fclose(input.file);
+    if (tablebaseFile != NULL)
+        closeTablebase(&tablebase);
+    free(input.data);
+    free(output);
+    free(heaps);
+    free(pending.heaps);
+    free(pending.results.sums);
+    free(pending.results.winning);
+    free(pending.results.rows);
+    free(pending.results.pieces);
+    freeEvaluator(&pending.evaluator);
+    freeRules(&rules);
+    return status;
+}
+
+static int fillInput(Input *input) {
+    unsigned char *grown;
+    size_t read;
+
+    if (input->finished)
+        return 0;
+    if (input->start > 0) { // Move the bytes not used yet to the front to make room
+        memmove(input->data, input->data + input->start, input->end - input->start);
+        input->end -= input->start;
+        input->start = 0;
+    }
+    if (input->end == input->capacity) { // One line or record fills the whole buffer
+        grown = realloc(input->data, input->capacity * 2);
+        if (grown == NULL)
+            return 0;
+        input->data = grown;
+        input->capacity *= 2;
+    }
+
+    read = fread(input->data + input->end, 1, input->capacity - input->end, input->file);
+    input->end += read;
+    if (read == 0)
+        input->finished = 1;
+    return read > 0;
+}
+
+static int parseLine(const unsigned char *line, const unsigned char *end, long long **heaps, int *capacity) {
+    long long *grown;
+    long long value;
+    int count = 0;
+
+    while (1) {
+        while (line < end && (*line == ' ' || *line == ',' || *line == '\t' || *line == '\r'))
+            line++;
+        if (line == end || *line == '#') // The rest of the line is a comment
+            return count;
+        if (*line < '0' || *line > '9')
+            return -1;
+
+        for (value = 0; line < end && *line >= '0' && *line <= '9'; line++) {
+            if (value > (0x7FFFFFFFFFFFFFFFLL - (*line - '0')) / 10) // Too big to store
+                return -1;
+            value = value * 10 + (*line - '0');
+        }
+        if (count == *capacity) {
+            grown = realloc(*heaps, (*capacity ? *capacity * 2 : 64) * sizeof(long long));
+            if (grown == NULL)
+                return -1;
+            *heaps = grown;
+            *capacity = *capacity ? *capacity * 2 : 64;
+        }
+        (*heaps)[count++] = value;
+    }
+}
+
+static const unsigned char *parseRecord(const unsigned char *in, const unsigned char *end, long long **heaps,
+                                        int *capacity, int *heapCount) {
+    unsigned long long value;
+    long long *grown;
+    int i;
+
+    if ((in = getNumber(in, end, &value)) == NULL)
+        return NULL;
+    if (value > 0x7FFFFFFF) {
+        *heapCount = -1;
+        return in;
+    }
+    *heapCount = (int) value;
+    if (*heapCount > *capacity) {
+        grown = realloc(*heaps, *heapCount * sizeof(long long));
+        if (grown == NULL) {
+            *heapCount = -1;
+            return in;
+        }
+        *heaps = grown;
+        *capacity = *heapCount;
+    }
+    for (i = 0; i < *heapCount; i++) {
+        if ((in = getNumber(in, end, &value)) == NULL)
+            return NULL;
+        (*heaps)[i] = (long long) (value & 0x7FFFFFFFFFFFFFFFULL);
+    }
+    return in;
+}
+
+static void analyzePosition(Game *game, Output *output) {
+    long long sum = 0;
+    long long pieces = 0;
+    int chosenRow = 0, winning, i;
+
+    game->total = 0;
+    for (i = 0; i < game->heapCount; i++) {
+        game->total += game->heaps[i];
+        sum ^= grundyValue(game->rules, game->heaps[i]);
+    }
+
+    if (game->total == 0) // Nobody can move; the player who just took the last piece won in normal play
+        winning = game->rules->misere;
+    else
+        winning = bestMove(game, &chosenRow, &pieces);
+
+    if (winning)
+        putText(output, "win ", 4);
+    else
+        putText(output, "loss ", 5);
+    putDecimal(output, sum);
+    putText(output, " ", 1);
+    putDecimal(output, chosenRow);
+    putText(output, " ", 1);
+    putDecimal(output, pieces);
+    putText(output, "\n", 1);
+}
+
+static int addPending(Pending *pending, const long long heaps[], int heapCount, Output *output) {
+    long long *grown;
+    int i;
+
+    if (heapCount != pending->block.heapCount || pending->block.count == BLOCK_POSITIONS)
+        flushPending(pending, output);
+    if (heapCount > pending->capacity) {
+        grown = realloc(pending->heaps, (size_t) heapCount * BLOCK_POSITIONS * sizeof(long long));
+        if (grown == NULL)
+            return 0;
+        pending->heaps = grown;
+        pending->capacity = heapCount;
+    }
+    pending->block.heapCount = heapCount;
+    pending->block.stride = BLOCK_POSITIONS;
+    pending->block.heaps = pending->heaps;
+    for (i = 0; i < heapCount; i++)
+        pending->heaps[i * BLOCK_POSITIONS + pending->block.count] = heaps[i];
+    pending->block.count++;
+    return 1;
+}
+
+static void flushPending(Pending *pending, Output *output) {
+    int p;
+
+    evaluateBatch(&pending->evaluator, &pending->block, &pending->results);
+    for (p = 0; p < pending->block.count; p++) {
+        if (pending->results.winning[p])
+            putText(output, "win ", 4);
+        else
+            putText(output, "loss ", 5);
+        putDecimal(output, pending->results.sums[p]);
+        putText(output, " ", 1);
+        putDecimal(output, pending->results.rows[p]);
+        putText(output, " ", 1);
+        putDecimal(output, pending->results.pieces[p]);
+        putText(output, "\n", 1);
+    }
+    pending->block.count = 0;
+}
+
+static void convertPosition(const long long heaps[], int heapCount, Output *output) {
+    unsigned char number[MAX_NUMBER_BYTES];
+    int i;
+
+    putText(output, (const char *) number, putNumber(number, (unsigned long long) heapCount) - number);
+    for (i = 0; i < heapCount; i++)
+        putText(output, (const char *) number, putNumber(number, (unsigned long long) heaps[i]) - number);
+}
+
+static void putText(Output *output, const char *text, size_t length) {
+    if (output->used + length > BUFFER_SIZE)
+        flushOutput(output);
+    memcpy(output->data + output->used, text, length);
+    output->used += length;
+}
+
+static void putDecimal(Output *output, long long value) {
+    char digits[20];
+    int count = 0;
+
+    do { // Digits come out lowest first, so fill the array from the back
+        digits[sizeof(digits) - ++count] = (char) ('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    putText(output, digits + sizeof(digits) - count, count);
+}
+
+static void flushOutput(Output *output) {
+    fwrite(output->data, 1, output->used, stdout);
+    output->used = 0;
+}
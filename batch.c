@@ -0,0 +1,269 @@
+#include <stdlib.h>
+#include "batch.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_AVX2 1 // The compiler can build AVX2 code for this target, whether or not the processor has it
+#else
+#define HAVE_AVX2 0
+#endif
+
+#define LANES 4 // 64-bit lanes in an AVX2 register
+
+/**
+ * Find where a row size is stored in the evaluator's tables
+ * @param evaluator
+ * @param heap number of pieces in the row
+ * @return the table index
+ */
+static long long tableIndex(const Evaluator *evaluator, long long heap);
+
+/**
+ * Find the amount that takes a row to the given Grundy value, trying the amounts in increasing order like
+ * grundyMove does
+ * @param evaluator
+ * @param heap number of pieces in the row
+ * @param target the Grundy value to leave
+ * @return the amount to take
+ */
+static long long amountToValue(const Evaluator *evaluator, long long heap, long long target);
+
+/**
+ * Evaluate positions one at a time, for any rules and any processor
+ * @param evaluator
+ * @param block
+ * @param results
+ * @param first the first position to evaluate
+ */
+static void evaluateScalar(const Evaluator *evaluator, const PositionBlock *block, BatchResults *results, int first);
+
+#if HAVE_AVX2
+/**
+ * Evaluate positions four at a time with AVX2, stopping before the last partial group of four
+ * @param evaluator
+ * @param block
+ * @param results
+ * @return the number of positions evaluated
+ */
+__attribute__((target("avx2")))
+static int evaluateAvx2(const Evaluator *evaluator, const PositionBlock *block, BatchResults *results);
+#endif
+
+int newEvaluator(Evaluator *evaluator, const Rules *rules) {
+    long long heap;
+    int j;
+
+    evaluator->rules = rules;
+    evaluator->values = NULL;
+    evaluator->reach = NULL;
+    evaluator->base = 0;
+    evaluator->length = 0;
+    evaluator->useAvx2 = 0;
+    if (rules->octal) // A move that splits a row is not a lookup in one row's table
+        return 0;
+
+    if (!rules->anyAmount) { // Plain Nim needs no tables: a row's value is its size and every smaller one is reachable
+        // Once a row is bigger than the largest move past the preperiod, every move lands in the repeating part,
+        // so from there on the reachable values repeat too
+        evaluator->base = rules->preperiod + rules->moves[rules->moveCount - 1];
+        evaluator->length = evaluator->base + rules->period;
+        evaluator->values = malloc(evaluator->length * sizeof(long long));
+        evaluator->reach = malloc(evaluator->length * sizeof(unsigned long long));
+        if (evaluator->values == NULL || evaluator->reach == NULL) {
+            freeEvaluator(evaluator);
+            return 0;
+        }
+        for (heap = 0; heap < evaluator->length; heap++) {
+            evaluator->values[heap] = grundyValue(rules, heap);
+            evaluator->reach[heap] = 0;
+            for (j = 0; j < rules->moveCount && rules->moves[j] <= heap; j++)
+                evaluator->reach[heap] |= 1ULL << evaluator->values[heap - rules->moves[j]];
+        }
+    }
+
+#if HAVE_AVX2
+    evaluator->useAvx2 = __builtin_cpu_supports("avx2") &&
+                         (rules->anyAmount || (rules->period & (rules->period - 1)) == 0);
+#endif
+    return 1;
+}
+
+void freeEvaluator(Evaluator *evaluator) {
+    free(evaluator->values);
+    free(evaluator->reach);
+    evaluator->values = NULL;
+    evaluator->reach = NULL;
+}
+
+void evaluateBatch(const Evaluator *evaluator, const PositionBlock *block, BatchResults *results) {
+    int first = 0;
+#if HAVE_AVX2
+    if (evaluator->useAvx2)
+        first = evaluateAvx2(evaluator, block, results);
+#endif
+    evaluateScalar(evaluator, block, results, first); // Whatever is left over
+}
+
+static long long tableIndex(const Evaluator *evaluator, long long heap) {
+    if (heap < evaluator->base)
+        return heap;
+    return evaluator->base + (heap - evaluator->base) % evaluator->rules->period;
+}
+
+static long long amountToValue(const Evaluator *evaluator, long long heap, long long target) {
+    const Rules *rules = evaluator->rules;
+    int j;
+    for (j = 0; j < rules->moveCount && rules->moves[j] <= heap; j++)
+        if (evaluator->values[tableIndex(evaluator, heap - rules->moves[j])] == target)
+            return rules->moves[j];
+    return 0; // Not reached: callers only ask for values the reach table says are there
+}
+
+static void evaluateScalar(const Evaluator *evaluator, const PositionBlock *block, BatchResults *results, int first) {
+    const Rules *rules = evaluator->rules;
+    long long X, value, rest, target, heap;
+    int p, r, bigRows, firstRow;
+
+    for (p = first; p < block->count; p++) {
+        X = 0;
+        bigRows = 0;
+        for (r = 0; r < block->heapCount; r++) {
+            heap = block->heaps[r * block->stride + p];
+            value = rules->anyAmount ? heap : evaluator->values[tableIndex(evaluator, heap)];
+            X ^= value;
+            bigRows += value > 1;
+        }
+
+        // Misère play only differs once every row is worth 0 or 1; then whoever faces an even number of 1s wins
+        results->sums[p] = X;
+        results->winning[p] = rules->misere && bigRows == 0 ? X == 0 : X != 0;
+        results->rows[p] = 0;
+        results->pieces[p] = 0;
+
+        firstRow = 0;
+        for (r = 0; r < block->heapCount; r++) {
+            heap = block->heaps[r * block->stride + p];
+            if (heap == 0)
+                continue;
+            if (firstRow == 0)
+                firstRow = r + 1;
+            if (!results->winning[p])
+                break;
+
+            // Pick the value this row has to be left at, exactly as grundyMove and misereMove do
+            value = rules->anyAmount ? heap : evaluator->values[tableIndex(evaluator, heap)];
+            rest = X ^ value;
+            target = rules->misere && bigRows - (value > 1) == 0 && rest <= 1 ? rest ^ 1 : rest;
+            if (rules->anyAmount ? target < heap : (evaluator->reach[tableIndex(evaluator, heap)] >> target & 1)) {
+                results->rows[p] = r + 1;
+                results->pieces[p] = rules->anyAmount ? heap - target : amountToValue(evaluator, heap, target);
+                break;
+            }
+        }
+        if (results->rows[p] == 0 && firstRow != 0) { // Lost (or stuck): take one piece from the first row with any
+            results->rows[p] = firstRow;
+            results->pieces[p] = 1;
+        }
+    }
+}
+
+#if HAVE_AVX2
+__attribute__((target("avx2")))
+static int evaluateAvx2(const Evaluator *evaluator, const PositionBlock *block, BatchResults *results) {
+    const Rules *rules = evaluator->rules;
+    const __m256i zero = _mm256_setzero_si256(), one = _mm256_set1_epi64x(1), two = _mm256_set1_epi64x(2);
+    const __m256i allSet = _mm256_set1_epi64x(-1);
+    const __m256i lastSmall = _mm256_set1_epi64x(evaluator->base - 1); // Sizes above this are in the repeating part
+    const __m256i base = _mm256_set1_epi64x(evaluator->base);
+    const __m256i periodMask = _mm256_set1_epi64x(rules->anyAmount ? 0 : rules->period - 1);
+    __m256i heap, index = zero, value, X, big, win, rest, target, small, found, hit, row, pieces, hitHeap, firstRow;
+    __m256i nonzero, bits;
+    long long heapLanes[LANES], rowLanes[LANES], pieceLanes[LANES], sumLanes[LANES];
+    int p, r, lane, winMask, hitMask;
+
+// Look up the Grundy value of each lane's row size, or use the size itself in plain Nim
+#define LOAD_VALUE()                                                                                                   \
+    heap = _mm256_loadu_si256((const __m256i *) (block->heaps + r * block->stride + p));                               \
+    if (rules->anyAmount) {                                                                                            \
+        value = heap;                                                                                                  \
+    } else {                                                                                                           \
+        index = _mm256_blendv_epi8(heap, _mm256_add_epi64(base, _mm256_and_si256(_mm256_sub_epi64(heap, base),         \
+                                                                                 periodMask)),                         \
+                                   _mm256_cmpgt_epi64(heap, lastSmall));                                               \
+        value = _mm256_i64gather_epi64(evaluator->values, index, 8);                                                   \
+    }
+
+    for (p = 0; p + LANES <= block->count; p += LANES) {
+        // First pass: the Grundy sum and the number of rows worth 2 or more, for four positions at once
+        X = zero;
+        big = zero;
+        for (r = 0; r < block->heapCount; r++) {
+            LOAD_VALUE()
+            X = _mm256_xor_si256(X, value);
+            big = _mm256_sub_epi64(big, _mm256_cmpgt_epi64(value, one)); // Comparisons give -1 where true
+        }
+        win = _mm256_xor_si256(_mm256_cmpeq_epi64(X, zero), allSet);
+        if (rules->misere) // With only 0s and 1s left, an even number of 1s (a sum of 0) wins instead
+            win = _mm256_blendv_epi8(win, _mm256_cmpeq_epi64(X, zero), _mm256_cmpeq_epi64(big, zero));
+
+        // Second pass: the first row each winning position can move in, and the first non-empty row for the rest
+        found = _mm256_xor_si256(win, allSet); // Lanes that are done looking
+        row = zero;
+        pieces = zero;
+        hitHeap = zero;
+        firstRow = zero;
+        for (r = 0; r < block->heapCount; r++) {
+            LOAD_VALUE()
+            nonzero = _mm256_xor_si256(_mm256_cmpeq_epi64(heap, zero), allSet);
+            firstRow = _mm256_blendv_epi8(firstRow, _mm256_set1_epi64x(r + 1),
+                                          _mm256_and_si256(nonzero, _mm256_cmpeq_epi64(firstRow, zero)));
+
+            rest = _mm256_xor_si256(X, value);
+            target = rest;
+            if (rules->misere) { // Leave an odd number of 1s when only small rows would be left
+                small = _mm256_and_si256(_mm256_cmpeq_epi64(_mm256_add_epi64(big, _mm256_cmpgt_epi64(value, one)), zero),
+                                         _mm256_cmpgt_epi64(two, rest));
+                target = _mm256_xor_si256(rest, _mm256_and_si256(small, one));
+            }
+
+            if (rules->anyAmount) {
+                hit = _mm256_cmpgt_epi64(heap, target);
+            } else {
+                bits = _mm256_i64gather_epi64((const long long *) evaluator->reach, index, 8);
+                hit = _mm256_and_si256(nonzero, _mm256_cmpeq_epi64(
+                        _mm256_and_si256(_mm256_srlv_epi64(bits, target), one), one));
+            }
+            hit = _mm256_andnot_si256(found, hit);
+            row = _mm256_blendv_epi8(row, _mm256_set1_epi64x(r + 1), hit);
+            if (rules->anyAmount) {
+                pieces = _mm256_blendv_epi8(pieces, _mm256_sub_epi64(heap, target), hit);
+            } else { // Keep the row size and the value to leave; the amount is found afterwards
+                pieces = _mm256_blendv_epi8(pieces, target, hit);
+                hitHeap = _mm256_blendv_epi8(hitHeap, heap, hit);
+            }
+            found = _mm256_or_si256(found, hit);
+        }
+
+        _mm256_storeu_si256((__m256i *) sumLanes, X);
+        _mm256_storeu_si256((__m256i *) heapLanes, hitHeap);
+        // Lanes that found no winning move take one piece from their first non-empty row, like firstAvailableMove
+        hit = _mm256_xor_si256(_mm256_cmpeq_epi64(row, zero), allSet);
+        _mm256_storeu_si256((__m256i *) rowLanes, _mm256_blendv_epi8(firstRow, row, hit));
+        _mm256_storeu_si256((__m256i *) pieceLanes, _mm256_blendv_epi8(
+                _mm256_and_si256(_mm256_xor_si256(_mm256_cmpeq_epi64(firstRow, zero), allSet), one), pieces, hit));
+        hitMask = _mm256_movemask_pd(_mm256_castsi256_pd(hit));
+        winMask = _mm256_movemask_pd(_mm256_castsi256_pd(win));
+        for (lane = 0; lane < LANES; lane++) {
+            results->sums[p + lane] = sumLanes[lane];
+            results->winning[p + lane] = winMask >> lane & 1;
+            results->rows[p + lane] = (int) rowLanes[lane];
+            results->pieces[p + lane] = pieceLanes[lane];
+            // The vector code found the row and the value to leave; the amount is one short scalar search
+            if (!rules->anyAmount && (hitMask >> lane & 1))
+                results->pieces[p + lane] = amountToValue(evaluator, heapLanes[lane], pieceLanes[lane]);
+        }
+    }
+#undef LOAD_VALUE
+    return p;
+}
+#endif
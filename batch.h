@@ -0,0 +1,66 @@
+#ifndef NIM_BATCH_H
+#define NIM_BATCH_H
+
+#include "grundy.h"
+
+/**
+ * A block of positions that all have the same number of rows, stored row by row (structure of arrays) so the
+ * same row of consecutive positions sits side by side in memory
+ */
+typedef struct {
+    int heapCount; // Rows in every position
+    int count; // Number of positions
+    long long stride; // Distance between one row and the next in heaps; at least count
+    const long long *heaps; // Pieces left in row r of position p are at heaps[r * stride + p]
+} PositionBlock;
+
+/**
+ * Where evaluateBatch stores its answers, one entry per position
+ */
+typedef struct {
+    long long *sums; // Grundy sum of the rows (the nim sum when any amount can be taken)
+    unsigned char *winning; // 1 if the player to move wins against perfect play, 0 if not
+    int *rows; // Row of the move getAIMove would make (1, 2, 3, ...), or 0 if the board is empty
+    long long *pieces; // Pieces that move takes, or 0 if the board is empty
+} BatchResults;
+
+/**
+ * Everything evaluateBatch needs for one set of rules, prepared once: the Grundy values, and for every row size
+ * a bit mask of which Grundy values a single move can reach, both widened to 64 bits and laid out so a row's entry
+ * is found with one comparison and one mask when the period is a power of 2
+ */
+typedef struct {
+    const Rules *rules;
+    long long base; // Row sizes from here on repeat every period entries in both tables
+    long long length; // Entries in each table: base + period
+    long long *values; // Grundy value of each row size below length
+    unsigned long long *reach; // Bit v is set if a move from a row of this size leaves a Grundy value of v
+    int useAvx2; // 1 to use the AVX2 code; set by newEvaluator if the processor and the rules allow it
+} Evaluator;
+
+/**
+ * Prepare to evaluate positions under a set of rules. The AVX2 code is picked at runtime if the processor has it
+ * and the rules either allow any amount or have a Grundy period that is a power of 2 (the standard rules do);
+ * otherwise the portable code is used. Set useAvx2 to 0 afterwards to force the portable code.
+ * @param evaluator address of the evaluator to set up
+ * @param rules the rules, which must outlive the evaluator
+ * @return 1 if successful, 0 if memory could not be allocated or the rules are an octal code
+ */
+int newEvaluator(Evaluator *evaluator, const Rules *rules);
+
+/**
+ * Release the memory held by an evaluator
+ * @param evaluator
+ */
+void freeEvaluator(Evaluator *evaluator);
+
+/**
+ * Evaluate every position in a block: the Grundy sum, whether the player to move wins, and the move getAIMove
+ * would make without a tablebase (the winning move grundyMove finds, or one piece from the first non-empty row)
+ * @param evaluator
+ * @param block
+ * @param results arrays with room for block->count entries each
+ */
+void evaluateBatch(const Evaluator *evaluator, const PositionBlock *block, BatchResults *results);
+
+#endif
@@ -0,0 +1,257 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "game.h"
+
+#define POSITIONS 256 // Positions per scenario; the benchmarks cycle through them so no single one gets cached
+#define OPS_PER_ROUND (POSITIONS * 16) // Operations between clock reads
+
+/**
+ * A primitive being timed, given a position and a legal move in it
+ */
+typedef long long (*Primitive)(Game *game, int row, long long pieces);
+
+/**
+ * A function to benchmark
+ */
+typedef struct {
+    const char *name;
+    Primitive primitive;
+} Benchmark;
+
+/**
+ * A family of positions to benchmark on
+ */
+typedef struct {
+    const char *name;
+    int heapCount; // Rows per position
+    long long maxHeap; // Largest number of pieces a row can start with
+    int adversarial; // 1 to only use positions where the player to move has no winning move
+} Scenario;
+
+/**
+ * Everything one benchmark needs: the positions and a move to try on each
+ */
+typedef struct {
+    Game games[POSITIONS];
+    int rows[POSITIONS]; // A row with pieces left in each position
+    long long pieces[POSITIONS]; // A legal number of pieces to take from that row
+} Positions;
+
+/**
+ * Fill in the positions for a scenario
+ * @param scenario
+ * @param rules
+ * @param positions address of the positions to fill
+ * @param seed address of the random number generator state
+ * @return 1 if successful, 0 if memory could not be allocated
+ */
+static int makePositions(const Scenario *scenario, const Rules *rules, Positions *positions, unsigned long long *seed);
+
+/**
+ * Release the memory held by a set of positions
+ * @param positions
+ */
+static void freePositions(Positions *positions);
+
+/**
+ * Time one primitive on every position, repeating until the time budget is used up
+ * @param primitive the wrapper around the function to time
+ * @param positions
+ * @param seconds how long to keep repeating
+ * @param ops address to store how many operations ran
+ * @return how many seconds the operations took
+ */
+static double runBenchmark(Primitive primitive, Positions *positions, double seconds, long long *ops);
+
+// Wrappers that give every primitive the same shape. They take the position and the move picked for it.
+static long long benchLegalMove(Game *game, int row, long long pieces);
+static long long benchGameWon(Game *game, int row, long long pieces);
+static long long benchNimSum(Game *game, int row, long long pieces);
+static long long benchRowSum(Game *game, int row, long long pieces);
+static long long benchRemovePieces(Game *game, int row, long long pieces);
+static long long benchGetAIMove(Game *game, int row, long long pieces);
+
+/**
+ * Read the monotonic clock
+ * @return the time in seconds
+ */
+static double now(void);
+
+static volatile long long sink; // Results are added here so the compiler cannot skip the work being timed
+
+int main(int argc, char *argv[]) {
+    const Scenario scenarios[] = {
+            {"standard-random", 3, 7, 0},
+            {"standard-lost", 3, 7, 1},
+            {"wide-random", 1000, 1000000, 0},
+            {"wide-lost", 1000, 1000000, 1},
+            {"huge-random", 10000, 1LL << 40, 0},
+    };
+    const Benchmark benchmarks[] = {
+            {"legalMove", benchLegalMove},
+            {"gameWon", benchGameWon},
+            {"nimSum", benchNimSum},
+            {"rowSum", benchRowSum},
+            {"removePieces", benchRemovePieces},
+            {"getAIMove", benchGetAIMove},
+    };
+    const int standardMoves[] = {1, 2, 3};
+    int scenarioCount = sizeof(scenarios) / sizeof(scenarios[0]);
+    int benchmarkCount = sizeof(benchmarks) / sizeof(benchmarks[0]);
+    int json = 0, first = 1, option, s, b;
+    double seconds = 0.2, elapsed;
+    long long ops;
+    unsigned long long seed = 1; // Fixed so every build is measured on the same positions
+    Positions *positions = malloc(sizeof(Positions));
+    Rules rules;
+
+    while ((option = getopt(argc, argv, "jt:")) != -1) {
+        switch (option) {
+            case 'j':
+                json = 1;
+                break;
+            case 't':
+                seconds = atof(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-j] [-t seconds per benchmark]\n  -j  print JSON instead of CSV\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (positions == NULL || !newSubtractionRules(&rules, standardMoves, 3)) {
+        fprintf(stderr, "Not enough memory\n");
+        return 1;
+    }
+
+    printf(json ? "[\n" : "function,scenario,heaps,ops,ns_per_op,ops_per_sec\n");
+    for (s = 0; s < scenarioCount; s++) {
+        if (!makePositions(&scenarios[s], &rules, positions, &seed)) {
+            fprintf(stderr, "Not enough memory for %s\n", scenarios[s].name);
+            return 1;
+        }
+        for (b = 0; b < benchmarkCount; b++) {
+            elapsed = runBenchmark(benchmarks[b].primitive, positions, seconds, &ops);
+            if (json)
+                printf("%s  {\"function\": \"%s\", \"scenario\": \"%s\", \"heaps\": %d, \"ops\": %lld, "
+                       "\"ns_per_op\": %.3f, \"ops_per_sec\": %.0f}", first ? "" : ",\n", benchmarks[b].name,
+                       scenarios[s].name, scenarios[s].heapCount, ops, elapsed * 1e9 / ops, ops / elapsed);
+            else
+                printf("%s,%s,%d,%lld,%.3f,%.0f\n", benchmarks[b].name, scenarios[s].name, scenarios[s].heapCount,
+                       ops, elapsed * 1e9 / ops, ops / elapsed);
+            first = 0;
+            fflush(stdout);
+        }
+        freePositions(positions);
+    }
+    if (json)
+        printf("\n]\n");
+
+    free(positions);
+    freeRules(&rules);
+    return 0;
+}
+
+static int makePositions(const Scenario *scenario, const Rules *rules, Positions *positions, unsigned long long *seed) {
+    long long *sizes = malloc(scenario->heapCount * sizeof(long long));
+    Game *game;
+    int i, j;
+
+    if (sizes == NULL)
+        return 0;
+
+    for (i = 0; i < POSITIONS; i++) {
+        game = &positions->games[i];
+        for (j = 0; j < scenario->heapCount; j++)
+            sizes[j] = 1 + (long long) (nextRandom(seed) % (unsigned long long) scenario->maxHeap);
+        if (!newGame(game, scenario->heapCount, sizes, rules)) {
+            for (j = 0; j < i; j++)
+                freeGame(&positions->games[j]);
+            free(sizes);
+            return 0;
+        }
+
+        // Empty out a random part of each row so the positions are not all full boards
+        for (j = 0; j < scenario->heapCount; j++)
+            removePieces(game, j + 1, (long long) (nextRandom(seed) % (unsigned long long) sizes[j]));
+
+        // Making the winning move leaves the other player lost, which is the slowest case for getAIMove
+        if (scenario->adversarial && grundyMove(rules, game->heaps, game->heapCount, &positions->rows[i],
+                                                &positions->pieces[i]))
+            removePieces(game, positions->rows[i], positions->pieces[i]);
+
+        randomMove(game, seed, &positions->rows[i], &positions->pieces[i]);
+    }
+
+    free(sizes);
+    return 1;
+}
+
+static void freePositions(Positions *positions) {
+    int i;
+    for (i = 0; i < POSITIONS; i++)
+        freeGame(&positions->games[i]);
+}
+
+static double runBenchmark(Primitive primitive, Positions *positions, double seconds, long long *ops) {
+    double start = now(), elapsed;
+    long long result = 0;
+    int i;
+
+    *ops = 0;
+    do {
+        for (i = 0; i < OPS_PER_ROUND; i++)
+            result += primitive(&positions->games[i % POSITIONS], positions->rows[i % POSITIONS],
+                                positions->pieces[i % POSITIONS]);
+        *ops += OPS_PER_ROUND;
+        elapsed = now() - start;
+    } while (elapsed < seconds);
+
+    sink += result;
+    return elapsed;
+}
+
+static long long benchLegalMove(Game *game, int row, long long pieces) {
+    return legalMove(game, row, pieces);
+}
+
+static long long benchGameWon(Game *game, int row, long long pieces) {
+    (void) row;
+    (void) pieces;
+    return gameWon(game);
+}
+
+static long long benchNimSum(Game *game, int row, long long pieces) {
+    (void) row;
+    (void) pieces;
+    return nimSum(game);
+}
+
+static long long benchRowSum(Game *game, int row, long long pieces) {
+    (void) pieces;
+    return rowSum(game, row);
+}
+
+static long long benchRemovePieces(Game *game, int row, long long pieces) {
+    long long left;
+    removePieces(game, row, pieces);
+    left = game->total;
+    removePieces(game, row, -pieces); // Put the pieces back so the position is the same next time around
+    return left;
+}
+
+static long long benchGetAIMove(Game *game, int row, long long pieces) {
+    getAIMove(game, &row, &pieces);
+    return row + pieces;
+}
+
+static double now(void) {
+    struct timespec spec;
+    clock_gettime(CLOCK_MONOTONIC, &spec);
+    return spec.tv_sec + spec.tv_nsec / 1e9;
+}
@@ -0,0 +1,339 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include "game.h"
+#include "standard.h"
+
+/**
+ * Determine whether a game is a position of the standard board under the standard rules, so its move can be looked
+ * up in standardTable
+ * @param game
+ * @return 1 if the game is covered by the table, 0 if not
+ */
+static int onStandardBoard(const Game *game);
+
+int newGame(Game *game, int heapCount, const long long sizes[], const Rules *rules) {
+    long long capacity = heapCount, *heaps, *copy;
+    int splits = 0, i;
+
+    for (i = 0; rules->octal && i < rules->moveCount; i++) // Only a digit with a 4 in it can split a row
+        splits |= rules->digits[rules->moves[i]] & 4;
+    // Each split takes at least one piece and leaves at least one on each side, so a row of n pieces can end up as at
+    // most (n + 1) / 2 rows
+    for (i = 0; splits && i < heapCount && capacity <= INT_MAX; i++)
+        capacity += (sizes[i] - 1) / 2;
+    for (i = 0; rules->octal && i < heapCount; i++)
+        if (grundyValue(rules, sizes[i]) < 0) // A row past the end of the table has no value to play it by
+            capacity = INT_MAX + 1LL;
+    heaps = capacity <= INT_MAX ? malloc(capacity * sizeof(long long)) : NULL;
+    copy = capacity <= INT_MAX ? malloc(capacity * sizeof(long long)) : NULL;
+
+    if (heaps == NULL || copy == NULL) { // Do not leave a half-allocated game behind
+        free(heaps);
+        free(copy);
+        game->heaps = game->sizes = NULL;
+        game->heapCount = game->heapCapacity = 0;
+        game->total = 0;
+        return 0;
+    }
+    memcpy(copy, sizes, heapCount * sizeof(long long));
+    initGame(game, heapCount, heaps, copy, rules);
+    game->heapCapacity = (int) capacity;
+    return 1;
+}
+
+void initGame(Game *game, int heapCount, long long heaps[], long long sizes[], const Rules *rules) {
+    game->heapCount = heapCount;
+    game->heapCapacity = heapCount;
+    game->heaps = heaps;
+    game->sizes = sizes;
+    game->rules = rules;
+    game->tablebase = NULL;
+    game->searcher = NULL;
+    game->mcts = NULL;
+    resetGame(game); // Every heap starts out full
+}
+
+void resetGame(Game *game) {
+    int i;
+    game->total = 0;
+    for (i = 0; i < game->heapCount; i++) {
+        game->heaps[i] = game->sizes[i];
+        game->total += game->sizes[i];
+    }
+}
+
+void freeGame(Game *game) {
+    free(game->heaps);
+    free(game->sizes);
+    game->heaps = NULL;
+    game->sizes = NULL;
+    game->heapCount = game->heapCapacity = 0;
+    game->total = 0;
+}
+
+int gameWon(Game *game) {
+    int row;
+    long long pieces, left;
+
+    if (game->rules->octal) // An octal code can leave rows too small for any amount it allows
+        return game->total == 0 || !octalFirstMove(game->rules, game->heaps, game->heapCount, &row, &pieces, &left);
+    if (game->searcher != NULL) // A variant can leave pieces that no move is allowed to take
+        return game->total == 0 || !searchHasMove(game->searcher, game->heaps, game->heapCount);
+    return game->total == 0; // The game is over if all pieces are gone. The running total tracks exactly that.
+}
+
+int legalMove(Game *game, int chosenRow, long long pieces) {
+    // First check if the choices are in bounds and the rules allow taking that many
+    if (!allowedTake(game->rules, pieces) || chosenRow > game->heapCount || chosenRow < 1)
+        return 0;
+    if (game->searcher != NULL && !searchAllowed(game->searcher, chosenRow, pieces))
+        return 0;
+    if (game->rules->octal && grundyValue(game->rules, rowSum(game, chosenRow)) < 0) // Past the end of the table
+        return 0;
+    if (game->rules->octal) // Taking from one end and from one piece in cover every number of rows it can leave
+        return octalAllowed(game->rules, rowSum(game, chosenRow), pieces, 0) ||
+               octalAllowed(game->rules, rowSum(game, chosenRow), pieces, 1);
+    return rowSum(game, chosenRow) >= pieces; // Then check if there are enough pieces left in the chosen row
+}
+
+int legalTurn(Game *game, const Turn *turn) {
+    int i, j;
+    if (turn->count < 1 || turn->count > game->rules->maxRows)
+        return 0;
+    if (game->rules->octal) // Always one row, at a place the code allows
+        return legalMove(game, turn->rows[0], turn->pieces[0]) &&
+               octalAllowed(game->rules, rowSum(game, turn->rows[0]), turn->pieces[0], turn->left);
+    for (i = 0; i < turn->count; i++) {
+        if (!legalMove(game, turn->rows[i], turn->pieces[i]))
+            return 0;
+        for (j = 0; j < i; j++) // Each row can only be taken from once per turn
+            if (turn->rows[j] == turn->rows[i])
+                return 0;
+    }
+    return 1;
+}
+
+long long nimSum(Game *game) {
+    long long sum = 0;
+    int i;
+    for (i = 0; i < game->heapCount; i++)
+        sum ^= game->heaps[i]; // The nim sum of many numbers is the nim sum of each one with the running result
+    return sum;
+}
+
+long long rowSum(Game *game, int chosenRow) {
+    return game->heaps[chosenRow - 1]; // Rows are stored as counts, so there is nothing to add up
+}
+
+int gameWinner(Game *game, int player) {
+    return game->rules->misere ? player : !player; // In misère play, taking the last piece loses
+}
+
+void firstAvailableMove(Game *game, int *chosenRow, long long *pieces) {
+    int i;
+    *pieces = 1; // Only take one piece
+    // Take it from whichever row has a piece to be taken
+    for (i = 0; i < game->heapCount - 1 && game->heaps[i] == 0; i++) {/* none */}
+    *chosenRow = i + 1;
+}
+
+void getAIMove(Game *game, int *chosenRow, long long *pieces) {
+    bestMove(game, chosenRow, pieces);
+}
+
+int bestMove(Game *game, int *chosenRow, long long *pieces) {
+    unsigned char entry;
+    Move move;
+    Turn turn;
+    int winning;
+
+    if (game->rules->octal) { // Where in the row to take from is left out, but the rest is the same as bestTurn's
+        winning = bestTurn(game, &turn);
+        *chosenRow = turn.rows[0];
+        *pieces = turn.pieces[0];
+        return winning;
+    }
+
+    if (game->mcts != NULL) { // Played out instead of solved, however the position could be solved
+        if (!mctsMove(game->mcts, game->heaps, game->heapCount, &move))
+            return game->rules->misere; // No moves left: the other player made the last one
+        *chosenRow = move.rows[0];
+        *pieces = move.pieces[0];
+        return game->mcts->winRate > 0.5;
+    }
+
+    if (game->searcher != NULL) {
+        if (!searchMove(game->searcher, game->heaps, game->heapCount, &move))
+            return game->rules->misere; // No moves left: the other player made the last one
+        *chosenRow = move.rows[0];
+        *pieces = move.pieces[0];
+        return game->searcher->score == 1;
+    }
+
+    if (game->rules->maxRows > 1) { // Moore's Nim_k has its own theory; the lookups below only cover one-row moves
+        winning = bestTurn(game, &turn);
+        *chosenRow = turn.rows[0];
+        *pieces = turn.pieces[0];
+        return winning;
+    }
+
+    if (game->total == 0) { // Same as above, and what evaluateBatch reports; the dummy move is only there to fill in
+        firstAvailableMove(game, chosenRow, pieces);
+        return game->rules->misere;
+    }
+
+    if (onStandardBoard(game)) { // Solved when the game was built, with the same moves as below
+        entry = standardTable[game->rules->misere][standardIndex(game->heaps)];
+        *chosenRow = STANDARD_ROW(entry);
+        *pieces = STANDARD_PIECES(entry);
+        return (entry & STANDARD_WINNING) != 0;
+    }
+
+    if (game->tablebase != NULL &&
+        tablebaseLookup(game->tablebase, game->heaps, game->heapCount, &winning, chosenRow, pieces)) {
+        if (!winning) // The other player can win no matter what; make a dummy move to move the game along
+            firstAvailableMove(game, chosenRow, pieces);
+        return winning;
+    }
+
+    // Same as above: if no move wins, make a dummy move
+    if (grundyMove(game->rules, game->heaps, game->heapCount, chosenRow, pieces))
+        return 1;
+    firstAvailableMove(game, chosenRow, pieces);
+    return 0;
+}
+
+void getAITurn(Game *game, Turn *turn) {
+    bestTurn(game, turn);
+}
+
+int bestTurn(Game *game, Turn *turn) {
+    Move move;
+
+    turn->left = 0; // Only an octal turn says where in the row it takes from
+    if (game->rules->octal) { // Nothing else can split a row, so the Grundy values decide even with other players set
+        turn->count = 1;
+        if (octalMove(game->rules, game->heaps, game->heapCount, &turn->rows[0], &turn->pieces[0], &turn->left))
+            return 1;
+        octalFirstMove(game->rules, game->heaps, game->heapCount, &turn->rows[0], &turn->pieces[0], &turn->left);
+        return 0; // Same as bestMove: if no move wins, make a dummy move
+    }
+    if (game->mcts != NULL) { // A Monte Carlo move can take from two rows, and bestMove only passes on the first
+        turn->count = 0;
+        if (!mctsMove(game->mcts, game->heaps, game->heapCount, &move))
+            return game->rules->misere;
+        for (; turn->count < SEARCH_MAX_ROWS && move.rows[turn->count] != 0; turn->count++) {
+            turn->rows[turn->count] = move.rows[turn->count];
+            turn->pieces[turn->count] = move.pieces[turn->count];
+        }
+        return game->mcts->winRate > 0.5;
+    }
+    if (game->rules->maxRows > 1 && game->searcher == NULL) { // Solved in closed form, however big the board
+        if (mooreMove(game->rules, game->heaps, game->heapCount, turn->rows, turn->pieces, &turn->count))
+            return 1;
+        turn->count = 1; // Same as bestMove: if no move wins, make a dummy move
+        firstAvailableMove(game, &turn->rows[0], &turn->pieces[0]);
+        return 0;
+    }
+    turn->count = 1;
+    return bestMove(game, &turn->rows[0], &turn->pieces[0]);
+}
+
+void removePieces(Game *game, int chosenRow, long long pieces) {
+    game->heaps[chosenRow - 1] -= pieces; // Pieces are only counted, so removing them is a subtraction
+    game->total -= pieces;
+}
+
+void takeTurn(Game *game, const Turn *turn) {
+    int i;
+    if (game->rules->octal) {
+        splitRow(game, turn->rows[0], turn->pieces[0], turn->left);
+        return;
+    }
+    for (i = 0; i < turn->count; i++)
+        removePieces(game, turn->rows[i], turn->pieces[i]);
+}
+
+void splitRow(Game *game, int chosenRow, long long pieces, long long left) {
+    long long right = game->heaps[chosenRow - 1] - pieces - left;
+    int i;
+
+    if (left == 0 || right == 0) { // Nothing to split off, so this is the same as taking from one end
+        removePieces(game, chosenRow, pieces);
+        return;
+    }
+    for (i = game->heapCount; i > chosenRow; i--) { // Shift the rows after it down to make room
+        game->heaps[i] = game->heaps[i - 1];
+        game->sizes[i] = game->sizes[i - 1];
+    }
+    game->heaps[chosenRow - 1] = left;
+    game->sizes[chosenRow - 1] -= right;
+    game->heaps[chosenRow] = right;
+    game->sizes[chosenRow] = right;
+    game->heapCount++;
+    game->total -= pieces;
+}
+
+void randomMove(Game *game, unsigned long long *seed, int *chosenRow, long long *pieces) {
+    const Rules *rules = game->rules;
+    long long heap;
+    int candidates = 0, i;
+
+    if (game->searcher != NULL) { // The variant can rule out any amount in any row, so pick among the legal moves
+        for (i = 0; i < game->heapCount; i++)
+            for (heap = 1; heap <= game->heaps[i]; heap++)
+                if (legalMove(game, i + 1, heap) && nextRandom(seed) % ++candidates == 0) {
+                    *chosenRow = i + 1;
+                    *pieces = heap;
+                }
+        return;
+    }
+
+    // Pick a row by keeping each one with a 1 in (rows seen so far) chance, so no list of rows is needed
+    for (i = 0; i < game->heapCount; i++)
+        if (game->heaps[i] > 0 && nextRandom(seed) % ++candidates == 0)
+            *chosenRow = i + 1;
+    heap = rowSum(game, *chosenRow);
+
+    if (rules->anyAmount) {
+        *pieces = 1 + (long long) (nextRandom(seed) % (unsigned long long) heap);
+        return;
+    }
+    // The amounts are sorted and start with 1, so count how many fit in the row and pick one of those
+    for (candidates = 0; candidates < rules->moveCount && rules->moves[candidates] <= heap; candidates++) {/* none */}
+    *pieces = rules->moves[nextRandom(seed) % candidates];
+}
+
+unsigned long long nextRandom(unsigned long long *seed) {
+    unsigned long long z = (*seed += 0x9E3779B97F4A7C15ULL); // splitmix64: a fixed step, then scramble the bits
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+int parseList(const char *text, long long values[], int maxValues) {
+    char *end;
+    int count = 0;
+
+    while (*text != '\0') {
+        if (count == maxValues)
+            return 0;
+        values[count] = strtoll(text, &end, 10);
+        if (end == text || values[count] < 1)
+            return 0;
+        count++;
+        text = *end == ',' ? end + 1 : end;
+        if (*end != ',' && *end != '\0')
+            return 0;
+    }
+    return count;
+}
+
+static int onStandardBoard(const Game *game) {
+    const Rules *rules = game->rules;
+    // Amounts are sorted and start with 1, so three of them ending in 3 can only be 1, 2 and 3
+    return !rules->anyAmount && rules->moveCount == 3 && rules->moves[2] == 3 && game->heapCount == 3 &&
+           game->total > 0 && game->heaps[0] <= STANDARD_ROW_1 && game->heaps[1] <= STANDARD_ROW_2 &&
+           game->heaps[2] <= STANDARD_ROW_3;
+}
@@ -0,0 +1,223 @@
+#ifndef NIM_GAME_H
+#define NIM_GAME_H
+
+#include "grundy.h"
+#include "mcts.h"
+#include "octal.h"
+#include "search.h"
+#include "tablebase.h"
+
+/**
+ * The state of a game: any number of heaps, each stored as a count of the pieces left in it
+ */
+typedef struct {
+    int heapCount; // Number of heaps (rows) on the board
+    int heapCapacity; // Rows heaps and sizes have room for; more than heapCount under octal rules, which split rows
+    long long *heaps; // Number of pieces left in each heap
+    long long *sizes; // Number of pieces each heap started with, used to draw the empty spaces
+    long long total; // Number of pieces left on the whole board
+    const Rules *rules; // How many pieces can be taken in one move
+    const Tablebase *tablebase; // Solved positions for the AI to look moves up in, or NULL to always calculate
+    Searcher *searcher; // Variant restrictions for the AI to search under, or NULL for the plain rules
+    Mcts *mcts; // Monte Carlo player for the AI to use instead of its exact strategies, or NULL
+} Game;
+
+/**
+ * Everything taken in one turn: pieces from a single row, or from up to rules->maxRows rows under Moore's Nim_k
+ */
+typedef struct {
+    int count; // Number of rows taken from
+    int rows[MAX_MOVE_ROWS]; // Rows taken from (1, 2, 3, ...), each at most once
+    long long pieces[MAX_MOVE_ROWS]; // Pieces taken from each of those rows
+    long long left; // Under an octal code, pieces left to the left of the ones taken from the one row; else unused
+} Turn;
+
+/**
+ * Set up a new game with full heaps of the given sizes. Under an octal code that can split rows, there is room for
+ * every row the heaps could be split into.
+ * @param game address of the game to set up
+ * @param heapCount number of heaps
+ * @param sizes number of pieces in each heap
+ * @param rules the rules to play by
+ * @return 1 if the game was set up successfully, 0 if a heap is past the end of the rules' Grundy table or memory
+ * could not be allocated
+ */
+int newGame(Game *game, int heapCount, const long long sizes[], const Rules *rules);
+
+/**
+ * Set up a new game with full heaps over storage the caller provides, without allocating anything. Such a game must
+ * not be passed to freeGame. Its capacity is heapCount; raise it if the arrays have room for rows to split into.
+ * @param game address of the game to set up
+ * @param heapCount number of heaps
+ * @param heaps array of heapCount numbers to keep the pieces left in each heap in
+ * @param sizes number of pieces in each heap, kept by the game and used to draw the empty spaces
+ * @param rules the rules to play by
+ */
+void initGame(Game *game, int heapCount, long long heaps[], long long sizes[], const Rules *rules);
+
+/**
+ * Put every piece back on the board
+ * @param game
+ */
+void resetGame(Game *game);
+
+/**
+ * Release the memory held by a game
+ * @param game
+ */
+void freeGame(Game *game);
+
+/**
+ * Determine if the game is over. Under a searched variant or an octal code, that can happen with pieces left if none
+ * can be taken.
+ * @param game
+ * @return 1 if the game is over, 0 if not
+ */
+int gameWon(Game *game);
+
+/**
+ * Determine whether a given move is legal. Under an octal code, that is whether the pieces can be taken from
+ * somewhere in the row, which must be within the Grundy table.
+ * @param game
+ * @param chosenRow human-friendly index of the row (1, 2, 3, ...)
+ * @param pieces
+ * @return 1 if the move is legal, 0 if not
+ */
+int legalMove(Game *game, int chosenRow, long long pieces);
+
+/**
+ * Determine whether a whole turn is legal: every part of it has to be a legal move, no row can be taken from twice,
+ * and it can take from no more rows than the rules allow. Under an octal code, the code also has to allow taking the
+ * pieces from where the turn says.
+ * @param game
+ * @param turn
+ * @return 1 if the turn is legal, 0 if not
+ */
+int legalTurn(Game *game, const Turn *turn);
+
+/**
+ * Calculate the nim sum of all rows (same thing as XOR)
+ * @param game
+ * @return the nim sum
+ */
+long long nimSum(Game *game);
+
+/**
+ * Count the number of pieces left in a row
+ * @param game
+ * @param chosenRow human-friendly index of the row (1, 2, 3, ...)
+ * @return the number of pieces left in the row
+ */
+long long rowSum(Game *game, int chosenRow);
+
+/**
+ * Determine who won a finished game
+ * @param game
+ * @param player the player who is up next, which is whoever did not take the last piece
+ * @return the winning player (0 or 1)
+ */
+int gameWinner(Game *game, int player);
+
+/**
+ * Make the first allowed move given the rows
+ * @param game
+ * @param chosenRow address to store the chosen row
+ * @param pieces address to store the chosen number of pieces to take
+ */
+void firstAvailableMove(Game *game, int *chosenRow, long long *pieces);
+
+/**
+ * Get the next best legal move in the game. Octal games always use the Grundy values of the rows, since nothing else
+ * here can split a row. Games with a Monte Carlo player leave every move to it (its variant should be the game's
+ * searcher, if there is one). Games with a searcher are searched, since the variant's restrictions have no closed form;
+ * positions of the standard 3, 5, 7 board are looked up in the table solved when the game was built, and others covered
+ * by the game's tablebase in the tablebase; the rest use the Grundy values of the rows under the game's rules. A
+ * searcher attached to a game must only allow one-row moves. When the rules let a move take from several rows, this is
+ * only the first row of getAITurn's move, and under an octal code it leaves out where in the row to take from.
+ * @param game
+ * @param chosenRow address to store the chosen row
+ * @param pieces address to store the chosen number of pieces to take
+ */
+void getAIMove(Game *game, int *chosenRow, long long *pieces);
+
+/**
+ * Get the same move as getAIMove, and whether it wins
+ * @param game
+ * @param chosenRow address to store the chosen row
+ * @param pieces address to store the chosen number of pieces to take
+ * @return 1 if the player to move wins against perfect play (for a Monte Carlo player, if it won most of the playouts
+ * through the move), 0 if the move is a dummy move in a lost position. On an empty board, the player to move has won
+ * in misère play and lost in normal play.
+ */
+int bestMove(Game *game, int *chosenRow, long long *pieces);
+
+/**
+ * Get the computer's whole turn, which can take from several rows under Moore's Nim_k, or from the middle of a row
+ * under an octal code
+ * @param game
+ * @param turn address to store the turn
+ */
+void getAITurn(Game *game, Turn *turn);
+
+/**
+ * Get the same turn as getAITurn, and whether it wins
+ * @param game
+ * @param turn address to store the turn
+ * @return 1 if the player to move wins against perfect play, 0 if the turn is a dummy move in a lost position
+ */
+int bestTurn(Game *game, Turn *turn);
+
+/**
+ * Remove the given number of pieces from the given row
+ * @param game
+ * @param chosenRow human-friendly index of the row (1, 2, 3, ...)
+ * @param pieces
+ */
+void removePieces(Game *game, int chosenRow, long long pieces);
+
+/**
+ * Take every part of a turn off the board, splitting the row under an octal code
+ * @param game
+ * @param turn
+ */
+void takeTurn(Game *game, const Turn *turn);
+
+/**
+ * Take pieces from the middle of a row: the ones to their left stay in the row, and the ones to their right move to
+ * a new row right after it, as long as there are some on both sides. The new row's size is the pieces it got, and
+ * the old row's shrinks by as much, so drawing them still shows every piece taken. The game must have room for the
+ * new row.
+ * @param game
+ * @param chosenRow human-friendly index of the row (1, 2, 3, ...)
+ * @param pieces
+ * @param left number of pieces to leave to the left of the ones taken
+ */
+void splitRow(Game *game, int chosenRow, long long pieces, long long left);
+
+/**
+ * Pick a random legal move, with every row that has pieces left equally likely
+ * @param game
+ * @param seed address of the random number generator state to use and advance
+ * @param chosenRow address to store the chosen row
+ * @param pieces address to store the chosen number of pieces to take
+ */
+void randomMove(Game *game, unsigned long long *seed, int *chosenRow, long long *pieces);
+
+/**
+ * Get the next number from a random number generator. Each thread keeps its own state, so no locking is needed
+ * and runs with the same seed repeat exactly.
+ * @param seed address of the generator state; any value works as a starting seed
+ * @return a random 64-bit number
+ */
+unsigned long long nextRandom(unsigned long long *seed);
+
+/**
+ * Parse a comma-separated list of positive numbers such as "3,5,7"
+ * @param text the list
+ * @param values array to store the numbers in
+ * @param maxValues size of the array
+ * @return how many numbers were read, or 0 if the list is invalid
+ */
+int parseList(const char *text, long long values[], int maxValues);
+
+#endif
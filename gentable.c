@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include "grundy.h"
+#include "standard.h"
+
+/**
+ * Solve every position of the standard board by trying every move, without any Grundy theory
+ * @param misere 1 if whoever takes the last piece loses, 0 if they win
+ * @param winning array to store whether the player to move wins each position, by standardIndex
+ */
+static void solve(int misere, unsigned char winning[STANDARD_STATES]);
+
+/**
+ * Build the table entry for a position from the runtime solver's move, after checking it against the exhaustive
+ * solution: grundyMove has to find a move exactly when the position is won, and that move has to leave a lost one
+ * @param rules
+ * @param heaps the position
+ * @param winning the exhaustive solution, by standardIndex
+ * @param entry address to store the entry
+ * @return 1 if the two solvers agree, 0 if not
+ */
+static int makeEntry(const Rules *rules, long long heaps[3], const unsigned char winning[STANDARD_STATES],
+                     unsigned char *entry);
+
+int main(int argc, char *argv[]) {
+    const int standardMoves[] = {1, 2, 3};
+    unsigned char winning[STANDARD_STATES], entries[2][STANDARD_STATES];
+    long long heaps[3];
+    int misere, index, mismatches = 0;
+    Rules rules;
+    FILE *file;
+
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s standardtable.c\n"
+                        "Solves the standard 3, 5, 7 board in both modes and writes the table the game is built with.\n",
+                argv[0]);
+        return 1;
+    }
+    if (!newSubtractionRules(&rules, standardMoves, 3)) {
+        fprintf(stderr, "Not enough memory\n");
+        return 1;
+    }
+
+    for (misere = 0; misere < 2; misere++) {
+        rules.misere = misere;
+        solve(misere, winning);
+        for (heaps[0] = 0; heaps[0] <= STANDARD_ROW_1; heaps[0]++)
+            for (heaps[1] = 0; heaps[1] <= STANDARD_ROW_2; heaps[1]++)
+                for (heaps[2] = 0; heaps[2] <= STANDARD_ROW_3; heaps[2]++)
+                    mismatches += !makeEntry(&rules, heaps, winning, &entries[misere][standardIndex(heaps)]);
+    }
+    freeRules(&rules);
+    if (mismatches > 0) { // Fail the build rather than ship a table the rest of the game disagrees with
+        fprintf(stderr, "The runtime solver disagrees with the exhaustive solution in %d positions\n", mismatches);
+        return 1;
+    }
+
+    file = fopen(argv[1], "w");
+    if (file == NULL) {
+        fprintf(stderr, "Cannot write %s\n", argv[1]);
+        return 1;
+    }
+    fprintf(file, "// Generated by nim-gentable when the game is built; do not edit\n"
+                  "#include \"standard.h\"\n\n"
+                  "const unsigned char standardTable[2][STANDARD_STATES] = {\n");
+    for (misere = 0; misere < 2; misere++) {
+        fprintf(file, "        { // %s play", misere ? "Misere" : "Normal");
+        for (index = 0; index < STANDARD_STATES; index++)
+            fprintf(file, "%s0x%02X,", index % 12 == 0 ? "\n                " : " ", entries[misere][index]);
+        fprintf(file, "\n        },\n");
+    }
+    fprintf(file, "};\n");
+    if (fclose(file) != 0) {
+        fprintf(stderr, "Cannot write %s\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
+
+static void solve(int misere, unsigned char winning[STANDARD_STATES]) {
+    long long heaps[3];
+    int index, row, take;
+
+    // Every move leads to a smaller index, so going up in order always finds the positions after a move solved
+    for (heaps[0] = 0; heaps[0] <= STANDARD_ROW_1; heaps[0]++) {
+        for (heaps[1] = 0; heaps[1] <= STANDARD_ROW_2; heaps[1]++) {
+            for (heaps[2] = 0; heaps[2] <= STANDARD_ROW_3; heaps[2]++) {
+                index = standardIndex(heaps);
+                winning[index] = heaps[0] + heaps[1] + heaps[2] == 0 && misere; // The other player took the last piece
+                for (row = 0; row < 3; row++) {
+                    for (take = 1; take <= 3 && take <= heaps[row]; take++) {
+                        heaps[row] -= take;
+                        winning[index] |= !winning[standardIndex(heaps)];
+                        heaps[row] += take;
+                    }
+                }
+            }
+        }
+    }
+}
+
+static int makeEntry(const Rules *rules, long long heaps[3], const unsigned char winning[STANDARD_STATES],
+                     unsigned char *entry) {
+    int index = standardIndex(heaps), chosenRow = 0, found, agree;
+    long long pieces = 0;
+
+    *entry = winning[index] ? STANDARD_WINNING : 0;
+    if (heaps[0] + heaps[1] + heaps[2] == 0)
+        return 1;
+
+    found = grundyMove(rules, heaps, 3, &chosenRow, &pieces);
+    if (!found) { // Like getAIMove, take one piece from the first row that has any
+        for (chosenRow = 1; heaps[chosenRow - 1] == 0; chosenRow++) {/* none */}
+        pieces = 1;
+    }
+    heaps[chosenRow - 1] -= pieces;
+    agree = found == winning[index] && (!found || !winning[standardIndex(heaps)]);
+    heaps[chosenRow - 1] += pieces;
+
+    if (!agree)
+        fprintf(stderr, "%s play, rows %lld %lld %lld: exhaustive %s, runtime %s\n", rules->misere ? "Misere" : "Normal",
+                heaps[0], heaps[1], heaps[2], winning[index] ? "win" : "loss", found ? "win" : "loss");
+    *entry |= (unsigned char) (chosenRow << 2 | pieces);
+    return agree;
+}
@@ -0,0 +1,349 @@
+#include <stdlib.h>
+#include <string.h>
+#include "grundy.h"
+
+#define FIRST_SEARCH_LENGTH 1024 // How many Grundy values to compute before looking for the repeat
+#define LAST_SEARCH_LENGTH (1 << 22) // Give up on rules whose values have not repeated after this many heap sizes
+
+/**
+ * Compute Grundy values directly from the definition: the smallest value no move can reach (the mex)
+ * @param rules
+ * @param values array to fill
+ * @param from first heap size to compute; everything below it must already be filled in
+ * @param to one past the last heap size to compute
+ */
+static void computeValues(const Rules *rules, unsigned short *values, long long from, long long to);
+
+/**
+ * Look for the point where the Grundy values start repeating, and store it in the rules
+ * @param rules
+ * @param values Grundy values for heap sizes 0 through length - 1
+ * @param length number of values computed
+ * @return 1 if the repeat was found, 0 if more values are needed
+ */
+static int findPeriod(Rules *rules, const unsigned short *values, long long length);
+
+/**
+ * Find a move that leaves a row with the given Grundy value
+ * @param rules
+ * @param heap number of pieces in the row
+ * @param target the Grundy value to leave the row at
+ * @param pieces address to store how many pieces to take
+ * @return 1 if there is such a move, 0 if not
+ */
+static int moveToValue(const Rules *rules, long long heap, long long target, long long *pieces);
+
+/**
+ * Find a misère move in Moore's Nim_k that leaves only rows of 0 or 1 pieces, with 1 more than a multiple of k + 1
+ * rows of 1. There always is one when 1 to k rows have 2 or more pieces, since each of those can be left at 0 or 1.
+ * @param rules
+ * @param heaps number of pieces left in each row
+ * @param heapCount number of rows
+ * @param bigRows number of rows with 2 or more pieces; at most rules->maxRows
+ * @param ones number of rows with 1 piece
+ * @param rows array to store the rows taken from (1, 2, 3, ...)
+ * @param pieces array to store the pieces taken from each of those rows
+ * @param rowCount address to store how many rows the move takes from
+ * @return 1 if a winning move was found, 0 if the rows of 1 already leave the player to move losing
+ */
+static int mooreSmallMove(const Rules *rules, const long long heaps[], int heapCount, int bigRows, int ones,
+                          int rows[], long long pieces[], int *rowCount);
+
+void newAnyAmountRules(Rules *rules) {
+    rules->misere = 1;
+    rules->anyAmount = 1;
+    rules->maxRows = 1;
+    rules->moveCount = 0;
+    rules->octal = 0;
+    rules->preperiod = 0;
+    rules->period = 0;
+    rules->table = NULL; // The Grundy value of a row in plain Nim is just its size, so there is nothing to store
+}
+
+int newSubtractionRules(Rules *rules, const int moves[], int moveCount) {
+    unsigned short *values = NULL, *grown;
+    long long length = 0, newLength;
+    int i, j, k;
+
+    rules->misere = 1;
+    rules->anyAmount = 0;
+    rules->maxRows = 1;
+    rules->moveCount = 0;
+    rules->octal = 0;
+    rules->preperiod = 0;
+    rules->period = 0;
+    rules->table = NULL;
+
+    // Copy the amounts over in increasing order (insertion sort), dropping duplicates
+    for (i = 0; i < moveCount; i++) {
+        if (moves[i] < 1)
+            return 0;
+        for (j = rules->moveCount; j > 0 && rules->moves[j - 1] > moves[i]; j--) {/* none */}
+        if (j > 0 && rules->moves[j - 1] == moves[i])
+            continue;
+        if (rules->moveCount == MAX_RULE_MOVES)
+            return 0;
+        for (k = rules->moveCount; k > j; k--) // Shift the bigger amounts up to make room
+            rules->moves[k] = rules->moves[k - 1];
+        rules->moves[j] = moves[i];
+        rules->moveCount++;
+    }
+    if (rules->moveCount == 0 || rules->moves[0] != 1) // Without 1, a row could get stuck with pieces left in it
+        return 0;
+
+    // Compute more and more values until the repeat shows up
+    for (newLength = FIRST_SEARCH_LENGTH; newLength <= LAST_SEARCH_LENGTH; newLength *= 2) {
+        grown = realloc(values, newLength * sizeof(unsigned short));
+        if (grown == NULL)
+            break;
+        values = grown;
+        computeValues(rules, values, length, newLength);
+        length = newLength;
+
+        if (findPeriod(rules, values, length)) {
+            // Only keep what is needed to look up any heap size
+            grown = realloc(values, (rules->preperiod + rules->period) * sizeof(unsigned short));
+            rules->table = grown == NULL ? values : grown;
+            return 1;
+        }
+    }
+
+    free(values);
+    return 0;
+}
+
+int newMooreRules(Rules *rules, int maxRows) {
+    if (maxRows < 1 || maxRows > MAX_MOVE_ROWS)
+        return 0;
+    newAnyAmountRules(rules);
+    rules->maxRows = maxRows;
+    return 1;
+}
+
+int parseRules(Rules *rules, const char *text) {
+    int moves[MAX_RULE_MOVES];
+    int moveCount = 0;
+    char *end;
+
+    if (strcmp(text, "any") == 0) {
+        newAnyAmountRules(rules);
+        return 1;
+    }
+    while (*text != '\0' && moveCount < MAX_RULE_MOVES) {
+        moves[moveCount++] = (int) strtol(text, &end, 10);
+        if (end == text || (*end != ',' && *end != '\0'))
+            return 0;
+        text = *end == ',' ? end + 1 : end;
+    }
+    return *text == '\0' && newSubtractionRules(rules, moves, moveCount);
+}
+
+void freeRules(Rules *rules) {
+    free(rules->table);
+    rules->table = NULL;
+}
+
+int allowedTake(const Rules *rules, long long pieces) {
+    int i;
+    if (rules->anyAmount)
+        return pieces >= 1;
+    for (i = 0; i < rules->moveCount; i++) // There are only a handful of amounts, so a scan is fastest
+        if (rules->moves[i] == pieces)
+            return 1;
+    return 0;
+}
+
+long long grundyValue(const Rules *rules, long long heap) {
+    if (rules->anyAmount)
+        return heap;
+    if (heap < rules->preperiod)
+        return rules->table[heap];
+    if (rules->period == 0) // Only values up to the heap size asked for were computed
+        return -1;
+    return rules->table[rules->preperiod + (heap - rules->preperiod) % rules->period];
+}
+
+int grundyMove(const Rules *rules, const long long heaps[], int heapCount, int *chosenRow, long long *pieces) {
+    long long X = 0; // Grundy sum of the whole board
+    int i;
+
+    if (rules->misere)
+        return misereMove(rules, heaps, heapCount, chosenRow, pieces);
+
+    for (i = 0; i < heapCount; i++)
+        X ^= grundyValue(rules, heaps[i]);
+    if (X == 0) // Every move leaves a nonzero sum, which the other player can bring back to 0
+        return 0;
+
+    for (i = 0; i < heapCount; i++) {
+        // Leave this row at the Grundy sum of every other row, so the new sum is 0
+        if (heaps[i] > 0 && moveToValue(rules, heaps[i], X ^ grundyValue(rules, heaps[i]), pieces)) {
+            *chosenRow = i + 1;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int misereMove(const Rules *rules, const long long heaps[], int heapCount, int *chosenRow, long long *pieces) {
+    long long X = 0; // Grundy sum of the whole board
+    long long value, rest, target;
+    int bigRows = 0; // Number of rows with a Grundy value of 2 or more
+    int i;
+
+    for (i = 0; i < heapCount; i++) {
+        value = grundyValue(rules, heaps[i]);
+        X ^= value;
+        bigRows += value > 1;
+    }
+
+    for (i = 0; i < heapCount; i++) {
+        if (heaps[i] == 0)
+            continue;
+        value = grundyValue(rules, heaps[i]);
+        rest = X ^ value; // Grundy sum of every other row
+
+        // Pick the one value this row has to be left at for the other player to lose
+        if (bigRows - (value > 1) == 0 && rest <= 1)
+            target = rest ^ 1; // Only small rows would be left, so leave an odd number of rows worth 1
+        else
+            target = rest; // Otherwise play exactly like normal Nim and bring the sum to 0
+
+        if (moveToValue(rules, heaps[i], target, pieces)) {
+            *chosenRow = i + 1;
+            return 1;
+        }
+    }
+    return 0; // No row can be changed to the right value, so this position is lost
+}
+
+int mooreMove(const Rules *rules, const long long heaps[], int heapCount, int rows[], long long pieces[],
+              int *rowCount) {
+    unsigned long long target[MAX_MOVE_ROWS]; // What each row taken from is left with, built up a digit at a time
+    unsigned long long digit, heap;
+    int counts[64] = {0}; // Number of rows with each binary digit set
+    int k = rules->maxRows, bigRows = 0, ones = 0, touched = 0, need, b, i, j;
+
+    for (i = 0; i < heapCount; i++) {
+        bigRows += heaps[i] > 1;
+        ones += heaps[i] == 1;
+        for (heap = (unsigned long long) heaps[i], b = 0; heap != 0; heap >>= 1, b++)
+            counts[b] += (int) (heap & 1);
+    }
+    if (rules->misere && bigRows <= k) // Every move from here can leave only small rows, where misère play differs
+        return mooreSmallMove(rules, heaps, heapCount, bigRows, ones, rows, pieces, rowCount);
+
+    // Rows already taken from have had a digit cleared, so every digit below it can be set freely
+    for (b = 63; b >= 0; b--) {
+        digit = 1ULL << b;
+        need = counts[b];
+        for (j = 0; j < touched; j++)
+            need -= (heaps[rows[j] - 1] & digit) != 0;
+        need %= k + 1;
+        if (need == 0)
+            continue;
+        if (k + 1 - need <= touched) { // Set the digit in enough of the free rows to make a multiple of k + 1
+            for (j = 0; j < k + 1 - need; j++)
+                target[j] |= digit;
+        } else { // Clear it in enough rows that have it; there is room, since touched + need <= k here
+            for (i = 0; need > 0; i++) {
+                for (j = 0; j < touched && rows[j] != i + 1; j++) {/* none */}
+                if (j < touched || !(heaps[i] & digit))
+                    continue;
+                rows[touched] = i + 1;
+                target[touched++] = (unsigned long long) heaps[i] & ~(digit | (digit - 1));
+                need--;
+            }
+        }
+    }
+
+    for (j = 0; j < touched; j++)
+        pieces[j] = heaps[rows[j] - 1] - (long long) target[j];
+    *rowCount = touched;
+    return touched > 0; // Every digit was already a multiple of k + 1, so this position is lost
+}
+
+static int mooreSmallMove(const Rules *rules, const long long heaps[], int heapCount, int bigRows, int ones,
+                          int rows[], long long pieces[], int *rowCount) {
+    int k = rules->maxRows, keep, take, i;
+
+    // Choose how many big rows to leave at 1 (keep) and how many rows of 1 to empty (take)
+    if (bigRows == 0) {
+        keep = 0;
+        take = ones == 0 ? 0 : (ones - 1) % (k + 1);
+        if (take == 0)
+            return 0;
+    } else {
+        keep = ((1 - ones) % (k + 1) + k + 1) % (k + 1);
+        take = 0;
+        if (keep > bigRows) { // Empty every big row, and make up the difference from the rows of 1
+            take = k + 1 - keep;
+            keep = 0;
+        }
+    }
+
+    *rowCount = 0;
+    for (i = 0; i < heapCount; i++) {
+        if (heaps[i] > 1) {
+            rows[*rowCount] = i + 1;
+            pieces[(*rowCount)++] = heaps[i] - (keep-- > 0);
+        } else if (heaps[i] == 1 && take > 0) {
+            rows[*rowCount] = i + 1;
+            pieces[(*rowCount)++] = 1;
+            take--;
+        }
+    }
+    return 1;
+}
+
+static int moveToValue(const Rules *rules, long long heap, long long target, long long *pieces) {
+    int j;
+
+    if (rules->anyAmount) { // Every smaller size can be reached, and the value of a row is its size
+        *pieces = heap - target;
+        return target < heap;
+    }
+    for (j = 0; j < rules->moveCount && rules->moves[j] <= heap; j++) {
+        if (grundyValue(rules, heap - rules->moves[j]) == target) {
+            *pieces = rules->moves[j];
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void computeValues(const Rules *rules, unsigned short *values, long long from, long long to) {
+    unsigned long long reached; // Bit v is set when some move reaches a row with Grundy value v
+    long long n;
+    int j, mex;
+
+    for (n = from; n < to; n++) {
+        reached = 0;
+        for (j = 0; j < rules->moveCount && rules->moves[j] <= n; j++)
+            reached |= 1ULL << values[n - rules->moves[j]]; // Values never exceed the number of moves, so they fit
+        for (mex = 0; reached & 1ULL << mex; mex++) {/* none */}
+        values[n] = (unsigned short) mex;
+    }
+}
+
+static int findPeriod(Rules *rules, const unsigned short *values, long long length) {
+    long long window = rules->moves[rules->moveCount - 1]; // The largest move
+    long long period, start, best = -1;
+
+    // If the values repeat for as long as the largest move, every later value is decided by the same earlier
+    // ones, so they repeat forever. Try every period and keep the one with the smallest table.
+    for (period = 1; period + window <= length / 2; period++) {
+        // Walk back from the end to find where this period stops matching
+        for (start = length - period; start > 0 && values[start - 1] == values[start - 1 + period]; start--) {/* none */}
+        if (length - period - start < window) // The matching stretch is too short to be sure
+            continue;
+        if (best < 0 || start + period < best) {
+            best = start + period;
+            rules->preperiod = start;
+            rules->period = period;
+        }
+        if (period >= best)
+            break; // Any longer period needs a bigger table
+    }
+    return best >= 0;
+}
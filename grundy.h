@@ -0,0 +1,123 @@
+#ifndef NIM_GRUNDY_H
+#define NIM_GRUNDY_H
+
+#define MAX_RULE_MOVES 32 // The most different amounts a subtraction rule can allow
+#define MAX_MOVE_ROWS 32 // The most rows one move can take from under Moore's Nim
+
+/**
+ * The rules for how many pieces can be taken from a row in one move, along with the Grundy values they produce.
+ * Every finite subtraction set gives Grundy values that eventually repeat, so only the part before the repeat
+ * (the preperiod) and one copy of the repeating part (the period) are stored. Octal games (see octal.h) repeat too
+ * as far as anyone knows, but not always soon enough to find, so their table can also just end.
+ */
+typedef struct {
+    int misere; // 1 if whoever takes the last piece loses (the original game), 0 if they win (normal play)
+    int anyAmount; // 1 if any number of pieces can be taken (plain Nim), 0 if only the amounts in moves can
+    int maxRows; // How many rows one move can take from: 1, or k for Moore's Nim_k (only with any amount)
+    int moveCount; // Number of allowed amounts
+    int moves[MAX_RULE_MOVES]; // Allowed amounts in increasing order; always starts with 1, except under an octal code
+    int octal; // 1 if a move can take pieces from the middle of a row and split it in two, as the digits say
+    unsigned char digits[MAX_RULE_MOVES + 1]; // Under an octal code, how taking each amount can leave the row
+    long long preperiod; // Heap sizes below this are looked up directly in the table
+    long long period; // Heap sizes from the preperiod on repeat every this many pieces, or 0 if the table just ends
+    unsigned short *table; // Grundy values for heap sizes 0 through preperiod + period - 1
+} Rules;
+
+/**
+ * Set up rules where any number of pieces can be taken from a row. Like every constructor here, this starts out
+ * in misère mode; change misere afterwards for normal play.
+ * @param rules address of the rules to set up
+ */
+void newAnyAmountRules(Rules *rules);
+
+/**
+ * Set up rules where only the given amounts can be taken from a row, and precompute their Grundy values
+ * @param rules address of the rules to set up
+ * @param moves the allowed amounts, in any order; must include 1 so the game always ends with an empty board
+ * @param moveCount number of allowed amounts
+ * @return 1 if the rules were set up successfully, 0 if the amounts are invalid or memory could not be allocated
+ */
+int newSubtractionRules(Rules *rules, const int moves[], int moveCount);
+
+/**
+ * Set up Moore's Nim_k, where one move can take any number of pieces from each of up to k rows
+ * @param rules address of the rules to set up
+ * @param maxRows how many rows one move can take from (k), from 1 to MAX_MOVE_ROWS
+ * @return 1 if the rules were set up successfully, 0 if maxRows is out of range
+ */
+int newMooreRules(Rules *rules, int maxRows);
+
+/**
+ * Set up rules from text: either "any" or a comma-separated list of amounts such as "1,2,3"
+ * @param rules address of the rules to set up
+ * @param text the rules as typed on a command line
+ * @return 1 if the rules were set up successfully, 0 if the text does not describe valid rules
+ */
+int parseRules(Rules *rules, const char *text);
+
+/**
+ * Release the memory held by a set of rules
+ * @param rules
+ */
+void freeRules(Rules *rules);
+
+/**
+ * Determine whether the rules allow taking the given number of pieces (ignoring how many are left in the row)
+ * @param rules
+ * @param pieces
+ * @return 1 if the amount is allowed, 0 if not
+ */
+int allowedTake(const Rules *rules, long long pieces);
+
+/**
+ * Look up the Grundy value of a single row
+ * @param rules
+ * @param heap number of pieces in the row
+ * @return the Grundy value, or -1 if the rules' values never repeated and the table ends at or before the heap
+ */
+long long grundyValue(const Rules *rules, long long heap);
+
+/**
+ * Find a move that leaves the other player in a losing position. In normal play, that means bringing the Grundy
+ * sum of the rows to 0. In misère play, see misereMove.
+ * @param rules
+ * @param heaps number of pieces left in each row
+ * @param heapCount number of rows
+ * @param chosenRow address to store the chosen row (1, 2, 3, ...)
+ * @param pieces address to store the chosen number of pieces to take
+ * @return 1 if a winning move was found, 0 if every move loses against perfect play
+ */
+int grundyMove(const Rules *rules, const long long heaps[], int heapCount, int *chosenRow, long long *pieces);
+
+/**
+ * Find a winning move when whoever takes the last piece loses, in one pass over the rows. Grundy values stand in
+ * for the rows, and the misère Nim rule decides which total to aim for: while any row has a Grundy value of 2 or
+ * more, aim for a Grundy sum of 0 like normal play; otherwise leave an odd number of rows with a value of 1. This
+ * is exact for every subtraction set that contains 1, including the standard take-1-to-3 rule.
+ * @param rules
+ * @param heaps number of pieces left in each row
+ * @param heapCount number of rows
+ * @param chosenRow address to store the chosen row (1, 2, 3, ...)
+ * @param pieces address to store the chosen number of pieces to take
+ * @return 1 if a winning move was found, 0 if every move loses against perfect play
+ */
+int misereMove(const Rules *rules, const long long heaps[], int heapCount, int *chosenRow, long long *pieces);
+
+/**
+ * Find a winning move in Moore's Nim_k without searching. Writing each row in binary, a position is lost for the
+ * player to move exactly when every binary digit is 1 in a multiple of k + 1 rows. The move is built from the top
+ * digit down, so it takes one pass over the rows to count the digits and one more per digit at most. In misère
+ * play the same holds while more than k rows have 2 or more pieces; with fewer, aim to leave only rows of 1, as
+ * many as 1 more than a multiple of k + 1.
+ * @param rules
+ * @param heaps number of pieces left in each row
+ * @param heapCount number of rows
+ * @param rows array of rules->maxRows entries to store the rows taken from (1, 2, 3, ...)
+ * @param pieces array of rules->maxRows entries to store the pieces taken from each of those rows
+ * @param rowCount address to store how many rows the move takes from
+ * @return 1 if a winning move was found, 0 if every move loses against perfect play
+ */
+int mooreMove(const Rules *rules, const long long heaps[], int heapCount, int rows[], long long pieces[],
+              int *rowCount);
+
+#endif
@@ -0,0 +1,365 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+#include "journal.h"
+#include "save.h"
+
+#define JOURNAL_MAGIC "NIMJRN" // Marks a journal file
+#define JOURNAL_VERSION 2 // Version written into new journals; version 1 only had moves from a single row
+#define JOURNAL_HEADER_SIZE 8 // Magic, version, then the computer's player number plus 1 (0 if there is none)
+
+/**
+ * Write the whole game as the only contents of a new journal file, then put it in place of the old one. The new
+ * file is flushed to disk before the rename and the directory after it, so a crash leaves either the old journal
+ * or the new one, never a mix.
+ * @param fileName
+ * @param game
+ * @param player the player who is up next
+ * @param aiPlayer the computer's player number (0 or 1), or -1 if there is no computer player
+ * @return a descriptor for appending to the new journal, or -1 if it could not be written
+ */
+static int writeCheckpoint(const char *fileName, const Game *game, int player, int aiPlayer);
+
+/**
+ * Flush the directory a file is in to disk, so a rename in it survives a crash
+ * @param fileName
+ * @return 1 if the directory was flushed, 0 otherwise
+ */
+static int syncDirectory(const char *fileName);
+
+/**
+ * Write batches of moves as they come in until the journal is closed; run by the journal's background thread
+ * @param argument address of the journal
+ * @return NULL
+ */
+static void *flushBatches(void *argument);
+
+int openJournal(Journal *journal, const char *fileName, const Game *game, int player, int aiPlayer) {
+    memset(journal, 0, sizeof(*journal));
+    journal->aiPlayer = aiPlayer;
+    journal->octal = game->rules->octal;
+    journal->fileName = malloc(strlen(fileName) + 1);
+    if (journal->fileName == NULL)
+        return 0;
+    strcpy(journal->fileName, fileName);
+
+    journal->file = writeCheckpoint(fileName, game, player, aiPlayer);
+    if (journal->file < 0) {
+        free(journal->fileName);
+        return 0;
+    }
+    pthread_mutex_init(&journal->lock, NULL);
+    pthread_cond_init(&journal->wake, NULL);
+    pthread_cond_init(&journal->flushed, NULL);
+    if (pthread_create(&journal->flusher, NULL, flushBatches, journal) != 0) {
+        pthread_mutex_destroy(&journal->lock);
+        pthread_cond_destroy(&journal->wake);
+        pthread_cond_destroy(&journal->flushed);
+        close(journal->file);
+        free(journal->fileName);
+        return 0;
+    }
+    return 1;
+}
+
+int journalTurn(Journal *journal, const Turn *turn) {
+    size_t needed = (2 + journal->octal) * MAX_NUMBER_BYTES * (size_t) turn->count, capacity;
+    unsigned char *grown, *out;
+    int recorded = 0, i;
+
+    pthread_mutex_lock(&journal->lock);
+    if (journal->used + needed > journal->capacity) { // Make room for the longest possible encoding of the turn
+        for (capacity = journal->capacity ? journal->capacity : 64 * MAX_NUMBER_BYTES; journal->used + needed > capacity;
+             capacity *= 2) {/* none */}
+        grown = realloc(journal->pending, capacity);
+        if (grown != NULL) {
+            journal->pending = grown;
+            journal->capacity = capacity;
+        }
+    }
+    if (!journal->failed && journal->used + needed <= journal->capacity) {
+        // The low bit of each row says whether another row of the same turn follows
+        out = journal->pending + journal->used;
+        for (i = 0; i < turn->count; i++) {
+            out = putNumber(out, (unsigned long long) turn->rows[i] << 1 | (i + 1 < turn->count));
+            out = putNumber(out, (unsigned long long) turn->pieces[i]);
+            if (journal->octal) // Octal turns take from one row, so this is only ever written once
+                out = putNumber(out, (unsigned long long) turn->left);
+        }
+        journal->used = out - journal->pending;
+        if (journal->pendingMoves++ == 0 || journal->pendingMoves >= JOURNAL_COMMIT_MOVES)
+            pthread_cond_signal(&journal->wake); // Start the clock on a new batch, or cut a full one short
+        journal->moves++;
+        recorded = 1;
+    }
+    pthread_mutex_unlock(&journal->lock);
+    return recorded;
+}
+
+int syncJournal(Journal *journal) {
+    int synced;
+
+    pthread_mutex_lock(&journal->lock);
+    journal->syncing++;
+    pthread_cond_signal(&journal->wake); // Write what is pending now instead of waiting for more moves
+    while (journal->written < journal->moves && !journal->failed)
+        pthread_cond_wait(&journal->flushed, &journal->lock);
+    journal->syncing--;
+    synced = !journal->failed;
+    pthread_mutex_unlock(&journal->lock);
+    return synced;
+}
+
+int compactJournal(Journal *journal, const Game *game, int player) {
+    int file, compacted = 0;
+
+    if (!syncJournal(journal))
+        return 0;
+
+    // Every move is on disk, so the flusher is idle until the next one; holding the lock keeps it that way
+    pthread_mutex_lock(&journal->lock);
+    file = writeCheckpoint(journal->fileName, game, player, journal->aiPlayer);
+    if (file >= 0) {
+        close(journal->file);
+        journal->file = file;
+        journal->moves = journal->written = 0;
+        compacted = 1;
+    }
+    pthread_mutex_unlock(&journal->lock);
+    return compacted;
+}
+
+int closeJournal(Journal *journal) {
+    int synced = syncJournal(journal);
+
+    pthread_mutex_lock(&journal->lock);
+    journal->closing = 1;
+    pthread_cond_signal(&journal->wake);
+    pthread_mutex_unlock(&journal->lock);
+    pthread_join(journal->flusher, NULL);
+
+    synced = close(journal->file) == 0 && synced;
+    pthread_mutex_destroy(&journal->lock);
+    pthread_cond_destroy(&journal->wake);
+    pthread_cond_destroy(&journal->flushed);
+    free(journal->pending);
+    free(journal->fileName);
+    return synced;
+}
+
+int replayJournal(Game *game, Rules *rules, int *player, int *aiPlayer, const char *fileName, long long *moves) {
+    const unsigned char *data, *in, *end, *batchEnd, *next;
+    unsigned long long length, row, pieces, left = 0;
+    unsigned int sum;
+    struct stat info;
+    void *mapping;
+    size_t size;
+    long long replayed = 0;
+    int file = open(fileName, O_RDONLY), valid, intact = 1, flagged, more, i;
+    Turn turn;
+
+    if (file < 0)
+        return 0;
+    if (fstat(file, &info) != 0 || info.st_size < JOURNAL_HEADER_SIZE) {
+        close(file);
+        return 0;
+    }
+    size = info.st_size;
+    mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file); // The mapping stays valid after the file is closed
+    if (mapping == MAP_FAILED)
+        return 0;
+    madvise(mapping, size, MADV_SEQUENTIAL); // Long games are read once from front to back
+    data = mapping;
+    end = data + size;
+
+    // The checkpoint is written before the journal is renamed into place, so it is always complete
+    in = getNumber(data + JOURNAL_HEADER_SIZE, end, &length);
+    valid = memcmp(data, JOURNAL_MAGIC, strlen(JOURNAL_MAGIC)) == 0 && data[6] >= 1 && data[6] <= JOURNAL_VERSION && data[7] <= 2 &&
+            in != NULL && length <= (unsigned long long) (end - in) && decodeSave(game, rules, player, in, length);
+    if (!valid) {
+        munmap(mapping, size);
+        return 0;
+    }
+    *aiPlayer = data[7] - 1;
+    flagged = data[6] > 1; // Whether rows carry the flag for another row of the same turn
+    in += length;
+
+    // A batch is its length, its moves, then a checksum of the moves; a crash can only cut off the last one
+    while (intact && in < end) {
+        in = getNumber(in, end, &length);
+        if (in == NULL || length > (unsigned long long) (end - in) || end - in - length < 4)
+            break;
+        batchEnd = in + length;
+        for (sum = 0, i = 0; i < 4; i++)
+            sum |= (unsigned int) batchEnd[i] << (8 * i);
+        if (sum != checksum(in, length))
+            break;
+
+        for (turn.count = 0; intact && in < batchEnd; in = next) {
+            next = getNumber(in, batchEnd, &row);
+            next = next == NULL ? NULL : getNumber(next, batchEnd, &pieces);
+            if (rules->octal) // The checkpoint's rules say whether turns say where in the row they took from
+                next = next == NULL ? NULL : getNumber(next, batchEnd, &left);
+            more = flagged && (row & 1);
+            row >>= flagged;
+            intact = next != NULL && turn.count < MAX_MOVE_ROWS && row <= (unsigned long long) game->heapCount &&
+                     pieces <= (unsigned long long) game->total && left <= (unsigned long long) game->total;
+            if (!intact)
+                break;
+            turn.rows[turn.count] = (int) row;
+            turn.pieces[turn.count++] = (long long) pieces;
+            turn.left = (long long) left;
+            if (!more) {
+                intact = legalTurn(game, &turn);
+                if (intact) {
+                    takeTurn(game, &turn);
+                    *player = !*player;
+                    replayed++;
+                }
+                turn.count = 0;
+            }
+        }
+        intact = intact && turn.count == 0; // A batch only ever holds whole turns
+        in = batchEnd + 4;
+    }
+    munmap(mapping, size);
+    if (moves != NULL)
+        *moves = replayed;
+    return 1;
+}
+
+static int writeCheckpoint(const char *fileName, const Game *game, int player, int aiPlayer) {
+    unsigned char header[JOURNAL_HEADER_SIZE + MAX_NUMBER_BYTES], *save;
+    struct iovec parts[2];
+    size_t size, headerSize;
+    char *temporary;
+    int file, written;
+
+    save = encodeSave(game, player, &size);
+    temporary = malloc(strlen(fileName) + 5);
+    if (save == NULL || temporary == NULL) {
+        free(save);
+        free(temporary);
+        return -1;
+    }
+    memcpy(header, JOURNAL_MAGIC, strlen(JOURNAL_MAGIC));
+    header[6] = JOURNAL_VERSION;
+    header[7] = (unsigned char) (aiPlayer + 1);
+    headerSize = putNumber(header + JOURNAL_HEADER_SIZE, size) - header;
+    parts[0].iov_base = header;
+    parts[0].iov_len = headerSize;
+    parts[1].iov_base = save;
+    parts[1].iov_len = size;
+
+    strcpy(temporary, fileName);
+    strcat(temporary, ".tmp");
+    file = open(temporary, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    written = file >= 0 && writev(file, parts, 2) == (ssize_t) (headerSize + size) && fsync(file) == 0 &&
+              rename(temporary, fileName) == 0 && syncDirectory(fileName);
+    if (!written && file >= 0) {
+        close(file);
+        unlink(temporary);
+        file = -1;
+    }
+    free(save);
+    free(temporary);
+    return file; // The descriptor still refers to the file, now under its real name
+}
+
+static int syncDirectory(const char *fileName) {
+    const char *slash = strrchr(fileName, '/');
+    char *directory;
+    int file, synced;
+
+    if (slash == NULL) {
+        directory = malloc(2);
+        if (directory != NULL)
+            strcpy(directory, ".");
+    } else {
+        directory = malloc(slash - fileName + 2);
+        if (directory != NULL) {
+            memcpy(directory, fileName, slash - fileName + 1); // Keep the slash, so "/name" gives "/"
+            directory[slash - fileName + 1] = '\0';
+        }
+    }
+    if (directory == NULL)
+        return 0;
+    file = open(directory, O_RDONLY | O_DIRECTORY);
+    free(directory);
+    if (file < 0)
+        return 0;
+    synced = fsync(file) == 0 || errno == EINVAL; // Some file systems cannot flush a directory and do not need to
+    close(file);
+    return synced;
+}
+
+static void *flushBatches(void *argument) {
+    Journal *journal = argument;
+    unsigned char *batch = NULL, *swap, length[MAX_NUMBER_BYTES], sum[4];
+    size_t batchCapacity = 0, used, capacity;
+    struct iovec parts[3];
+    struct timespec deadline;
+    unsigned int check;
+    int moves, file, written, i;
+
+    pthread_mutex_lock(&journal->lock);
+    while (1) {
+        while (journal->pendingMoves == 0 && !journal->closing)
+            pthread_cond_wait(&journal->wake, &journal->lock);
+        if (journal->pendingMoves == 0)
+            break; // Closing, with nothing left to write
+
+        // Let the moves that follow soon after share this batch, unless someone is waiting for it
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += JOURNAL_COMMIT_MS * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        while (!journal->closing && !journal->syncing && journal->pendingMoves < JOURNAL_COMMIT_MOVES &&
+               pthread_cond_timedwait(&journal->wake, &journal->lock, &deadline) != ETIMEDOUT) {/* none */}
+
+        // Swap buffers, so new moves can be recorded while this batch is written
+        used = journal->used;
+        moves = journal->pendingMoves;
+        capacity = journal->capacity;
+        swap = batch;
+        batch = journal->pending;
+        journal->pending = swap;
+        journal->capacity = batchCapacity;
+        batchCapacity = capacity;
+        journal->used = 0;
+        journal->pendingMoves = 0;
+        file = journal->file;
+        pthread_mutex_unlock(&journal->lock);
+
+        check = checksum(batch, used);
+        for (i = 0; i < 4; i++) // Little-endian, like the checksum of a save
+            sum[i] = (unsigned char) (check >> (8 * i));
+        parts[0].iov_base = length;
+        parts[0].iov_len = putNumber(length, used) - length;
+        parts[1].iov_base = batch;
+        parts[1].iov_len = used;
+        parts[2].iov_base = sum;
+        parts[2].iov_len = 4;
+        written = writev(file, parts, 3) == (ssize_t) (parts[0].iov_len + used + 4) && fdatasync(file) == 0;
+
+        pthread_mutex_lock(&journal->lock);
+        if (written) {
+            journal->written += moves;
+            journal->batches++;
+        } else {
+            journal->failed = 1;
+        }
+        pthread_cond_broadcast(&journal->flushed);
+    }
+    pthread_mutex_unlock(&journal->lock);
+    free(batch);
+    return NULL;
+}
@@ -0,0 +1,97 @@
+#ifndef NIM_JOURNAL_H
+#define NIM_JOURNAL_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include "game.h"
+
+#define JOURNAL_COMMIT_MOVES 256 // Most moves held in memory before they are written out without waiting
+#define JOURNAL_COMMIT_MS 20 // Longest a move waits to be written, so moves close together share one flush
+#define JOURNAL_COMPACT_MOVES 4096 // Moves after which a journal is worth compacting
+
+/**
+ * An append-only record of a game, so it can be picked up again after a crash. The file starts with a checkpoint
+ * of the whole game in the save format, then holds batches of moves made since then. Moves are only copied into
+ * memory as they are made; a background thread writes each batch with a single write and flush to disk, so every
+ * move made while a flush is going on goes out with the next one. Compacting replaces the file with a new
+ * checkpoint, written to a temporary file and renamed over the old one, so there is always a complete journal on
+ * disk.
+ */
+typedef struct {
+    char *fileName; // The journal file
+    int aiPlayer; // The computer's player number (0 or 1), or -1 if there is no computer player
+    int octal; // 1 if the game is played under an octal code, so each turn also says where in the row it took from
+    pthread_t flusher; // Writes batches in the background
+    pthread_mutex_t lock; // Guards everything below
+    pthread_cond_t wake; // Signaled when there are moves to write or the journal is closing
+    pthread_cond_t flushed; // Signaled after every batch is on disk
+    int file; // Descriptor the batches are appended to
+    unsigned char *pending; // Encoded moves not written yet
+    size_t used, capacity; // Bytes in pending and bytes allocated
+    int pendingMoves; // Moves in pending
+    long long moves; // Moves made since the checkpoint
+    long long written; // Moves since the checkpoint that are on disk
+    long long batches; // Batches written since the journal was opened
+    int syncing; // Number of threads waiting for everything to be written
+    int closing; // 1 once the flusher should stop
+    int failed; // 1 once a write failed; later moves are dropped
+} Journal;
+
+/**
+ * Start a journal with a checkpoint of the game, replacing the file if it exists
+ * @param journal address of the journal to set up
+ * @param fileName
+ * @param game
+ * @param player the player who is up next
+ * @param aiPlayer the computer's player number (0 or 1), or -1 if there is no computer player
+ * @return 1 if the journal is ready, 0 if the file could not be written or memory could not be allocated
+ */
+int openJournal(Journal *journal, const char *fileName, const Game *game, int player, int aiPlayer);
+
+/**
+ * Record a turn, from however many rows it takes. This only copies it into memory; it reaches the disk with the
+ * next batch.
+ * @param journal
+ * @param turn
+ * @return 1 if the turn was recorded, 0 if memory ran out or an earlier write failed
+ */
+int journalTurn(Journal *journal, const Turn *turn);
+
+/**
+ * Wait until every recorded move is on disk
+ * @param journal
+ * @return 1 if every move was written, 0 if a write failed
+ */
+int syncJournal(Journal *journal);
+
+/**
+ * Replace the journal with a checkpoint of the game, dropping the moves that led to it
+ * @param journal
+ * @param game the game after every recorded move
+ * @param player the player who is up next
+ * @return 1 if the new checkpoint is in place, 0 if it could not be written; the old journal is kept then
+ */
+int compactJournal(Journal *journal, const Game *game, int player);
+
+/**
+ * Write any moves still in memory, stop the background thread and release the journal
+ * @param journal
+ * @return 1 if every move was written, 0 if a write failed
+ */
+int closeJournal(Journal *journal);
+
+/**
+ * Rebuild a game from a journal with a single memory mapping of the file. Each move is checked and applied in time
+ * proportional to the rows it takes from (or to the rows after it, if it splits a row), and replay stops at the first
+ * batch that was not completely written, as after a crash.
+ * @param game the game to load the board into; its old board is freed
+ * @param rules the rules the game points to, replaced by the rules in the checkpoint
+ * @param player address to store the player who is up next
+ * @param aiPlayer address to store the computer's player number (0 or 1), or -1 if there is no computer player
+ * @param fileName
+ * @param moves address to store the number of moves replayed after the checkpoint, or NULL
+ * @return 1 if the journal was replayed, 0 if it could not be opened or its checkpoint is not valid
+ */
+int replayJournal(Game *game, Rules *rules, int *player, int *aiPlayer, const char *fileName, long long *moves);
+
+#endif
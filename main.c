@@ -1,253 +1,281 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include "nim.h"
+#include "render.h"
+#include "stats.h"
 
 // Define color codes/text placeholders
-#define BOARD_BG "\e[48;5;255m"
-#define EMPTY_PIECE "\e[1;38;2;200;200;240m"
-#define FULL_PIECE "\e[1;38;2;50;50;240m"
 #define GAME_END "\e[4;1;38;2;152;195;121m"
 #define NIM "\e[1;4;38;5;166mN\e[1;38;5;142mi\e[1;38;5;117mm\e[0;1;38;2;255;255;255m"
 #define PIECES "\e[1;95m"
 #define PLAYER "\e[1;91m"
-#define RESET "\e[0;1;38;2;255;255;255m"
-#define ROW_LABEL "\e[1;38;5;161m"
 #define SPACER "-------------------------------------------------------------------------\n"
+#define TABLEBASE_FILE "nim.tb" // Solved positions made by nim-tbgen, used by the computer player if present
+#define JOURNAL_FILE "nim.journal" // Every move of the game being played, so it can be resumed if it is interrupted
+#define STATS_FILE "nim-stats.json" // Timings of the hot paths, written on exit or SIGUSR1 when built with NIM_STATS
+#define MCTS_NODES (1 << 19) // Nodes in the Monte Carlo player's tree, about 40 MB
+#define OCTAL_CACHE_FILE "nim-octal.cache" // Grundy values of the last octal code played, so they are worked out once
+#define MAX_OCTAL_ROWS 64 // Most rows an octal game can start with
+#define MAX_OCTAL_ROW 1000000 // Most pieces a row of an octal game can start with
 
 /**
- * Determine if the game is over
- * @param row0
- * @param row1
- * @param row2
- * @return 1 if the game is over, 0 if not
- */
-int gameWon(int row0[3], int row1[5], int row2[7]);
-
-/**
- * Prompt the user for their next move
- * @param row0
- * @param row1
- * @param row2
+ * Prompt the user for their next move, or for where to scroll the board if they enter row 0 and it does not fit
+ * @param game
+ * @param renderer the renderer the board is drawn with
  * @param chosenRow address to store the chosen row
  * @param pickedRowFlag address for flag for whether the user has successfully picked a row
  * @param pieces address to store the chosen number of pieces to take
+ * @param left address to store how many pieces to leave to the left of the ones taken, which is only asked for in
+ * octal games
  * @param saveFlag address for flag for whether the user has opted to save the game at this point
  * @return 1 if the move has been chosen successfully or if the user chose to save the game, 0 otherwise
  */
-int getMove(int row0[3], int row1[5], int row2[7], int *chosenRow, int *pickedRowFlag, int *pieces, int *saveFlag);
-
-/**
- * Determine whether a given move is legal
- * @param row0
- * @param row1
- * @param row2
- * @param chosenRow
- * @param pieces
- * @return 1 if the move is legal, 0 if not
- */
-int legalMove(int row0[3], int row1[5], int row2[7], int chosenRow, int pieces);
+int getMove(Game *game, Renderer *renderer, int *chosenRow, int *pickedRowFlag, long long *pieces, long long *left,
+            int *saveFlag);
 
 /**
- * Calculate the nim sum of three given rows (same thing as XOR)
- * @param row0
- * @param row1
- * @param row2
- * @return the nim sum
+ * Under rules that let a move take from several rows, prompt the user for another row to add to their turn
+ * @param game
+ * @param turn address of the turn so far, which the row is added to
+ * @return 1 if the user may still add rows, 0 if they ended their turn
  */
-int nimSum(int row0[3], int row1[5], int row2[7]);
+int getExtraRow(Game *game, Turn *turn);
 
 /**
  * Read a game from a file
- * @param row0
- * @param row1
- * @param row2
+ * @param game the game to load the board into
+ * @param rules address of the rules, replaced by the ones the game was saved with
  * @param player address to store the player who is up next read from the file
  * @return 1 if the file was read successfully, 0 otherwise
  */
-int readGame(int row0[3], int row1[5], int row2[7], int *player);
-
-/**
- * Count the number of pieces left in a row
- * @param row
- * @param size the total number of pieces that can fit in this row
- * @return the number of pieces left in the row
- */
-int rowSum(int row[], int size);
+int readGame(Game *game, Rules *rules, int *player);
 
 /**
  * Write the game to a file
- * @param row0
- * @param row1
- * @param row2
+ * @param game
  * @param player the player who is up next
  * @return 1 if the game was written successfully, 0 otherwise
  */
-int writeGame(int row0[3], int row1[5], int row2[7], int player);
+int writeGame(Game *game, int player);
 
 /**
- * Pretty print the game board
- * @param row0
- * @param row1
- * @param row2
- */
-void displayBoard(int row0[3], int row1[5], int row2[7]);
-
-/**
- * Make the first allowed move given the rows
- * @param row0
- * @param row1
- * @param row2
- * @param chosenRow address to store the chosen row
- * @param pieces address to store the chosen number of pieces to take
- */
-void firstAvailableMove(int row0[3], int row1[5], int row2[7], int *chosenRow, int *pieces);
-
-/**
- * Get the next best legal move in the game
- * @param row0
- * @param row1
- * @param row2
- * @param chosenRow address to store the chosen row
- * @param pieces address to store the chosen number of pieces to take
+ * Rebuild the last game that did not finish from the journal
+ * @param game the game to load the board into
+ * @param rules address of the rules, replaced by the ones the game was played with
+ * @param player address to store the player who is up next
+ * @param computerGame address of boolean for whether the game was against the computer
+ * @param aiPlayer address to store the computer's player number (0 or 1)
+ * @return 1 if the game was rebuilt successfully, 0 otherwise
  */
-void getAIMove(int row0[3], int row1[5], int row2[7], int *chosenRow, int *pieces);
+int resumeGame(Game *game, Rules *rules, int *player, int *computerGame, int *aiPlayer);
 
 /**
- * Pretty print a single row
- * @param row
- * @param number human-friendly index of the row (1, 2, 3)
- * @param size the total number of items that fit in this row
+ * Prompt the user for options on how they can play against the computer
+ * @param aiPlayer address of the computer's player number (0 or 1)
+ * @param thinkingTime address to store the seconds the Monte Carlo player thinks per move, or 0 for perfect play
  */
-void printRow(int row[], int number, int size);
+void setUpAI(int *aiPlayer, double *thinkingTime);
 
 /**
- * Read a single row from a file
- * @param file address of the file data
- * @param row the row to save data into
+ * Prompt the user for which amounts can be taken in one move, and for the rows to start with in an octal game
+ * @param rules address of the rules to set up
+ * @param game the game to replace the board of, if the user picks an octal game
  */
-void readRow(FILE *file, int row[]);
+void setUpRules(Rules *rules, Game *game);
 
 /**
- * Remove the given number of pieces from the given row
- * @param row
- * @param pieces
+ * Prompt the user for whether taking the last piece wins or loses
+ * @param rules address of the rules to set the mode of
  */
-void removePieces(int row[], int pieces);
-
-/**
- * Prompt the user for options on how they can play against the computer
- * @param aiPlayer address of the computer's player number (0 or 1)
- */
-void setUpAI(int *aiPlayer);
+void setUpMode(Rules *rules);
 
 /**
  * Prompt the user for options on how they can play the game
- * @param row0
- * @param row1
- * @param row2
+ * @param game
+ * @param rules address of the rules for new games
  * @param player address of the player who is up (0 or 1)
  * @param computerGame address of boolean for whether this game is against the computer
  * @param aiPlayer address of the computer's player number (0 or 1)
+ * @param thinkingTime address of the seconds the Monte Carlo player thinks per move, or 0 for perfect play
  */
-void setUpGame(int row0[3], int row1[5], int row2[7], int *player, int *computerGame, int *aiPlayer);
-
-/**
- * Write a single row to a file
- * @param file address of the file data
- * @param row the row to write
- * @param size the number of items that can fit in the row
- */
-void writeRow(FILE *file, int row[], int size);
+void setUpGame(Game *game, Rules *rules, int *player, int *computerGame, int *aiPlayer, double *thinkingTime);
 
 int main(void) {
-    // Arrays for each row
-    int row0[] = {1, 1, 1};
-    int row1[] = {1, 1, 1, 1, 1};
-    int row2[] = {1, 1, 1, 1, 1, 1, 1};
-    int *row; // Pointer for passing individual rows to functions
+    const long long startingSizes[] = {3, 5, 7}; // The standard board
+    const int standardMoves[] = {1, 2, 3}; // The standard rules: take 1, 2, or 3 pieces
+    Rules rules; // Which amounts can be taken in one move
+    Tablebase tablebase; // Solved positions for the computer player
+    Renderer renderer; // Draws the board, updating only what changed from one turn to the next
+    Journal journal; // Records every move so the game can be resumed after a crash
+    Mcts mcts; // Plays out random games to pick the computer's moves, if the user chose it over perfect play
+    double thinkingTime = 0; // Seconds the Monte Carlo player thinks per move, or 0 if it is not playing
+    Ponderer ponderer; // Works out the computer's replies while the user is choosing their move
+    int havePonderer = 0; // Whether the ponderer could be set up
+    int pondered = 0; // Whether the computer's next turn was worked out while the user was choosing theirs
+    Turn reply; // The computer's next turn, if it was pondered
+    long long moveMade = 0; // When the user finished their last move, until the computer replies (with NIM_STATS)
+    int haveJournal; // Whether the journal could be started
+    int haveTablebase; // Whether the tablebase file was found
+    Game game; // The state of the board
     int aiPlayer; // Which turn the AI player gets
     int chosenRow; // Which row the player chose to take from
+    Turn turn; // Every row taken from this turn, which can be more than one under Moore's Nim
     int pickedRowFlag; // Tracks whether the player has successfully picked a row
-    int pieces; // How many pieces the player chose to take
+    long long pieces; // How many pieces the player chose to take
+    long long left; // How many pieces the player chose to leave to the left of the ones they took, in octal games
     int computerGame = 0; // Whether the player is playing against the computer
     int player = 0; // Which player's turn it is; 0 = A; 1 = B
     int saveGameFlag = 0; // Tracks whether the player chose to save the game on their most recent input
+    int succeeded; // Result of the last timed call
+    int i;
+
+    STATS_START(STATS_FILE);
+
+    if (!newSubtractionRules(&rules, standardMoves, 3) || !newGame(&game, 3, startingSizes, &rules)) {
+        printf("Not enough memory to start a game.\n");
+        return 1;
+    }
 
     printf(RESET"Welcome to "NIM"!\n");
 
-    setUpGame(row0, row1, row2, &player, &computerGame, &aiPlayer);
+    setUpGame(&game, &rules, &player, &computerGame, &aiPlayer, &thinkingTime);
+
+    // Only hand the tablebase to the game if it was solved for the rules that were picked
+    haveTablebase = openTablebase(&tablebase, TABLEBASE_FILE);
+    if (haveTablebase && tablebaseMatches(&tablebase, &rules))
+        game.tablebase = &tablebase;
+
+    if (computerGame && thinkingTime > 0) {
+        if (rules.octal) {
+            printf("The Monte Carlo player cannot split rows. The computer will play perfectly.\n");
+        } else if (newMcts(&mcts, &rules, MCTS_NODES)) {
+            mcts.timeLimit = thinkingTime;
+            game.mcts = &mcts;
+        } else {
+            printf("Not enough memory for the Monte Carlo player. The computer will play perfectly.\n");
+        }
+    }
+
+    if (computerGame)
+        havePonderer = newPonderer(&ponderer);
+
+    newRenderer(&renderer);
+
+    haveJournal = openJournal(&journal, JOURNAL_FILE, &game, player, computerGame ? aiPlayer : -1);
+    if (!haveJournal)
+        printf("Could not write to "JOURNAL_FILE". This game cannot be resumed if it is interrupted.\n");
 
     // Loop as long as the game is not won and there user did not choose to save the game
-    while (!gameWon(row0, row1, row2) && !saveGameFlag) {
+    while (!gameWon(&game) && !saveGameFlag) {
         printf(SPACER);
-        displayBoard(row0, row1, row2);
+        STATS_SPAN(STAT_DRAW_BOARD, drawBoard(&renderer, &game));
         printf("It is player "PLAYER"%c"RESET"'s turn.\n", player ? 'B' : 'A');
 
         // This condition ensures the program does not ask for a move if it is the computer's turn
         if (!computerGame || player != aiPlayer) {
+            if (havePonderer) // Think about every reply while the user thinks about their move
+                startPondering(&ponderer, &game);
+
             printf("What move would you like to make?\n");
+            if (rules.maxRows > 1)
+                printf("You can take from up to %d rows this turn.\n", rules.maxRows);
             pickedRowFlag = 0;
 
             // As long as the move is not successful, continue asking
-            while (!getMove(row0, row1, row2, &chosenRow, &pickedRowFlag, &pieces, &saveGameFlag)) {/* none */}
+            do {
+                STATS_SPAN(STAT_GET_MOVE, succeeded = getMove(&game, &renderer, &chosenRow, &pickedRowFlag, &pieces,
+                                                              &left, &saveGameFlag));
+            } while (!succeeded);
+            turn.count = 1;
+            turn.rows[0] = chosenRow;
+            turn.pieces[0] = pieces;
+            turn.left = left;
+
+            // Under Moore's Nim, keep adding rows until the user ends their turn or reaches the limit
+            while (!saveGameFlag && turn.count < rules.maxRows && succeeded)
+                STATS_SPAN(STAT_GET_EXTRA_ROW, succeeded = getExtraRow(&game, &turn));
+
+            // Drop the replies to every other move, keeping the one to the move the user made if it is ready
+            STATS_MARK(moveMade);
+            if (havePonderer)
+                STATS_SPAN(STAT_STOP_PONDERING,
+                           pondered = stopPondering(&ponderer, saveGameFlag ? NULL : &turn, &reply));
         } else { // Otherwise, it must be the computer's turn to choose a move
-            getAIMove(row0, row1, row2, &chosenRow, &pieces);
+            if (pondered) {
+                turn = reply;
+            } else {
+                STATS_SPAN(STAT_AI_TURN, getAITurn(&game, &turn));
+                if (game.mcts != NULL)
+                    printf("The computer played out %lld games in %.2f seconds.\n", mcts.playouts, mcts.seconds);
+            }
+            if (moveMade != 0) { // Only set with NIM_STATS, when the computer is replying to the user
+                STATS_SINCE(STAT_REPLY, moveMade);
+                STATS_COUNT(pondered ? COUNTER_PONDER_HITS : COUNTER_PONDER_MISSES);
+                moveMade = 0;
+            }
+            pondered = 0;
         }
 
         if (saveGameFlag) { // If the user chose to save the game in their last move
             // This condition calls the function to save the game. If it FAILS, then the condition will pass
-            if (!writeGame(row0, row1, row2, player)) {
+            STATS_SPAN(STAT_WRITE_GAME, succeeded = writeGame(&game, player));
+            if (!succeeded) {
                 saveGameFlag = 0;
                 continue; // Since saving failed, return to the game that was going on
             }
         } else { // If we got here and the user did not try to save, then they successfully chose a move.
-            printf("Player "PLAYER"%c"RESET" will remove "PIECES"%d"RESET" pieces from "ROW_LABEL"Row %d"RESET"\n",
-                   player ? 'B' : 'A', pieces, chosenRow);
-
-            // Translate the rows from 1 indexed (user-facing) to the real variable names
-            if (chosenRow == 1)
-                row = row0;
-            else if (chosenRow == 2)
-                row = row1;
-            else
-                row = row2;
+            printf("Player "PLAYER"%c"RESET" will remove", player ? 'B' : 'A');
+            for (i = 0; i < turn.count; i++)
+                printf("%s "PIECES"%lld"RESET" pieces from "ROW_LABEL"Row %d"RESET, i > 0 ? "," : "", turn.pieces[i],
+                       turn.rows[i]);
+            if (rules.octal && turn.left > 0 && turn.left < rowSum(&game, turn.rows[0]) - turn.pieces[0])
+                printf(", splitting it after "PIECES"%lld"RESET" pieces", turn.left);
+            printf("\n");
 
-            removePieces(row, pieces); // Execute the move
+            takeTurn(&game, &turn); // Execute the move
 
             player = !player; // Switch which player's turn it is
+
+            STATS_COUNT(COUNTER_TURNS);
+
+            // Recording the move only copies it; the journal writes it out in the background
+            if (haveJournal) {
+                STATS_SPAN(STAT_JOURNAL_TURN, succeeded = journalTurn(&journal, &turn));
+                if (succeeded && journal.moves >= JOURNAL_COMPACT_MOVES && compactJournal(&journal, &game, player))
+                    STATS_COUNT(COUNTER_COMPACTIONS);
+            }
         }
     }
 
     if (!saveGameFlag) // The game loop can exit if the user saves or if the game ends; only print if game is over.
-        printf(SPACER GAME_END"Player "PLAYER"%c"GAME_END" took the last piece.\nPlayer "PLAYER"%c"GAME_END" wins!",
-               player ? 'A' : 'B', player ? 'B' : 'A');
+        printf(SPACER GAME_END"Player "PLAYER"%c"GAME_END" %s.\nPlayer "PLAYER"%c"GAME_END" wins!", player ? 'A' : 'B',
+               game.total > 0 ? "made the last move" : "took the last piece", gameWinner(&game, player) ? 'B' : 'A');
 
-    return 0;
-}
-
-int legalMove(int row0[3], int row1[5], int row2[7], int row, int pieces) {
-    if (pieces > 3 || pieces < 0 || row > 3 || row < 0) // First check if the choices are in max bounds
-        return 0;
-    // Then check if there are enough pieces left in the chosen row
-    switch (row) {
-        case 1:
-            return rowSum(row0, 3) >= pieces;
-        case 2:
-            return rowSum(row1, 5) >= pieces;
-        default:
-            return rowSum(row2, 7) >= pieces;
+    if (haveJournal) {
+        closeJournal(&journal);
+        if (!saveGameFlag) // A finished game has nothing to resume
+            remove(JOURNAL_FILE);
     }
+    freeRenderer(&renderer);
+    if (havePonderer) // Before the Monte Carlo player it may still be using
+        freePonderer(&ponderer);
+    if (game.mcts != NULL)
+        freeMcts(&mcts);
+    freeGame(&game);
+    freeRules(&rules);
+    if (haveTablebase)
+        closeTablebase(&tablebase);
+    return 0;
 }
 
-int gameWon(int row0[3], int row1[5], int row2[7]) {
-    int sum =
-            rowSum(row0, 3) +
-            rowSum(row1, 5) +
-            rowSum(row2, 7);
-    return sum == 0; // The game is over if all pieces are gone. Simplest check is to sum all pieces.
-}
+int getMove(Game *game, Renderer *renderer, int *chosenRow, int *pickedRowFlag, long long *pieces, long long *left,
+            int *saveFlag) {
+    int firstRow; // Where the user wants the board to start if they scroll
+    long long firstPiece;
+    int octalRow; // Only there to check that a row allows an octal move
+    long long octalPieces, octalLeft;
 
-int getMove(int row0[3], int row1[5], int row2[7], int *chosenRow, int *pickedRowFlag, int *pieces, int *saveFlag) {
     if (!*pickedRowFlag) { // This check ensures the program does not prompt the user to enter the row again
         printf("Enter the row you would like to take from (or -1 to save the game): ");
         scanf("%d", chosenRow);
@@ -255,68 +283,92 @@ int getMove(int row0[3], int row1[5], int row2[7], int *chosenRow, int *pickedRo
             *saveFlag = 1;
             return 1; // Return 1 to break out of the game loop in the main function
         }
-        if (!legalMove(row0, row1, row2, *chosenRow, 1)) { // If the move is invalid, tell the user
+        if (*chosenRow == 0 && boardClipped(renderer, game)) { // Row 0 scrolls a board that does not fit on screen
+            printf("Enter the row and the piece to show first: ");
+            scanf("%d %lld", &firstRow, &firstPiece);
+            scrollBoard(renderer, firstRow, firstPiece);
+            drawBoard(renderer, game);
+            return 0; // Ask for the row again
+        }
+        if (*chosenRow > game->heapCount || *chosenRow < 1 || rowSum(game, *chosenRow) == 0) { // If the row is invalid
             printf("Invalid row!\n");
+            STATS_COUNT(COUNTER_INVALID_INPUT);
             return 0; // Go back to the main loop and return 0 so that it repeats.
         }
+        // An octal code can leave a row with pieces but no amount allowed, which would leave the user stuck on it
+        if (game->rules->octal && !octalFirstMove(game->rules, &game->heaps[*chosenRow - 1], 1, &octalRow,
+                                                  &octalPieces, &octalLeft)) {
+            printf("Invalid row!\n");
+            STATS_COUNT(COUNTER_INVALID_INPUT);
+            return 0;
+        }
         // If the other conditions are not met, then the move is legal. Set flag to not ask the user for a row again
         *pickedRowFlag = 1;
     }
     // Now, get the number of pieces
     printf("Enter the number of pieces you would like to take from row %d: ", *chosenRow);
-    scanf("%d", pieces);
-    if (!legalMove(row0, row1, row2, *chosenRow, *pieces)) { // Similar invalid check as above
+    scanf("%lld", pieces);
+    if (!legalMove(game, *chosenRow, *pieces)) { // Similar invalid check as above
         printf("Invalid move!\n");
+        STATS_COUNT(COUNTER_INVALID_INPUT);
         return 0;
     }
+    *left = 0;
+    if (game->rules->octal && rowSum(game, *chosenRow) > *pieces) { // In an octal game, also ask where to take them
+        printf("Enter how many pieces to leave to the left of the ones you take (0 to take them from the left end): ");
+        scanf("%lld", left);
+        if (!octalAllowed(game->rules, rowSum(game, *chosenRow), *pieces, *left)) {
+            printf("Invalid move!\n");
+            STATS_COUNT(COUNTER_INVALID_INPUT);
+            return 0;
+        }
+    }
     return 1; // If all is well, return 1 and move on
 }
 
-int nimSum(int row0[3], int row1[5], int row2[7]) {
-    int a = rowSum(row0, 3);
-    int b = rowSum(row1, 5);
-    int c = rowSum(row2, 7);
+int getExtraRow(Game *game, Turn *turn) {
+    int chosenRow = 0; // Stays 0, which ends the turn, if nothing could be read
+    long long pieces;
+    int i;
 
-    // To get the nim sum of three numbers, take the nim sum of two and then the sum of that with the third
-    return (a ^ b) ^ c;
+    printf("Enter another row to take from (or 0 to end your turn): ");
+    scanf("%d", &chosenRow);
+    if (chosenRow == 0)
+        return 0;
+    for (i = 0; i < turn->count && turn->rows[i] != chosenRow; i++) {/* none */}
+    if (i < turn->count || !legalMove(game, chosenRow, 1)) { // Each row can only be taken from once per turn
+        printf("Invalid row!\n");
+        STATS_COUNT(COUNTER_INVALID_INPUT);
+        return 1; // Ask for another row
+    }
+    printf("Enter the number of pieces you would like to take from row %d: ", chosenRow);
+    scanf("%lld", &pieces);
+    if (!legalMove(game, chosenRow, pieces)) { // Similar invalid check as above
+        printf("Invalid move!\n");
+        STATS_COUNT(COUNTER_INVALID_INPUT);
+        return 1;
+    }
+    turn->rows[turn->count] = chosenRow;
+    turn->pieces[turn->count++] = pieces;
+    return 1;
 }
 
-int readGame(int row0[3], int row1[5], int row2[7], int *player) {
-    FILE *file;
+int readGame(Game *game, Rules *rules, int *player) {
     char fileName[31]; // String to store the user-entered file name
-    char playerChar;
     printf(SPACER);
     printf("Reading Game from File\n");
     printf("Enter the name of the file you would like to load the game from (30 character limit): ");
     scanf("%30s", fileName);
-    file = fopen(fileName, "r"); // Try opening the file the user gave
 
-    if (file == NULL) { // If the file does not exist...
-        printf("There is no file called %s. Returning to main menu...\n", fileName);
+    if (!readSave(game, rules, player, fileName)) { // If the file does not exist or is not a saved game...
+        printf("There is no saved game in a file called %s. Returning to main menu...\n", fileName);
         printf(SPACER);
         return 0; // Return to the main loop as a failure
     }
-
-    // Otherwise, if the file does exist, read it row by row
-    readRow(file, row0);
-    readRow(file, row1);
-    readRow(file, row2);
-    fscanf(file, "%c", &playerChar);
-    *player = playerChar == 'B'; // Set the player boolean from the file
-
-    fclose(file);
     return 1;
 }
 
-int rowSum(int row[], int size) {
-    int sum = 0;
-    int i;
-    for (i = 0; i < size; i++)
-        sum += row[i]; // Add to the sum if this index of the array is 1
-    return sum;
-}
-
-int writeGame(int row0[3], int row1[5], int row2[7], int player) {
+int writeGame(Game *game, int player) {
     FILE *file;
     char fileName[31]; // String to store the user-entered file name
     char createNewFile; // To get input from the user later
@@ -337,152 +389,33 @@ int writeGame(int row0[3], int row1[5], int row2[7], int player) {
         fclose(file);
     }
 
-    file = fopen(fileName, "w"); // NOW open it in write mode. If it did not exist before, it will be created
-
-    // Write to the file row by row
-    writeRow(file, row0, 3);
-    writeRow(file, row1, 5);
-    writeRow(file, row2, 7);
-    fprintf(file, "%c.", player ? 'B' : 'A');
-
-    fclose(file);
+    // NOW write it. If it did not exist before, it will be created
+    if (!writeSave(game, player, fileName)) {
+        printf("Could not write to %s. Returning to game...\n", fileName);
+        return 0;
+    }
     printf("Game saved. Exiting...");
     return 1;
 }
 
-void firstAvailableMove(int row0[3], int row1[5], int row2[7], int *chosenRow, int *pieces) {
-    *pieces = 1; // Only take one piece
-    // Take it from whichever row has a piece to be taken
-    if (rowSum(row0, 3))
-        *chosenRow = 1;
-    else if (rowSum(row1, 5))
-        *chosenRow = 2;
-    else
-        *chosenRow = 3;
-}
-
-void getAIMove(int row0[3], int row1[5], int row2[7], int *chosenRow, int *pieces) {
-    int X = nimSum(row0, row1, row2);
-    int h1, h2, h3;
-    int h1SumX, h2SumX, h3SumX;
-
-    if (X == 0) // This means we are not in a guaranteed winning position; make a dummy move to move the game along
-        return firstAvailableMove(row0, row1, row2, chosenRow, pieces); // Call and exit
-
-    // Calculate important values for checks
-    h1 = rowSum(row0, 3);
-    h1SumX = X ^ h1;
-
-    h2 = rowSum(row1, 5);
-    h2SumX = X ^ h2;
-
-    h3 = rowSum(row2, 7);
-    h3SumX = X ^ h3;
-
-    if (h1 + h2 + h3 == 1 || h1 == 1 && h2 == 1 && h3 == 1) // Sorry buddy you lost (there is no way to win)
-        return firstAvailableMove(row0, row1, row2, chosenRow, pieces);
-
-    // Special cases 1
-    if (h1 + h2 == 1 && h3 < 4 || // There is a one, a zero, and something else
-        h1 + h3 == 1 && h2 < 4 || // There is a one, a zero, and something else
-        h2 + h3 == 1 && h1 < 4) { // There is a one, a zero, and something else
-        if (h1 > 1) {
-            *chosenRow = 1;
-            *pieces = h1;
-        } else if (h2 > 1) {
-            *chosenRow = 2;
-            *pieces = h2;
-        } else {
-            *chosenRow = 3;
-            *pieces = h3;
-        }
-        return;
-    }
-
-    // Special cases 2
-    if (h1 == 1 && h2 == 1 && h3 < 4 || // There are two ones and something else
-        h1 == 1 && h3 == 1 && h2 < 4 || // There are two ones and something else
-        h2 == 1 && h3 == 1 && h1 < 4 || // There are two ones and something else
-        h1 == 0 && h2 == 0 && h3 < 5 || // There are two zeros and something else
-        h1 == 0 && h3 == 0 && h2 < 5 || // There are two zeros and something else
-        h2 == 0 && h3 == 0 && h1 < 5) { // There are two zeros and something else
-        // Make the proper move to get the game into a winning position
-        if (h1 > 1) {
-            *chosenRow = 1;
-            *pieces = h1 - 1;
-        } else if (h2 > 1) {
-            *chosenRow = 2;
-            *pieces = h2 - 1;
-        } else {
-            *chosenRow = 3;
-            *pieces = h3 - 1;
-        }
-        return;
-    }
-
-    // Standard strategy calculations now to get nimSum back to 0
-    if (h1SumX <= h1 && h1 - h1SumX <= 3) {
-        *chosenRow = 1;
-        *pieces = h1 - h1SumX;
-    } else if (h2SumX <= h2 && h2 - h2SumX <= 3) {
-        *chosenRow = 2;
-        *pieces = h2 - h2SumX;
-    } else if (h3SumX <= h3 && h3 - h3SumX <= 3) {
-        *chosenRow = 3;
-        *pieces = h3 - h3SumX;
-    } else { // Backup move if there is no way to make the right move (if the proper move would be more than 3 pieces)
-        firstAvailableMove(row0, row1, row2, chosenRow, pieces);
-    }
-}
-
-void displayBoard(int row0[3], int row1[5], int row2[7]) {
-    printRow(row0, 1, 3);
-    printRow(row1, 2, 5);
-    printRow(row2, 3, 7);
-}
-
-void printRow(int *row, int number, int size) {
-    int i;
-    printf(ROW_LABEL"Row %d%*c"RESET, number, 10 - size, ' '); // The label on the left ("Row 1")
-    for (i = 0; i < size; i++) {
-        if (*(row + i)) // Dereference the correct index of the array
-            printf(BOARD_BG" "FULL_PIECE"■"RESET); // Print with the full color
-        else
-            printf(BOARD_BG" "EMPTY_PIECE"■"RESET); // Print with the empty color
-    }
-    printf(BOARD_BG" "RESET"\n"); // After each row, make sure to move to the next line
-}
+int resumeGame(Game *game, Rules *rules, int *player, int *computerGame, int *aiPlayer) {
+    int journaledAI; // The computer's player number in the journal, or -1 if there was no computer player
 
-void readRow(FILE *file, int row[]) {
-    char c = ' ';
-    int i = 0;
-    while (c != '.') { // As long as we do not reach the end marker, which is a period
-        fscanf(file, "%c", &c);
-        if (c == ',') // If this character is a comma, move on without doing anything because this separates items
-            continue;
-        else if (c == 'E') // If E, set as 0 for empty
-            row[i] = 0;
-        else if (c == 'F') // If F, set as 1 for full
-            row[i] = 1;
-        i++; // This will not increment when the character is a comma
-    }
-
-    // Move the cursor over one character to skip the newline and prepare for the next call of this function
-    fseek(file, sizeof(char), SEEK_CUR);
-}
-
-void removePieces(int row[], int pieces) {
-    int removed = 0; // Track how many pieces have actually been removed
-    int i = 0;
-    while (removed < pieces) { // Go until the right number of pieces has been removed
-        removed += row[i]; // Removed will only increase if there was actually something there to remove
-        row[i] = 0;
-        i++; // Move over one place in the array each time regardless
+    if (!replayJournal(game, rules, player, &journaledAI, JOURNAL_FILE, NULL)) { // If there is no journal...
+        printf("There is no unfinished game to resume. Returning to main menu...\n");
+        printf(SPACER);
+        return 0; // Return to the main loop as a failure
     }
+    *computerGame = journaledAI >= 0;
+    if (*computerGame)
+        *aiPlayer = journaledAI;
+    printf("Ok. Resuming the last game...\n");
+    return 1;
 }
 
-void setUpAI(int *aiPlayer) {
+void setUpAI(int *aiPlayer, double *thinkingTime) {
     int input;
+    unsigned long long seed; // State for the random number generator
 
     printf(SPACER);
 
@@ -496,8 +429,8 @@ void setUpAI(int *aiPlayer) {
             printf("Ok. You are player "PLAYER"B"RESET".  Preparing new game...\n");
             *aiPlayer = 0; // Set the computer to be player A
         } else if (input == 3) { // If 3, pick a random number to determine who goes first
-            srand(time(NULL));
-            *aiPlayer = rand() % 2; // Modulo 2 to get a number between 0 and 1
+            seed = time(NULL);
+            *aiPlayer = nextRandom(&seed) % 2; // Modulo 2 to get a number between 0 and 1
             printf("Ok. You are player "PLAYER"%c"RESET".  Preparing new game...\n", *aiPlayer ? 'A' : 'B');
         } else { // If the user gave an invalid option, go back to the start of the loop using continue
             printf("Invalid option. Type a number between 1 and 3\n");
@@ -505,42 +438,168 @@ void setUpAI(int *aiPlayer) {
         }
         break; // If the program gets here, an option was chosen successfully, and the loop can break
     }
+
+    while (1) { // Loop until broken
+        printf("How should the computer play?\n1: Perfectly\n2: By playing out random games for a set time (Monte Carlo)\nEnter selection: ");
+        scanf("%d", &input);
+        if (input == 1) { // If 1, the computer solves every position
+            printf("Ok. The computer will play perfectly.\n");
+            *thinkingTime = 0;
+        } else if (input == 2) { // If 2, ask how long each move can take
+            printf("How many seconds can the computer think per move? ");
+            if (scanf("%lf", thinkingTime) != 1 || *thinkingTime <= 0 || *thinkingTime > 3600) {
+                printf("Type a number of seconds above 0 and up to 3600\n");
+                continue;
+            }
+            printf("Ok. The computer will think for %g seconds per move.\n", *thinkingTime);
+        } else { // If the user gave an invalid option, go back to the start of the loop using continue
+            printf("Invalid option. Type 1 or 2\n");
+            continue;
+        }
+        break; // If the program gets here, an option was chosen successfully, and the loop can break
+    }
 }
 
-void setUpGame(int row0[3], int row1[5], int row2[7], int *player, int *computerGame, int *aiPlayer) {
+void setUpRules(Rules *rules, Game *game) {
     int input;
+    int moves[MAX_RULE_MOVES]; // Amounts the user chose
+    int moveCount;
+    char code[40]; // Octal code the user chose, such as 0.77
+    char list[256]; // Row sizes the user chose for an octal game, separated by commas
+    long long sizes[MAX_OCTAL_ROWS];
+    long long largest;
+    int heapCount;
+    Game board; // The rows an octal game starts with, replacing the standard board
+    Rules chosen;
+    int i;
 
     printf(SPACER);
 
     while (1) { // Loop until broken
-        printf("What would you like to do?\n1: Start new game\n2: Load game from file\n3: Start new game against computer\nEnter selection: ");
+        printf("How many pieces can be taken in one move?\n1: 1 to 3 pieces\n2: Any number of pieces\n3: Choose the amounts\n4: Any number of pieces from each of several rows (Moore's Nim)\n5: Pieces from anywhere in a row, splitting it, as an octal code says (Kayles and others)\nEnter selection: ");
         scanf("%d", &input);
-        if (input == 1) { // If 1, nothing to do here except go back to the main loop and get started
+        if (input == 1) { // If 1, keep the standard rules
+            printf("Ok. Players can take 1 to 3 pieces.\n");
+            return;
+        } else if (input == 2) { // If 2, switch to plain Nim
+            printf("Ok. Players can take any number of pieces.\n");
+            newAnyAmountRules(&chosen);
+        } else if (input == 3) { // If 3, read amounts until the user enters 0
+            printf("Enter the amounts that can be taken separated by spaces, then 0 (1 must be one of them): ");
+            for (moveCount = 0; moveCount < MAX_RULE_MOVES && scanf("%d", &moves[moveCount]) == 1 && moves[moveCount] > 0; moveCount++) {/* none */}
+            if (!newSubtractionRules(&chosen, moves, moveCount)) {
+                printf("Those amounts cannot be used. Make sure 1 is one of them.\n");
+                continue;
+            }
+            printf("Ok. Preparing the rules...\n");
+        } else if (input == 4) { // If 4, ask how many rows one move can take from
+            printf("How many rows can one move take from? (2 to %d) ", MAX_MOVE_ROWS);
+            scanf("%d", &input);
+            if (input < 2 || !newMooreRules(&chosen, input)) {
+                printf("That number of rows cannot be used.\n");
+                continue;
+            }
+            printf("Ok. Players can take any number of pieces from each of up to %d rows.\n", input);
+        } else if (input == 5) { // If 5, read the code and the rows to play it on, which the values are worked out for
+            printf("Enter the octal code (such as 0.77 for Kayles or 0.07 for Dawson's Kayles): ");
+            scanf("%39s", code);
+            printf("Enter the number of pieces in each row, separated by commas (up to %d rows of up to %d pieces): ",
+                   MAX_OCTAL_ROWS, MAX_OCTAL_ROW);
+            scanf("%255s", list);
+            heapCount = parseList(list, sizes, MAX_OCTAL_ROWS);
+            for (largest = 0, i = 0; i < heapCount; i++)
+                largest = sizes[i] > largest ? sizes[i] : largest;
+            if (heapCount == 0 || largest > MAX_OCTAL_ROW) {
+                printf("Those rows cannot be used.\n");
+                continue;
+            }
+            printf("Ok. Working out the Grundy values...\n");
+            if (!newOctalRules(&chosen, code, largest, OCTAL_CACHE_FILE)) {
+                printf("That code cannot be used. Type 0. and then up to %d digits from 0 to 7, not all 0.\n",
+                       MAX_RULE_MOVES);
+                continue;
+            }
+            if (grundyValue(&chosen, largest) < 0) { // This code's values take too long to work out all at once
+                printf("Working out the values that far takes too long for this code. They go up to rows of %lld "
+                       "pieces so far; enter the rows again to carry on from there.\n", chosen.preperiod - 1);
+                freeRules(&chosen);
+                continue;
+            }
+            // The board needs room for the rows it splits into, which the new rules decide
+            if (!newGame(&board, heapCount, sizes, &chosen)) {
+                printf("Not enough memory for those rows.\n");
+                freeRules(&chosen);
+                continue;
+            }
+            board.rules = rules;
+            freeGame(game);
+            *game = board;
+            printf("Ok. Players take pieces from anywhere in a row as the code allows. Whoever cannot move loses.\n");
+        } else { // If the user gave an invalid option, go back to the start of the loop using continue
+            printf("Invalid option. Type a number between 1 and 5\n");
+            continue;
+        }
+        break; // If the program gets here, an option was chosen successfully, and the loop can break
+    }
+
+    freeRules(rules); // Replace the standard rules with the chosen ones
+    *rules = chosen;
+}
+
+void setUpMode(Rules *rules) {
+    int input;
+
+    printf(SPACER);
+
+    while (1) { // Loop until broken
+        printf("What happens to whoever takes the last piece?\n1: They lose (misère)\n2: They win (normal)\nEnter selection: ");
+        scanf("%d", &input);
+        if (input == 1 || input == 2) {
+            rules->misere = input == 1;
+            printf("Ok. Whoever takes the last piece %s.\n", rules->misere ? "loses" : "wins");
+            break;
+        }
+        printf("Invalid option. Type 1 or 2\n"); // If the user gave an invalid option, ask again
+    }
+}
+
+void setUpGame(Game *game, Rules *rules, int *player, int *computerGame, int *aiPlayer, double *thinkingTime) {
+    int input;
+    int loaded; // Whether a game was read in
+
+    printf(SPACER);
+
+    while (1) { // Loop until broken
+        printf("What would you like to do?\n1: Start new game\n2: Load game from file\n3: Start new game against computer\n4: Resume the last unfinished game\nEnter selection: ");
+        scanf("%d", &input);
+        if (input == 1) { // If 1, ask for the rules and go back to the main loop to get started
+            setUpRules(rules, game);
+            if (!rules->octal) // Octal games are always played in normal play
+                setUpMode(rules);
             printf("Ok. Preparing new game...\n");
         } else if (input == 2) { // If 2, attempt to read a game from a file
-            if (!readGame(row0, row1, row2, player)) // If the read fails and returns 0...
+            STATS_SPAN(STAT_READ_GAME, loaded = readGame(game, rules, player));
+            if (!loaded) // If the read fails and returns 0...
                 continue; // Go back to the start of this loop and prompt the user for an option again with continue
         } else if (input == 3) { // If 3, set the computer game flag and prompt the user for computer options
             printf("Ok. Preparing new game against computer...\n");
+            setUpRules(rules, game);
+            if (!rules->octal)
+                setUpMode(rules);
             *computerGame = 1;
-            setUpAI(aiPlayer);
+            setUpAI(aiPlayer, thinkingTime);
+        } else if (input == 4) { // If 4, attempt to rebuild the game that was interrupted
+            STATS_SPAN(STAT_RESUME_GAME, loaded = resumeGame(game, rules, player, computerGame, aiPlayer));
+            if (!loaded) // If there is nothing to resume...
+                continue; // Go back to the start of this loop and prompt the user for an option again with continue
         } else { // If the user gave an invalid option, go back to the start of the loop using continue
-            printf("Invalid option. Type a number between 1 and 3\n");
+            printf("Invalid option. Type a number between 1 and 4\n");
             continue;
         }
         break; // If the program gets here, an option was chosen successfully, and the loop can break
     }
 }
 
-void writeRow(FILE *file, int row[], int size) {
-    int i;
-    for (i = 0; i < size; i++) { // For each item in the array
-        fprintf(file, "%c", row[i] ? 'F' : 'E'); // First, print an F or E depending on whether a piece is there
-        fprintf(file, "%c", i == size - 1 ? '.' : ','); // Then, print a comma, or, if this is the last item, a period
-    }
-    fprintf(file, "\n"); // Print a newline at the end to prepare for the next line to be written
-}
-
 /**
 * External Sources
 * [Stack Overflow](https://stackoverflow.com/questions/8464620/program-doesnt-wait-for-user-input-with-scanfc-yn) on bug with scanf after using scanf to get string input from user
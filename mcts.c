@@ -0,0 +1,356 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "game.h"
+
+#define MAX_THREADS 256
+#define NO_NODE (-1) // Index standing for no node at all
+
+/**
+ * One position in the tree, reached from its parent by a move. Children are kept as a list that only ever grows at
+ * the front, so threads can walk it while another thread adds to it.
+ */
+struct MctsNode {
+    Move move; // The move that leads here from the parent
+    _Atomic int firstChild; // Child added last, or NO_NODE
+    int nextSibling; // The parent's child added before this one, or NO_NODE; set before the node is linked in
+    _Atomic int visits; // Playouts through here, counting ones still running
+    _Atomic int wins; // Finished playouts through here won by the player who made the move
+    _Atomic int expanded; // Set once every move from here has a child
+    atomic_flag adding; // Held by the thread adding a child
+    MoveList untried; // How far adding children has got in the walk through the moves, guarded by adding
+};
+
+/**
+ * Everything the threads searching one position share
+ */
+typedef struct {
+    Mcts *mcts;
+    Searcher variant; // The rules and restrictions to walk moves under; its table is not used
+    const long long *heaps; // The position at the root
+    int heapCount;
+    double deadline; // Time to stop by, or 0 for no limit
+    long long playoutLimit; // Playouts to stop after, or 0 for no limit
+    atomic_int used; // Nodes handed out from the arena
+    atomic_llong started; // Playouts claimed so far
+} Tree;
+
+/**
+ * One thread's state: its own generator and a board to play out on
+ */
+typedef struct {
+    Tree *tree;
+    unsigned long long seed;
+    long long *heaps; // The position being played out
+    int path[MCTS_MAX_DEPTH]; // Nodes walked through in the current playout, root first
+} Worker;
+
+/**
+ * Set up a node with no children and no visits
+ * @param node
+ * @param move the move that leads to the node
+ */
+static void initNode(struct MctsNode *node, const Move *move);
+
+/**
+ * Run playouts until the search runs out of time or playouts
+ * @param arg address of the thread's Worker
+ * @return NULL
+ */
+static void *runPlayouts(void *arg);
+
+/**
+ * Walk down the tree from the root, add a node, play the game out at random and score every node walked through
+ * @param worker
+ */
+static void playout(Worker *worker);
+
+/**
+ * Add a child for the next move from a node that has not been tried yet. Gives up at once if another thread is
+ * adding one there or the arena is full.
+ * @param tree
+ * @param parent index of the node
+ * @param heaps the position at the node
+ * @return index of the new child, or NO_NODE if none was added
+ */
+static int addChild(Tree *tree, int parent, const long long heaps[]);
+
+/**
+ * Pick the child with the best upper confidence bound (UCT). Playouts still running count as losses, which is what
+ * steers threads apart.
+ * @param tree
+ * @param parent index of the node
+ * @return index of the child, or NO_NODE if the node has none
+ */
+static int selectChild(const Tree *tree, int parent);
+
+/**
+ * Pick a random one-row move for a playout. A position with no one-row move has no two-row move either, so
+ * playouts end exactly when the game does.
+ * @param variant
+ * @param heaps number of pieces left in each row
+ * @param heapCount number of rows
+ * @param seed address of the generator
+ * @param row address to store the row (0, 1, 2, ...)
+ * @param pieces address to store the number of pieces to take
+ * @return 1 if there was a move, 0 if the game is over
+ */
+static int randomPlayoutMove(const Searcher *variant, const long long heaps[], int heapCount,
+                             unsigned long long *seed, int *row, long long *pieces);
+
+/**
+ * Take a move off a board
+ * @param heaps number of pieces left in each row
+ * @param move
+ */
+static void playMove(long long heaps[], const Move *move);
+
+/**
+ * Read the monotonic clock
+ * @return the time in seconds
+ */
+static double now(void);
+
+int newMcts(Mcts *mcts, const Rules *rules, int capacity) {
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+
+    mcts->rules = rules;
+    mcts->variant = NULL;
+    mcts->threads = processors > 0 ? (int) (processors < MAX_THREADS ? processors : MAX_THREADS) : 1;
+    mcts->timeLimit = 0;
+    mcts->playoutLimit = 0;
+    mcts->exploration = sqrt(2);
+    mcts->seed = (unsigned long long) time(NULL);
+    atomic_init(&mcts->stop, 0);
+    mcts->playouts = 0;
+    mcts->nodesUsed = 0;
+    mcts->winRate = 0;
+    mcts->seconds = 0;
+
+    mcts->capacity = capacity > 0 ? capacity : 1; // Room for the root at the least
+    mcts->nodes = malloc(mcts->capacity * sizeof(struct MctsNode));
+    return mcts->nodes != NULL;
+}
+
+void freeMcts(Mcts *mcts) {
+    free(mcts->nodes);
+    mcts->nodes = NULL;
+    mcts->capacity = 0;
+}
+
+int mctsMove(Mcts *mcts, const long long heaps[], int heapCount, Move *best) {
+    MoveList list = {1, 0, 0, 0, 0};
+    pthread_t ids[MAX_THREADS];
+    const struct MctsNode *child;
+    long long *boards;
+    Worker *workers;
+    Tree tree;
+    double start = now();
+    int threads = mcts->threads < 1 ? 1 : mcts->threads > MAX_THREADS ? MAX_THREADS : mcts->threads;
+    int running, mostVisits = -1, i;
+
+    mcts->playouts = 0;
+    mcts->nodesUsed = 0;
+    mcts->winRate = 0;
+    mcts->seconds = 0;
+
+    tree.mcts = mcts;
+    if (mcts->variant != NULL) {
+        tree.variant = *mcts->variant;
+    } else { // The plain rules, taking from two rows at once as the nearest a move can get to Moore's Nim_k
+        memset(&tree.variant, 0, sizeof(tree.variant));
+        tree.variant.rules = mcts->rules;
+        tree.variant.maxRowsPerMove = mcts->rules->maxRows > 1 ? SEARCH_MAX_ROWS : 1;
+    }
+    if (!searchNextMove(&tree.variant, heaps, heapCount, &list, best)) // Until the search finishes, any move will do
+        return 0;
+
+    tree.heaps = heaps;
+    tree.heapCount = heapCount;
+    tree.deadline = mcts->timeLimit > 0 ? start + mcts->timeLimit : 0;
+    tree.playoutLimit = mcts->timeLimit <= 0 && mcts->playoutLimit <= 0 ? MCTS_DEFAULT_PLAYOUTS : mcts->playoutLimit;
+    atomic_init(&tree.used, 1);
+    atomic_init(&tree.started, 0);
+    initNode(&mcts->nodes[0], best);
+
+    workers = malloc(threads * sizeof(Worker));
+    boards = malloc(threads * heapCount * sizeof(long long));
+    if (workers == NULL || boards == NULL) {
+        free(workers);
+        free(boards);
+        return 1;
+    }
+    for (i = 0; i < threads; i++) {
+        workers[i].tree = &tree;
+        workers[i].seed = nextRandom(&mcts->seed);
+        workers[i].heaps = boards + i * heapCount;
+    }
+
+    // This thread plays out too, alongside however many others could be started
+    for (running = 1; running < threads && pthread_create(&ids[running], NULL, runPlayouts, &workers[running]) == 0;
+         running++) {/* none */}
+    runPlayouts(&workers[0]);
+    for (i = 1; i < running; i++)
+        pthread_join(ids[i], NULL);
+
+    // The move played out most often is the one the search trusts most
+    for (i = atomic_load(&mcts->nodes[0].firstChild); i != NO_NODE; i = mcts->nodes[i].nextSibling) {
+        child = &mcts->nodes[i];
+        if (child->visits > mostVisits) {
+            mostVisits = child->visits;
+            *best = child->move;
+            mcts->winRate = child->visits > 0 ? (double) child->wins / child->visits : 0;
+        }
+    }
+    mcts->playouts = mcts->nodes[0].visits;
+    mcts->nodesUsed = tree.used < mcts->capacity ? tree.used : mcts->capacity;
+    mcts->seconds = now() - start;
+    free(workers);
+    free(boards);
+    return 1;
+}
+
+static void initNode(struct MctsNode *node, const Move *move) {
+    node->move = *move;
+    atomic_init(&node->firstChild, NO_NODE);
+    node->nextSibling = NO_NODE;
+    atomic_init(&node->visits, 0);
+    atomic_init(&node->wins, 0);
+    atomic_init(&node->expanded, 0);
+    atomic_flag_clear(&node->adding);
+    node->untried.rows = 1;
+    node->untried.first = node->untried.second = 0;
+    node->untried.firstPieces = node->untried.secondPieces = 0;
+}
+
+static void *runPlayouts(void *arg) {
+    Worker *worker = arg;
+    Tree *tree = worker->tree;
+
+    while ((tree->playoutLimit == 0 || atomic_fetch_add(&tree->started, 1) < tree->playoutLimit) &&
+           (tree->deadline == 0 || now() < tree->deadline) &&
+           !atomic_load_explicit(&tree->mcts->stop, memory_order_relaxed))
+        playout(worker);
+    return NULL;
+}
+
+static void playout(Worker *worker) {
+    Tree *tree = worker->tree;
+    struct MctsNode *nodes = tree->mcts->nodes;
+    long long *heaps = worker->heaps, pieces = 0; // Set by randomPlayoutMove whenever it finds a move
+    int depth = 0, current = 0, child, added = 0, toMove, winner, row = 0, i;
+
+    memcpy(heaps, tree->heaps, tree->heapCount * sizeof(long long));
+    worker->path[0] = 0;
+    atomic_fetch_add(&nodes[0].visits, 1);
+
+    // Walk down by UCT until a node gets a new child, or there is nowhere further to go
+    while (!added && depth < MCTS_MAX_DEPTH - 1) {
+        child = NO_NODE;
+        if (!atomic_load(&nodes[current].expanded))
+            added = (child = addChild(tree, current, heaps)) != NO_NODE;
+        if (child == NO_NODE && (child = selectChild(tree, current)) == NO_NODE)
+            break; // The game is over here, or the node has no children yet and none could be added
+        atomic_fetch_add(&nodes[child].visits, 1); // Counts as a loss to the other threads until the result is in
+        playMove(heaps, &nodes[child].move);
+        worker->path[++depth] = current = child;
+    }
+
+    // Finish the game at random; the player left without a move loses, or wins in misère play
+    for (toMove = depth & 1; randomPlayoutMove(&tree->variant, heaps, tree->heapCount, &worker->seed, &row, &pieces);
+         toMove = !toMove)
+        heaps[row] -= pieces;
+    winner = tree->variant.rules->misere ? toMove : !toMove;
+
+    // Players are numbered from the root's player to move, so the move into the node at depth i was made by (i-1)&1
+    for (i = 1; i <= depth; i++)
+        if (winner == ((i - 1) & 1))
+            atomic_fetch_add(&nodes[worker->path[i]].wins, 1);
+}
+
+static int addChild(Tree *tree, int parent, const long long heaps[]) {
+    struct MctsNode *nodes = tree->mcts->nodes, *node = &nodes[parent];
+    Move move;
+    int child = NO_NODE;
+
+    if (atomic_load(&tree->used) >= tree->mcts->capacity ||
+        atomic_flag_test_and_set_explicit(&node->adding, memory_order_acquire))
+        return NO_NODE; // Another thread is adding one; go on through the children there are
+    if (!atomic_load(&node->expanded)) {
+        if (!searchNextMove(&tree->variant, heaps, tree->heapCount, &node->untried, &move)) {
+            atomic_store(&node->expanded, 1);
+        } else if ((child = atomic_fetch_add(&tree->used, 1)) < tree->mcts->capacity) {
+            initNode(&nodes[child], &move);
+            nodes[child].nextSibling = atomic_load_explicit(&node->firstChild, memory_order_relaxed);
+            atomic_store_explicit(&node->firstChild, child, memory_order_release); // Only now can others see it
+        } else { // The arena filled up since the check above
+            child = NO_NODE;
+        }
+    }
+    atomic_flag_clear_explicit(&node->adding, memory_order_release);
+    return child;
+}
+
+static int selectChild(const Tree *tree, int parent) {
+    struct MctsNode *nodes = tree->mcts->nodes;
+    double logVisits = log(atomic_load(&nodes[parent].visits) + 1.0), value, bestValue = -1;
+    int child, visits, best = NO_NODE;
+
+    for (child = atomic_load_explicit(&nodes[parent].firstChild, memory_order_acquire); child != NO_NODE;
+         child = nodes[child].nextSibling) {
+        visits = atomic_load_explicit(&nodes[child].visits, memory_order_relaxed);
+        if (visits == 0) // Just added by another thread, and not played through yet
+            return child;
+        value = (double) atomic_load_explicit(&nodes[child].wins, memory_order_relaxed) / visits +
+                tree->mcts->exploration * sqrt(logVisits / visits);
+        if (value > bestValue) {
+            bestValue = value;
+            best = child;
+        }
+    }
+    return best;
+}
+
+static int randomPlayoutMove(const Searcher *variant, const long long heaps[], int heapCount,
+                             unsigned long long *seed, int *row, long long *pieces) {
+    long long after;
+    int candidates = 0, i;
+
+    // Keep each row with a move with a 1 in (rows seen so far) chance, as randomMove does
+    for (i = 0; i < heapCount; i++)
+        if (heaps[i] > 0 && searchNextAmount(variant, heaps, i, 0) != 0 && nextRandom(seed) % ++candidates == 0)
+            *row = i;
+    if (candidates == 0)
+        return 0;
+
+    if (variant->rules->anyAmount) {
+        // Take the next amount allowed after a random point, halving the point until one is found below it
+        for (after = (long long) (nextRandom(seed) % (unsigned long long) heaps[*row]);
+             (*pieces = searchNextAmount(variant, heaps, *row, after)) == 0; after /= 2) {/* none */}
+        return 1;
+    }
+    candidates = 0;
+    for (after = searchNextAmount(variant, heaps, *row, 0); after != 0;
+         after = searchNextAmount(variant, heaps, *row, after))
+        if (nextRandom(seed) % ++candidates == 0)
+            *pieces = after;
+    return 1;
+}
+
+static void playMove(long long heaps[], const Move *move) {
+    int i;
+    for (i = 0; i < SEARCH_MAX_ROWS && move->rows[i] != 0; i++)
+        heaps[move->rows[i] - 1] -= move->pieces[i];
+}
+
+static double now(void) {
+    struct timespec spec;
+    clock_gettime(CLOCK_MONOTONIC, &spec);
+    return spec.tv_sec + spec.tv_nsec / 1e9;
+}
@@ -0,0 +1,67 @@
+#ifndef NIM_MCTS_H
+#define NIM_MCTS_H
+
+#include <stdatomic.h>
+#include "search.h"
+
+#define MCTS_DEFAULT_PLAYOUTS 20000 // Playouts per move when neither limit is set
+#define MCTS_MAX_DEPTH 1024 // Deepest the tree is walked in one playout; the random game goes on from there
+
+struct MctsNode;
+
+/**
+ * A Monte Carlo tree search player for rules and variants too big to solve. Every playout walks down the tree by
+ * UCT, adds one node, finishes the game with random moves and scores every node on the way. Threads share one tree:
+ * a thread walking through a node counts a visit there straight away, before its result is known, so the node looks
+ * like a loss to the others until then and they spread out over other moves (virtual loss). Nodes come from an arena
+ * allocated once, so a search never allocates per node; once the arena is full, playouts go on without growing the
+ * tree.
+ */
+typedef struct {
+    const Rules *rules; // Amounts that can be taken from a row, and whether taking the last piece wins
+    const Searcher *variant; // Restrictions on top of the rules, or NULL for the plain rules (its table is not used)
+    int threads; // Threads running playouts, counting the one that calls mctsMove
+    double timeLimit; // Seconds a search may take, or 0 for no limit
+    long long playoutLimit; // Playouts a search may run, or 0 for no limit
+    double exploration; // How much UCT favours moves tried less often over moves that have done well
+    unsigned long long seed; // Seeds every thread's generator, and moves on with each search
+    atomic_int stop; // Set from another thread to cut searches short while it stays set; cleared by whoever set it
+
+    struct MctsNode *nodes; // The node arena
+    int capacity; // Number of nodes in the arena
+
+    // Results of the last search
+    long long playouts; // Playouts run
+    int nodesUsed; // Nodes added to the tree
+    double winRate; // Share of the playouts through the chosen move that the player to move won
+    double seconds; // Time taken
+} Mcts;
+
+/**
+ * Set up a Monte Carlo player with one thread per processor, MCTS_DEFAULT_PLAYOUTS playouts per move and no time
+ * limit
+ * @param mcts address of the player to set up
+ * @param rules the rules to play by
+ * @param capacity nodes to make room for in the arena; each playout adds at most one
+ * @return 1 if successful, 0 if memory could not be allocated
+ */
+int newMcts(Mcts *mcts, const Rules *rules, int capacity);
+
+/**
+ * Release the memory held by a Monte Carlo player
+ * @param mcts
+ */
+void freeMcts(Mcts *mcts);
+
+/**
+ * Search for a move until the time or playout limit runs out (MCTS_DEFAULT_PLAYOUTS if neither is set), and pick
+ * the move played out most often. Moves take from two rows at once only if the variant or the rules allow it.
+ * @param mcts
+ * @param heaps number of pieces left in each row
+ * @param heapCount number of rows
+ * @param best address to store the move
+ * @return 1 if a move was found, 0 if there are no legal moves
+ */
+int mctsMove(Mcts *mcts, const long long heaps[], int heapCount, Move *best);
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef NIM_NIM_H
+#define NIM_NIM_H
+
+/**
+ * libnim, the game engine every Nim program is built on: rules and their Grundy values, octal games, game positions,
+ * the computer player, the variant searcher, the Monte Carlo player, tablebases, batch evaluation, saves, journals and
+ * pondering. Nothing in it reads or writes the terminal or keeps global state, so it can be embedded anywhere.
+ *
+ * Threads: everything works on state passed in explicitly. Rules, tablebases and evaluators are only read once they
+ * are set up, so any number of threads can share them; each thread plays its own Game and keeps its own random
+ * number generator seed. Searchers can be copied so threads share one transposition table (see Searcher).
+ *
+ * Memory: setting up rules, searchers, tablebases and evaluators allocates; play does not. Games set up with initGame
+ * live in storage the caller provides, and legalMove, legalTurn, removePieces, splitRow, takeTurn, gameWon, nimSum,
+ * bestMove, bestTurn, grundyMove, mooreMove and octalMove never allocate, so they can be called millions of times a
+ * second from many threads without locks. Searching under a variant allocates one copy of the position per call, and a
+ * Monte Carlo search one per thread; its tree comes from an arena allocated when the player is set up.
+ */
+
+#include "batch.h"
+#include "game.h"
+#include "journal.h"
+#include "ponder.h"
+#include "save.h"
+
+#endif
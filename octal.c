@@ -0,0 +1,464 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "octal.h"
+#include "save.h"
+
+#define CACHE_MAGIC "NIMOCT" // Marks a file of octal Grundy values
+#define CACHE_VERSION 1 // Version written into new cache files
+#define CACHE_HEADER_SIZE 8 // Magic, version, then the number of digits after the point
+#define FIRST_CHECK 64 // Heap sizes computed before the first look for the repeat and the first pick of a mask
+
+/**
+ * An octal game's Grundy values while they are being computed
+ */
+typedef struct {
+    const Rules *rules;
+    unsigned short *values; // Grundy values of heap sizes 0 through length - 1
+    long long length; // Number of values computed
+    unsigned int top; // Smallest power of 2 above every value so far
+    unsigned int mask; // Values with an even number of bits set under this mask are rare, the rest common
+    int *rare; // Heap sizes from 1 up with rare values, in increasing order; only kept while the mask is not 0
+    long long rareCount, rareCapacity;
+    long long *counts; // Number of heap sizes with each value up to OCTAL_MAX_VALUE, to pick the mask by
+    int splits[MAX_RULE_MOVES]; // Amounts that can be taken from the middle of a row, in increasing order
+    int splitCount;
+    long long work; // Pairs of parts looked at so far, to stop at OCTAL_MAX_WORK
+} Sequence;
+
+/**
+ * Compute the Grundy value of the next heap size from the ones before it, and count the work it took
+ * @param sequence
+ * @return the value, or -1 if it would be over OCTAL_MAX_VALUE
+ */
+static int computeValue(Sequence *sequence);
+
+/**
+ * Add the next heap size's value to the sequence
+ * @param sequence
+ * @param value
+ * @return 1 if successful, 0 if memory could not be allocated
+ */
+static int appendValue(Sequence *sequence, int value);
+
+/**
+ * Pick the mask that makes the fewest heap sizes computed so far rare, and list them again if it changed
+ * @param sequence
+ * @return 1 if successful, 0 if memory could not be allocated
+ */
+static int pickMask(Sequence *sequence);
+
+/**
+ * Look for the point where the Grundy values start repeating, and store it in the rules. By the octal game
+ * periodicity theorem, values that repeat with period p from heap size e up to 2e + p + t, where t is the largest
+ * amount that can be taken, repeat forever.
+ * @param rules
+ * @param values Grundy values for heap sizes 0 through length - 1
+ * @param length number of values computed
+ * @return 1 if the repeat was proven, 0 if more values are needed
+ */
+static int findOctalPeriod(Rules *rules, const unsigned short *values, long long length);
+
+/**
+ * Read the values a cache file has for the rules' code
+ * @param fileName
+ * @param rules the rules, whose preperiod and period are set from the file
+ * @param values address to store the values, to be freed by the caller
+ * @param length address to store the number of values
+ * @return 1 if the file has values for the same code, 0 otherwise
+ */
+static int readCache(const char *fileName, Rules *rules, unsigned short **values, long long *length);
+
+/**
+ * Write the rules' table to a cache file, through a temporary file renamed into place so a reader never sees half
+ * of one
+ * @param fileName
+ * @param rules
+ * @return 1 if the file was written, 0 otherwise
+ */
+static int writeCache(const char *fileName, const Rules *rules);
+
+int newOctalRules(Rules *rules, const char *text, long long maxHeap, const char *cacheFile) {
+    unsigned char digits[MAX_RULE_MOVES + 1] = {0};
+    int digitCount = 1;
+
+    if (*text == '0') // The digit before the point is always 0 here, so it can be left out
+        text++;
+    if (*text++ != '.')
+        return 0;
+    for (; *text >= '0' && *text <= '7' && digitCount <= MAX_RULE_MOVES; text++)
+        digits[digitCount++] = (unsigned char) (*text - '0');
+    return *text == '\0' && newOctalDigitRules(rules, digits, digitCount, maxHeap, cacheFile);
+}
+
+int newOctalDigitRules(Rules *rules, const unsigned char digits[], int digitCount, long long maxHeap,
+                       const char *cacheFile) {
+    Sequence sequence;
+    unsigned short *grown;
+    long long nextCheck, cached = 0;
+    int value, found = 0, k;
+
+    rules->misere = 0;
+    rules->anyAmount = 0;
+    rules->maxRows = 1;
+    rules->moveCount = 0;
+    rules->octal = 1;
+    rules->preperiod = 0;
+    rules->period = 0;
+    rules->table = NULL;
+    memset(rules->digits, 0, sizeof(rules->digits));
+    if (digitCount < 1 || digitCount > MAX_RULE_MOVES + 1 || digits[0] != 0 || maxHeap < 0 || maxHeap > OCTAL_MAX_HEAP)
+        return 0;
+
+    memset(&sequence, 0, sizeof(sequence));
+    sequence.rules = rules;
+    sequence.top = 1;
+    for (k = 1; k < digitCount; k++) {
+        if (digits[k] > 7)
+            return 0;
+        rules->digits[k] = digits[k];
+        if (digits[k] != 0)
+            rules->moves[rules->moveCount++] = k;
+        if (digits[k] & 4)
+            sequence.splits[sequence.splitCount++] = k;
+    }
+    if (rules->moveCount == 0)
+        return 0;
+
+    // Pick up where the cache left off, if it was made for the same code
+    if (cacheFile != NULL && readCache(cacheFile, rules, &sequence.values, &cached) &&
+        (rules->period > 0 || cached > maxHeap)) {
+        rules->table = sequence.values;
+        return 1;
+    }
+    grown = realloc(sequence.values, (maxHeap + 1) * sizeof(unsigned short));
+    sequence.counts = calloc(OCTAL_MAX_VALUE + 1, sizeof(long long));
+    if (grown == NULL || sequence.counts == NULL) {
+        free(grown == NULL ? sequence.values : grown);
+        free(sequence.counts);
+        return 0;
+    }
+    sequence.values = grown;
+    while (sequence.length < cached) // Count the cached values; there is no mask yet, so nothing is listed
+        appendValue(&sequence, sequence.values[sequence.length]);
+    value = sequence.length >= FIRST_CHECK && !pickMask(&sequence) ? -1 : 0;
+
+    nextCheck = sequence.length < FIRST_CHECK ? FIRST_CHECK : sequence.length + sequence.length / 8;
+    while (value >= 0 && !found && sequence.length <= maxHeap && sequence.work < OCTAL_MAX_WORK) {
+        value = computeValue(&sequence);
+        if (value < 0 || !appendValue(&sequence, value)) {
+            value = -1;
+            break;
+        }
+        if (sequence.length == nextCheck) { // Look for the repeat every so often
+            found = findOctalPeriod(rules, sequence.values, sequence.length);
+            nextCheck += sequence.length / 8 > FIRST_CHECK ? sequence.length / 8 : FIRST_CHECK;
+        }
+        if (sequence.length >= FIRST_CHECK && (sequence.length & (sequence.length - 1)) == 0 && !pickMask(&sequence))
+            value = -1; // Rebalance the mask each time the count doubles
+    }
+    free(sequence.rare);
+    free(sequence.counts);
+    if (value < 0) {
+        free(sequence.values);
+        return 0;
+    }
+
+    if (found || findOctalPeriod(rules, sequence.values, sequence.length)) {
+        // Only keep what is needed to look up any heap size
+        grown = realloc(sequence.values, (rules->preperiod + rules->period) * sizeof(unsigned short));
+        rules->table = grown == NULL ? sequence.values : grown;
+    } else { // Not proven to repeat yet, so the table just ends
+        rules->preperiod = sequence.length;
+        rules->table = sequence.values;
+    }
+    if (cacheFile != NULL)
+        writeCache(cacheFile, rules);
+    return 1;
+}
+
+int octalAllowed(const Rules *rules, long long heap, long long pieces, long long left) {
+    long long right = heap - pieces - left;
+    if (pieces < 1 || pieces > MAX_RULE_MOVES || left < 0 || right < 0)
+        return 0;
+    return rules->digits[pieces] >> ((left > 0) + (right > 0)) & 1; // Bit 1, 2 or 4 for leaving 0, 1 or 2 rows
+}
+
+int octalFirstMove(const Rules *rules, const long long heaps[], int heapCount, int *chosenRow, long long *pieces,
+                   long long *left) {
+    long long place;
+    int i, j;
+
+    // Taking from the end and taking from one piece in cover every number of rows a move can leave
+    for (i = 0; i < heapCount; i++) {
+        for (j = 0; j < rules->moveCount && rules->moves[j] <= heaps[i]; j++) {
+            for (place = 0; place <= 1 && place <= heaps[i] - rules->moves[j]; place++) {
+                if (octalAllowed(rules, heaps[i], rules->moves[j], place)) {
+                    *chosenRow = i + 1;
+                    *pieces = rules->moves[j];
+                    *left = place;
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+int octalMove(const Rules *rules, const long long heaps[], int heapCount, int *chosenRow, long long *pieces,
+              long long *left) {
+    long long X = 0; // Grundy sum of the whole board
+    long long target, rest, place;
+    int digit, i, j;
+
+    for (i = 0; i < heapCount; i++) {
+        if (grundyValue(rules, heaps[i]) < 0) // Past the end of a table that never repeated
+            return 0;
+        X ^= grundyValue(rules, heaps[i]);
+    }
+    if (X == 0) // Every move leaves a nonzero sum, which the other player can bring back to 0
+        return 0;
+
+    for (i = 0; i < heapCount; i++) {
+        target = X ^ grundyValue(rules, heaps[i]); // Leave what is left of this row at the sum of every other row
+        for (j = 0; j < rules->moveCount && rules->moves[j] <= heaps[i]; j++) {
+            *chosenRow = i + 1;
+            *pieces = rules->moves[j];
+            *left = 0;
+            rest = heaps[i] - rules->moves[j];
+            digit = rules->digits[rules->moves[j]];
+            if (rest == 0 ? (digit & 1) && target == 0 : (digit & 2) && grundyValue(rules, rest) == target)
+                return 1;
+            for (place = 1; (digit & 4) && 2 * place <= rest; place++) { // The two parts are worth their nim sum
+                if ((grundyValue(rules, place) ^ grundyValue(rules, rest - place)) == target) {
+                    *left = place;
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+static int computeValue(Sequence *sequence) {
+    const Rules *rules = sequence->rules;
+    const unsigned short *values = sequence->values;
+    unsigned long long seen[(OCTAL_MAX_VALUE + 1) / 64 + 1]; // Bit v is set when some move reaches value v, up to top
+    long long n = sequence->length, r, part, rest, limit;
+    int words = (int) (sequence->top / 64) + 1; // Nim sums of values stay below top, so the mex is at most top
+    int mex, value, k, j, w;
+
+    memset(seen, 0, words * sizeof(seen[0]));
+
+    // Taking the whole row, or from one end of it
+    for (j = 0; j < rules->moveCount && rules->moves[j] <= n; j++) {
+        k = rules->moves[j];
+        if (n == k ? rules->digits[k] & 1 : rules->digits[k] & 2) {
+            value = n == k ? 0 : values[n - k];
+            seen[value >> 6] |= 1ULL << (value & 63);
+        }
+    }
+
+    // Every common value a split can reach pairs a rare part with a common one, so the rare heap sizes find them all
+    for (j = 0; j < sequence->splitCount && sequence->splits[j] + 2 <= n; j++) {
+        rest = n - sequence->splits[j];
+        for (r = 0; r < sequence->rareCount && sequence->rare[r] < rest; r++) {
+            value = values[sequence->rare[r]] ^ values[rest - sequence->rare[r]];
+            seen[value >> 6] |= 1ULL << (value & 63);
+        }
+        sequence->work += r;
+    }
+    for (w = 0; seen[w] == ~0ULL; w++) {/* none */}
+    mex = 64 * w + __builtin_ctzll(~seen[w]);
+
+    // A rare mex may still be reached by splitting into two rare or two common parts, so go through the splits
+    // until it turns up, and stop as soon as the smallest value not seen is common
+    limit = sequence->splitCount > 0 ? (n - sequence->splits[0]) / 2 : 0;
+    for (part = 1; part <= limit && !__builtin_parity(mex & sequence->mask); part++) {
+        for (j = 0; j < sequence->splitCount && 2 * part <= n - sequence->splits[j]; j++) {
+            value = values[part] ^ values[n - sequence->splits[j] - part];
+            seen[value >> 6] |= 1ULL << (value & 63);
+        }
+        sequence->work += j;
+        for (w = 0; seen[w] == ~0ULL; w++) {/* none */}
+        mex = 64 * w + __builtin_ctzll(~seen[w]);
+    }
+    return mex <= OCTAL_MAX_VALUE ? mex : -1;
+}
+
+static int appendValue(Sequence *sequence, int value) {
+    long long capacity;
+    int *grown;
+
+    if (sequence->mask != 0 && sequence->length > 0 && !__builtin_parity(value & sequence->mask)) {
+        if (sequence->rareCount == sequence->rareCapacity) {
+            capacity = sequence->rareCapacity ? 2 * sequence->rareCapacity : 64;
+            grown = realloc(sequence->rare, capacity * sizeof(int));
+            if (grown == NULL)
+                return 0;
+            sequence->rare = grown;
+            sequence->rareCapacity = capacity;
+        }
+        sequence->rare[sequence->rareCount++] = (int) sequence->length;
+    }
+    sequence->values[sequence->length++] = (unsigned short) value;
+    sequence->counts[value]++;
+    for (; sequence->top <= (unsigned int) value; sequence->top <<= 1) {/* none */}
+    return 1;
+}
+
+static int pickMask(Sequence *sequence) {
+    unsigned int top = sequence->top, best = 0, half, mask, i;
+    long long length = sequence->length, *walsh, a, b;
+
+    if (top < 2) // Every value so far is 0, which is rare under any mask
+        return 1;
+    walsh = malloc(top * sizeof(long long));
+    if (walsh == NULL)
+        return 0;
+
+    // A Walsh-Hadamard transform of the counts turns entry S into the number of heap sizes rare under mask S minus
+    // the number common under it, for every S at once
+    memcpy(walsh, sequence->counts, top * sizeof(long long));
+    for (half = 1; half < top; half <<= 1) {
+        for (i = 0; i < top; i += 2 * half) {
+            for (mask = i; mask < i + half; mask++) {
+                a = walsh[mask];
+                b = walsh[mask + half];
+                walsh[mask] = a + b;
+                walsh[mask + half] = a - b;
+            }
+        }
+    }
+    for (mask = 1; mask < top; mask++)
+        if (best == 0 || walsh[mask] < walsh[best])
+            best = mask;
+    if (sequence->mask != 0 && walsh[sequence->mask] <= walsh[best]) // Keep the old one rather than list them again
+        best = sequence->mask;
+    free(walsh);
+    if (best == sequence->mask)
+        return 1;
+
+    // List the rare heap sizes again, under the new mask
+    sequence->mask = best;
+    sequence->rareCount = 0;
+    sequence->length = 0;
+    while (sequence->length < length) {
+        sequence->counts[sequence->values[sequence->length]]--; // Added back right away
+        if (!appendValue(sequence, sequence->values[sequence->length])) {
+            sequence->length = length;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int findOctalPeriod(Rules *rules, const unsigned short *values, long long length) {
+    long long largest = rules->moves[rules->moveCount - 1]; // The largest move
+    long long period, start, best = -1;
+
+    // Try every period and keep the one with the smallest table
+    for (period = 1; 2 * period + largest <= length; period++) {
+        // Walk back from the end to find where this period stops matching
+        for (start = length - period; start > 0 && values[start - 1] == values[start - 1 + period]; start--) {/* none */}
+        if (length - period < 2 * start + period + largest) // The matching stretch is too short to prove anything
+            continue;
+        if (best < 0 || start + period < best) {
+            best = start + period;
+            rules->preperiod = start;
+            rules->period = period;
+        }
+        if (period >= best)
+            break; // Any longer period needs a bigger table
+    }
+    return best >= 0;
+}
+
+static int readCache(const char *fileName, Rules *rules, unsigned short **values, long long *length) {
+    const unsigned char *data, *in, *end;
+    unsigned long long preperiod, period, n;
+    int digitCount = rules->moves[rules->moveCount - 1], file = open(fileName, O_RDONLY), valid, i;
+    unsigned int sum = 0;
+    struct stat info;
+    void *mapping;
+    size_t size;
+
+    if (file < 0)
+        return 0;
+    if (fstat(file, &info) != 0 || info.st_size < CACHE_HEADER_SIZE + digitCount + 4) {
+        close(file);
+        return 0;
+    }
+    size = info.st_size;
+    mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file); // The mapping stays valid after the file is closed
+    if (mapping == MAP_FAILED)
+        return 0;
+    data = mapping;
+    end = data + size - 4;
+    for (i = 0; i < 4; i++)
+        sum |= (unsigned int) end[i] << (8 * i);
+
+    // Two bytes for each value, after the preperiod and period
+    in = data + CACHE_HEADER_SIZE + digitCount;
+    valid = memcmp(data, CACHE_MAGIC, strlen(CACHE_MAGIC)) == 0 && data[6] == CACHE_VERSION &&
+            data[7] == digitCount && memcmp(data + CACHE_HEADER_SIZE, rules->digits + 1, digitCount) == 0 &&
+            sum == checksum(data, size - 4) && (in = getNumber(in, end, &preperiod)) != NULL &&
+            (in = getNumber(in, end, &period)) != NULL && preperiod + period > 0 &&
+            preperiod + period == (unsigned long long) (end - in) / 2 && (end - in) % 2 == 0 &&
+            (*values = malloc((preperiod + period) * sizeof(unsigned short))) != NULL;
+    if (valid) {
+        for (n = 0; n < preperiod + period; n++, in += 2) // Little-endian, like the checksum
+            (*values)[n] = (unsigned short) (in[0] | in[1] << 8);
+        rules->preperiod = (long long) preperiod;
+        rules->period = (long long) period;
+        *length = (long long) (preperiod + period);
+    }
+    munmap(mapping, size);
+    return valid;
+}
+
+static int writeCache(const char *fileName, const Rules *rules) {
+    long long tableSize = rules->preperiod + rules->period, n;
+    int digitCount = rules->moves[rules->moveCount - 1], written, i;
+    unsigned char *buffer, *out;
+    unsigned int sum;
+    char *temporary;
+    FILE *file;
+
+    buffer = malloc(CACHE_HEADER_SIZE + digitCount + 2 * MAX_NUMBER_BYTES + 2 * tableSize + 4);
+    temporary = malloc(strlen(fileName) + 5);
+    if (buffer == NULL || temporary == NULL) {
+        free(buffer);
+        free(temporary);
+        return 0;
+    }
+    memcpy(buffer, CACHE_MAGIC, strlen(CACHE_MAGIC));
+    buffer[6] = CACHE_VERSION;
+    buffer[7] = (unsigned char) digitCount;
+    memcpy(buffer + CACHE_HEADER_SIZE, rules->digits + 1, digitCount);
+    out = putNumber(buffer + CACHE_HEADER_SIZE + digitCount, (unsigned long long) rules->preperiod);
+    out = putNumber(out, (unsigned long long) rules->period);
+    for (n = 0; n < tableSize; n++) {
+        *out++ = (unsigned char) rules->table[n];
+        *out++ = (unsigned char) (rules->table[n] >> 8);
+    }
+    sum = checksum(buffer, out - buffer);
+    for (i = 0; i < 4; i++) // Little-endian, like the checksum of a save
+        *out++ = (unsigned char) (sum >> (8 * i));
+
+    strcpy(temporary, fileName);
+    strcat(temporary, ".tmp");
+    file = fopen(temporary, "wb");
+    written = file != NULL && fwrite(buffer, 1, out - buffer, file) == (size_t) (out - buffer);
+    written = file != NULL && fclose(file) == 0 && written && rename(temporary, fileName) == 0;
+    if (!written)
+        remove(temporary);
+    free(buffer);
+    free(temporary);
+    return written;
+}
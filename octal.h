@@ -0,0 +1,86 @@
+#ifndef NIM_OCTAL_H
+#define NIM_OCTAL_H
+
+#include "grundy.h"
+
+#define OCTAL_MAX_HEAP (1LL << 26) // Largest heap size Grundy values are computed up to
+#define OCTAL_MAX_VALUE 65535 // Largest Grundy value the table can hold; codes that go past it are turned down
+#define OCTAL_MAX_WORK (1LL << 30) // Most pairs of parts one set-up looks at, a few seconds' work, before it stops early
+
+/**
+ * Set up an octal game, such as Kayles (0.77) or Dawson's Kayles (0.07). Digit k after the point says what taking
+ * k pieces from a row can leave: it is the sum of 1 if the row can be emptied, 2 if one row can be left, and 4 if
+ * the pieces can come from the middle, leaving two rows. Grundy values are computed by mex like for subtraction
+ * rules, but a split row is worth the nim sum of its two parts, so each value has a choice of every way to split,
+ * which makes the obvious computation quadratic. Instead, values are sorted into rare and common ones by the parity
+ * of their bits under a mask picked to keep the rare ones few: a common value can only come from splitting into a
+ * rare and a common part, so walking the rare heap sizes finds every common option, and only a rare candidate for
+ * the mex needs a scan of the splits, which stops as soon as it is found. Values are computed until the octal game
+ * periodicity theorem proves the repeat, or up to maxHeap. Unlike the other constructors, this starts out in normal
+ * play, since Grundy values do not decide misère octal games.
+ *
+ * Codes whose values do not split that way, such as 0.04, 0.14 and 0.6, have many rare values and stay close to
+ * quadratic: a few hundred thousand heap sizes take seconds, and a million take minutes. So the work is capped at
+ * OCTAL_MAX_WORK, after which the table ends where it got to (grundyValue then gives -1 past it, and newGame turns
+ * such rows down). With a cache file, the next call picks up from there.
+ * @param rules address of the rules to set up
+ * @param text the code, such as "0.137" or ".07", with at most MAX_RULE_MOVES digits after the point
+ * @param maxHeap the largest heap size the values are needed for, at most OCTAL_MAX_HEAP
+ * @param cacheFile file to start from the values in, if they were computed for the same code, and to keep them in
+ * for next time; or NULL to always compute them
+ * @return 1 if the rules were set up successfully, even if the table ends before maxHeap; 0 if the code is invalid, a
+ * value would be over OCTAL_MAX_VALUE, or memory could not be allocated
+ */
+int newOctalRules(Rules *rules, const char *text, long long maxHeap, const char *cacheFile);
+
+/**
+ * Set up an octal game from its digits, as newOctalRules does from text
+ * @param rules address of the rules to set up
+ * @param digits digit k for every amount k from 0 to digitCount - 1; digit 0 must be 0
+ * @param digitCount number of digits, at most MAX_RULE_MOVES + 1
+ * @param maxHeap the largest heap size the values are needed for, at most OCTAL_MAX_HEAP
+ * @param cacheFile file to keep the values in, or NULL
+ * @return 1 if the rules were set up successfully, 0 otherwise
+ */
+int newOctalDigitRules(Rules *rules, const unsigned char digits[], int digitCount, long long maxHeap,
+                       const char *cacheFile);
+
+/**
+ * Determine whether an octal code allows taking pieces from a row at a given place
+ * @param rules
+ * @param heap number of pieces in the row
+ * @param pieces number of pieces to take
+ * @param left number of pieces to leave to the left of the ones taken, from 0 to heap - pieces
+ * @return 1 if the move is allowed, 0 if not
+ */
+int octalAllowed(const Rules *rules, long long heap, long long pieces, long long left);
+
+/**
+ * Find the first move an octal code allows, to check whether any is left or to play a dummy move
+ * @param rules
+ * @param heaps number of pieces left in each row
+ * @param heapCount number of rows
+ * @param chosenRow address to store the chosen row (1, 2, 3, ...)
+ * @param pieces address to store the chosen number of pieces to take
+ * @param left address to store the number of pieces to leave to their left
+ * @return 1 if there is a move, 0 if no row allows one
+ */
+int octalFirstMove(const Rules *rules, const long long heaps[], int heapCount, int *chosenRow, long long *pieces,
+                   long long *left);
+
+/**
+ * Find a move in an octal game that brings the Grundy sum of the rows to 0, trying every amount and every place to
+ * take it from in each row
+ * @param rules
+ * @param heaps number of pieces left in each row
+ * @param heapCount number of rows
+ * @param chosenRow address to store the chosen row (1, 2, 3, ...)
+ * @param pieces address to store the chosen number of pieces to take
+ * @param left address to store the number of pieces to leave to their left
+ * @return 1 if a winning move was found, 0 if every move loses against perfect play or a row is past the end of the
+ * Grundy table
+ */
+int octalMove(const Rules *rules, const long long heaps[], int heapCount, int *chosenRow, long long *pieces,
+              long long *left);
+
+#endif
@@ -0,0 +1,189 @@
+#include <stdlib.h>
+#include <string.h>
+#include "ponder.h"
+
+/**
+ * Work out a reply to every move in turn until they run out or the ponderer is stopped, then refine a Monte Carlo
+ * player's quick replies
+ * @param arg address of the Ponderer
+ * @return NULL
+ */
+static void *ponder(void *arg);
+
+/**
+ * Work out a reply to every move in turn, in order of row and then amount
+ * @param ponderer
+ * @return 1 if every move has a reply, or there is no room for more; 0 if the ponderer was stopped
+ */
+static int replyToEveryMove(Ponderer *ponderer);
+
+/**
+ * Work out the computer's reply to one move on the ponderer's board, which is put back afterwards
+ * @param ponderer
+ * @param row row the move takes from (1, 2, 3, ...)
+ * @param pieces pieces it takes
+ * @param reply address to store the reply
+ * @return 1 if the reply was worked out, 0 if the move ends the game or the ponderer was stopped during the search
+ */
+static int replyTo(Ponderer *ponderer, int row, long long pieces, Turn *reply);
+
+/**
+ * Order replies so the ones a Monte Carlo player won least often come first, for qsort
+ * @param a address of a Reply
+ * @param b address of a Reply
+ * @return negative, 0 or positive as a's win rate is below, equal to or above b's
+ */
+static int compareReplies(const void *a, const void *b);
+
+int newPonderer(Ponderer *ponderer) {
+    ponderer->heaps = NULL;
+    ponderer->heapCapacity = 0;
+    ponderer->replies = malloc(PONDER_MAX_REPLIES * sizeof(Reply));
+    ponderer->replyCount = 0;
+    atomic_init(&ponderer->stop, 0);
+    ponderer->running = 0;
+    return ponderer->replies != NULL;
+}
+
+int startPondering(Ponderer *ponderer, const Game *game) {
+    long long *heaps;
+
+    stopPondering(ponderer, NULL, NULL);
+    if (game->rules->octal) // Replies are matched by row and amount, which do not say where an octal move splits
+        return 0;
+    if (game->heapCount > ponderer->heapCapacity) {
+        heaps = realloc(ponderer->heaps, game->heapCount * sizeof(long long));
+        if (heaps == NULL)
+            return 0;
+        ponderer->heaps = heaps;
+        ponderer->heapCapacity = game->heapCount;
+    }
+    memcpy(ponderer->heaps, game->heaps, game->heapCount * sizeof(long long));
+    ponderer->game = *game; // The rules, tablebase, searcher and Monte Carlo player are shared; the board is not
+    ponderer->game.heaps = ponderer->heaps;
+
+    ponderer->replyCount = 0;
+    atomic_store(&ponderer->stop, 0);
+    ponderer->running = pthread_create(&ponderer->thread, NULL, ponder, ponderer) == 0;
+    return ponderer->running;
+}
+
+int stopPondering(Ponderer *ponderer, const Turn *move, Turn *reply) {
+    int found = 0, i;
+
+    if (ponderer->running) {
+        atomic_store(&ponderer->stop, 1);
+        if (ponderer->game.mcts != NULL) // A search can take seconds; end it now instead of waiting it out
+            atomic_store(&ponderer->game.mcts->stop, 1);
+        pthread_join(ponderer->thread, NULL);
+        if (ponderer->game.mcts != NULL)
+            atomic_store(&ponderer->game.mcts->stop, 0);
+        ponderer->running = 0;
+    }
+
+    if (move != NULL && move->count == 1)
+        for (i = 0; i < ponderer->replyCount && !found; i++)
+            if (ponderer->replies[i].row == move->rows[0] && ponderer->replies[i].pieces == move->pieces[0]) {
+                *reply = ponderer->replies[i].reply;
+                found = 1;
+            }
+    ponderer->replyCount = 0; // They were replies to this position only
+    return found;
+}
+
+void freePonderer(Ponderer *ponderer) {
+    stopPondering(ponderer, NULL, NULL);
+    free(ponderer->heaps);
+    free(ponderer->replies);
+    ponderer->heaps = NULL;
+    ponderer->replies = NULL;
+    ponderer->heapCapacity = 0;
+}
+
+static void *ponder(void *arg) {
+    Ponderer *ponderer = arg;
+    Mcts *mcts = ponderer->game.mcts;
+    double timeLimit;
+    long long playoutLimit;
+    Turn reply;
+    int finished, i;
+
+    if (mcts == NULL) { // An exact reply is as good as it gets the first time
+        replyToEveryMove(ponderer);
+        return NULL;
+    }
+
+    // A quick search for every move first, so whichever one is made has a reply
+    timeLimit = mcts->timeLimit;
+    playoutLimit = mcts->playoutLimit;
+    mcts->timeLimit = timeLimit / PONDER_QUICK_SHARE;
+    if (playoutLimit > 0 || timeLimit <= 0) // Without either limit, a search runs MCTS_DEFAULT_PLAYOUTS playouts
+        mcts->playoutLimit = (playoutLimit > 0 ? playoutLimit : MCTS_DEFAULT_PLAYOUTS) / PONDER_QUICK_SHARE + 1;
+    finished = replyToEveryMove(ponderer);
+    mcts->timeLimit = timeLimit; // The game searches with the whole budget again once pondering stops
+    mcts->playoutLimit = playoutLimit;
+    if (!finished)
+        return NULL;
+
+    // Then the full search, first for the moves the other player is most likely to make: the best ones for them
+    qsort(ponderer->replies, ponderer->replyCount, sizeof(Reply), compareReplies);
+    for (i = 0; i < ponderer->replyCount; i++) {
+        if (!replyTo(ponderer, ponderer->replies[i].row, ponderer->replies[i].pieces, &reply))
+            return NULL; // A cut-short search is thrown away, and the quick reply kept
+        ponderer->replies[i].reply = reply;
+    }
+    return NULL;
+}
+
+static int replyToEveryMove(Ponderer *ponderer) {
+    Game *game = &ponderer->game;
+    Searcher variant;
+    Reply *entry;
+    long long pieces;
+    int row;
+
+    // Walk the amounts the same way the searcher does, with no restrictions beyond the rules if the game has none
+    if (game->searcher != NULL) {
+        variant = *game->searcher;
+    } else {
+        memset(&variant, 0, sizeof(variant));
+        variant.rules = game->rules;
+        variant.maxRowsPerMove = 1;
+    }
+
+    for (row = 0; row < game->heapCount; row++) {
+        for (pieces = searchNextAmount(&variant, game->heaps, row, 0); pieces != 0;
+             pieces = searchNextAmount(&variant, game->heaps, row, pieces)) {
+            if (ponderer->replyCount == PONDER_MAX_REPLIES)
+                return 1;
+            entry = &ponderer->replies[ponderer->replyCount];
+            if (replyTo(ponderer, row + 1, pieces, &entry->reply)) {
+                entry->row = row + 1;
+                entry->pieces = pieces;
+                entry->winRate = game->mcts != NULL ? game->mcts->winRate : 0;
+                ponderer->replyCount++;
+            } else if (atomic_load(&ponderer->stop)) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+static int replyTo(Ponderer *ponderer, int row, long long pieces, Turn *reply) {
+    Game *game = &ponderer->game;
+    int ended;
+
+    removePieces(game, row, pieces);
+    ended = gameWon(game); // Nothing to reply to a move that ends the game
+    if (!ended)
+        getAITurn(game, reply);
+    game->heaps[row - 1] += pieces; // Put the pieces back for the next move
+    game->total += pieces;
+    return !ended && !atomic_load(&ponderer->stop); // The reply may have been cut short, so it is not kept
+}
+
+static int compareReplies(const void *a, const void *b) {
+    double first = ((const Reply *) a)->winRate, second = ((const Reply *) b)->winRate;
+    return (first > second) - (first < second);
+}
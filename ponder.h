@@ -0,0 +1,74 @@
+#ifndef NIM_PONDER_H
+#define NIM_PONDER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "game.h"
+
+#define PONDER_MAX_REPLIES 4096 // Most of the other player's moves worked out ahead in one turn
+#define PONDER_QUICK_SHARE 16 // A Monte Carlo player's first reply to each move gets this share of its search budget
+
+/**
+ * The computer's reply to one move the other player could make
+ */
+typedef struct {
+    int row; // Row the move takes from (1, 2, 3, ...)
+    long long pieces; // Pieces it takes
+    Turn reply; // What getAITurn plays after it
+    double winRate; // Under a Monte Carlo player, the share of the quick search's playouts the reply won
+} Reply;
+
+/**
+ * Works out the computer's replies on a thread of its own while the other player is still choosing their move, so
+ * the reply to whichever move they make is usually ready the moment they make it. Every one-row move is tried in
+ * order of row and then amount, up to PONDER_MAX_REPLIES of them. A Monte Carlo player's full search is too slow to
+ * cover every move in time, so it first answers each with a quick search of 1/PONDER_QUICK_SHARE of its budget, then
+ * searches again in full, starting with the moves the quick searches rated best for the other player, the ones they
+ * are most likely to make. The ponderer plays on a copy of the board but shares everything else with the game, so the
+ * game's searcher and Monte Carlo player must not be used by anyone else until pondering stops.
+ */
+typedef struct {
+    Game game; // Copy of the game being pondered, over heaps of the ponderer's own
+    long long *heaps; // Pieces left in each row of the copy
+    int heapCapacity; // Rows heaps has room for
+    Reply *replies; // Replies worked out so far
+    int replyCount; // Number of replies, only read once the thread has stopped
+    atomic_int stop; // Set to make the thread stop after the reply it is working on, which is then thrown away
+    pthread_t thread; // Works out the replies
+    int running; // 1 while the thread has not been joined
+} Ponderer;
+
+/**
+ * Set up a ponderer that is not pondering yet
+ * @param ponderer address of the ponderer to set up
+ * @return 1 if successful, 0 if memory could not be allocated
+ */
+int newPonderer(Ponderer *ponderer);
+
+/**
+ * Start working out replies to every move the player to move could make. Anything still being pondered is stopped
+ * first. Octal games are not pondered: their moves split rows, and their replies come from the Grundy values in a
+ * single pass over the rows anyway.
+ * @param ponderer
+ * @param game the position the other player is choosing a move in; it can change once this returns
+ * @return 1 if pondering started, 0 if the game is an octal game, memory could not be allocated or the thread could
+ * not be started
+ */
+int startPondering(Ponderer *ponderer, const Game *game);
+
+/**
+ * Stop pondering, cutting short a Monte Carlo search that is under way, and get the reply to the move that was made
+ * @param ponderer
+ * @param move the move the other player made, or NULL if none was
+ * @param reply address to store the reply
+ * @return 1 if the reply had been worked out, 0 if it has to be worked out now
+ */
+int stopPondering(Ponderer *ponderer, const Turn *move, Turn *reply);
+
+/**
+ * Stop pondering and release the memory held by a ponderer
+ * @param ponderer
+ */
+void freePonderer(Ponderer *ponderer);
+
+#endif
@@ -0,0 +1,386 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include "render.h"
+
+#define MIN_TEXT_LINES 3 // Lines kept under the board for text to scroll in
+#define PIECE " ■" // Two columns on the screen
+
+/**
+ * Look up whether output is a terminal and how big it is
+ * @param renderer
+ */
+static void measureTerminal(Renderer *renderer);
+
+/**
+ * Find how many rows fit on the screen from the first row in view
+ * @param renderer
+ * @param game
+ * @return the number of rows to draw
+ */
+static int rowsInView(const Renderer *renderer, const Game *game);
+
+/**
+ * Find the width of a row's label, which pads small rows so the board lines up on the right
+ * @param number human-friendly index of the row (1, 2, 3, ...)
+ * @param size number of pieces the row started with
+ * @return the width in columns
+ */
+static int labelWidth(int number, long long size);
+
+/**
+ * Find how many of a row's pieces fit on the screen from the first piece in view
+ * @param renderer
+ * @param number human-friendly index of the row (1, 2, 3, ...)
+ * @param size number of pieces the row started with
+ * @return the number of pieces to draw
+ */
+static long long piecesInView(const Renderer *renderer, int number, long long size);
+
+/**
+ * Add text to the frame being built
+ * @param renderer
+ * @param text
+ * @param length
+ * @return 1 if successful, 0 if memory ran out
+ */
+static int putText(Renderer *renderer, const char *text, size_t length);
+
+/**
+ * Add a cursor movement to the frame being built
+ * @param renderer
+ * @param line line on the screen (1, 2, 3, ...)
+ * @param column column on the screen (1, 2, 3, ...)
+ * @return 1 if successful, 0 if memory ran out
+ */
+static int moveCursor(Renderer *renderer, int line, long long column);
+
+/**
+ * Add a run of pieces of the same color to the frame being built
+ * @param renderer
+ * @param color EMPTY_PIECE or FULL_PIECE
+ * @param count number of pieces
+ * @return 1 if successful, 0 if memory ran out
+ */
+static int putPieces(Renderer *renderer, const char *color, long long count);
+
+/**
+ * Add a whole row, label and all, to the frame being built
+ * @param renderer
+ * @param game
+ * @param number human-friendly index of the row (1, 2, 3, ...)
+ * @param first index of the first piece to draw
+ * @param count number of pieces to draw
+ * @return 1 if successful, 0 if memory ran out
+ */
+static int putRow(Renderer *renderer, const Game *game, int number, long long first, long long count);
+
+/**
+ * Build a frame that draws the whole board
+ * @param renderer
+ * @param game
+ * @return 1 if successful, 0 if memory ran out
+ */
+static int fullFrame(Renderer *renderer, const Game *game);
+
+/**
+ * Build a frame that only redraws the pieces that changed since the frame on the screen
+ * @param renderer
+ * @param game
+ * @return 1 if successful, 0 if memory ran out
+ */
+static int changedFrame(Renderer *renderer, const Game *game);
+
+/**
+ * Determine whether the frame on the screen can be updated in place to show a game
+ * @param renderer
+ * @param game
+ * @return 1 if only pieces have to change, 0 if the frame has to be drawn in full
+ */
+static int canUpdate(const Renderer *renderer, const Game *game);
+
+/**
+ * Remember what the frame on the screen shows, so the next frame can be compared to it
+ * @param renderer
+ * @param game
+ * @return 1 if successful, 0 if memory ran out
+ */
+static int remember(Renderer *renderer, const Game *game);
+
+/**
+ * Write the frame that was built with one write, after anything printf is still holding
+ * @param renderer
+ * @return 1 if the whole frame was written, 0 otherwise
+ */
+static int writeFrame(Renderer *renderer);
+
+void newRenderer(Renderer *renderer) {
+    memset(renderer, 0, sizeof(Renderer));
+    measureTerminal(renderer);
+}
+
+void freeRenderer(Renderer *renderer) {
+    if (renderer->terminal && renderer->drawn) { // Setting the scroll region moves the cursor, so keep it in place
+        renderer->used = 0;
+        if (putText(renderer, "\e7\e[r\e8", strlen("\e7\e[r\e8")))
+            writeFrame(renderer);
+    }
+    free(renderer->sizes);
+    free(renderer->shown);
+    free(renderer->buffer);
+    memset(renderer, 0, sizeof(Renderer));
+}
+
+int drawBoard(Renderer *renderer, const Game *game) {
+    long long largest = 1;
+    int i, built;
+
+    measureTerminal(renderer);
+    for (i = 0; i < game->heapCount; i++)
+        if (game->sizes[i] > largest)
+            largest = game->sizes[i];
+    if (renderer->firstRow > game->heapCount - 1)
+        renderer->firstRow = game->heapCount > 0 ? game->heapCount - 1 : 0;
+    if (renderer->firstPiece > largest - 1)
+        renderer->firstPiece = largest - 1;
+
+    renderer->used = 0;
+    if (renderer->terminal && renderer->drawn && canUpdate(renderer, game))
+        built = changedFrame(renderer, game);
+    else
+        built = fullFrame(renderer, game);
+    if (!built || !writeFrame(renderer)) {
+        renderer->drawn = 0; // The screen is in an unknown state, so start over next time
+        return 0;
+    }
+    renderer->drawn = remember(renderer, game);
+    return 1;
+}
+
+int boardClipped(Renderer *renderer, const Game *game) {
+    int i, rows;
+
+    measureTerminal(renderer);
+    if (!renderer->terminal)
+        return 0;
+    rows = rowsInView(renderer, game);
+    if (renderer->firstRow > 0 || renderer->firstPiece > 0 || rows < game->heapCount)
+        return 1;
+    for (i = 0; i < rows; i++)
+        if (piecesInView(renderer, i + 1, game->sizes[i]) < game->sizes[i])
+            return 1;
+    return 0;
+}
+
+void scrollBoard(Renderer *renderer, int firstRow, long long firstPiece) {
+    renderer->firstRow = firstRow > 1 ? firstRow - 1 : 0;
+    renderer->firstPiece = firstPiece > 1 ? firstPiece - 1 : 0;
+}
+
+static void measureTerminal(Renderer *renderer) {
+    struct winsize size;
+
+    // Without room for the board and a few lines of text, frames are printed like ordinary text
+    renderer->terminal = isatty(STDOUT_FILENO) && ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 &&
+                         size.ws_row > MIN_TEXT_LINES + 2 && size.ws_col > 20;
+    renderer->width = renderer->terminal ? size.ws_col : 0;
+    renderer->height = renderer->terminal ? size.ws_row : 0;
+}
+
+static int rowsInView(const Renderer *renderer, const Game *game) {
+    int rows = game->heapCount - renderer->firstRow;
+    if (!renderer->terminal)
+        return game->heapCount;
+    if (rows > renderer->height - MIN_TEXT_LINES - 1) // One line goes to the status under the board
+        rows = renderer->height - MIN_TEXT_LINES - 1;
+    return rows;
+}
+
+static int labelWidth(int number, long long size) {
+    char label[32];
+    return sprintf(label, "Row %d", number) + (size < 10 ? 10 - (int) size : 1);
+}
+
+static long long piecesInView(const Renderer *renderer, int number, long long size) {
+    long long fit, left = size - renderer->firstPiece;
+    if (left < 0)
+        left = 0;
+    if (!renderer->terminal)
+        return size;
+    fit = (renderer->width - labelWidth(number, size) - 1) / 2; // One column goes to the board edge after the pieces
+    if (fit < 0)
+        fit = 0;
+    return left < fit ? left : fit;
+}
+
+static int putText(Renderer *renderer, const char *text, size_t length) {
+    char *grown;
+    size_t capacity;
+
+    if (renderer->used + length > renderer->capacity) {
+        capacity = renderer->capacity ? renderer->capacity * 2 : 4096;
+        while (capacity < renderer->used + length)
+            capacity *= 2;
+        grown = realloc(renderer->buffer, capacity);
+        if (grown == NULL)
+            return 0;
+        renderer->buffer = grown;
+        renderer->capacity = capacity;
+    }
+    memcpy(renderer->buffer + renderer->used, text, length);
+    renderer->used += length;
+    return 1;
+}
+
+static int moveCursor(Renderer *renderer, int line, long long column) {
+    char text[48];
+    return putText(renderer, text, sprintf(text, "\e[%d;%lldH", line, column));
+}
+
+static int putPieces(Renderer *renderer, const char *color, long long count) {
+    long long i;
+
+    if (count <= 0)
+        return 1;
+    // Pieces next to each other share their colors, so the escape codes only go at the start of the run
+    if (!putText(renderer, BOARD_BG, strlen(BOARD_BG)) || !putText(renderer, color, strlen(color)))
+        return 0;
+    for (i = 0; i < count; i++)
+        if (!putText(renderer, PIECE, sizeof(PIECE) - 1))
+            return 0;
+    return putText(renderer, RESET, strlen(RESET));
+}
+
+static int putRow(Renderer *renderer, const Game *game, int number, long long first, long long count) {
+    long long size = game->sizes[number - 1];
+    long long empty = size - game->heaps[number - 1]; // Pieces are removed from the left, so empty spaces come first
+    long long emptyInView = empty - first;
+    char label[64];
+
+    if (emptyInView < 0)
+        emptyInView = 0;
+    if (emptyInView > count)
+        emptyInView = count;
+    return putText(renderer, label, sprintf(label, ROW_LABEL"Row %d%*c"RESET, number,
+                                            size < 10 ? 10 - (int) size : 1, ' ')) &&
+           putPieces(renderer, EMPTY_PIECE, emptyInView) &&
+           putPieces(renderer, FULL_PIECE, count - emptyInView) &&
+           putText(renderer, BOARD_BG" "RESET, strlen(BOARD_BG" "RESET));
+}
+
+static int fullFrame(Renderer *renderer, const Game *game) {
+    char status[160];
+    int rows = rowsInView(renderer, game), i;
+
+    if (!renderer->terminal) { // Plain text, one row per line
+        for (i = 0; i < game->heapCount; i++)
+            if (!putRow(renderer, game, i + 1, 0, game->sizes[i]) || !putText(renderer, "\n", 1))
+                return 0;
+        return 1;
+    }
+
+    // Clear the screen and draw the board at the top
+    if (!putText(renderer, "\e[r\e[H\e[2J", strlen("\e[r\e[H\e[2J")))
+        return 0;
+    for (i = 0; i < rows; i++)
+        if (!moveCursor(renderer, i + 1, 1) ||
+            !putRow(renderer, game, renderer->firstRow + i + 1, renderer->firstPiece,
+                    piecesInView(renderer, renderer->firstRow + i + 1, game->sizes[renderer->firstRow + i])))
+            return 0;
+    if (boardClipped(renderer, game) &&
+        (!moveCursor(renderer, rows + 1, 1) ||
+         !putText(renderer, status, snprintf(status, sizeof(status), "Rows %d-%d of %d from piece %lld are shown. "
+                                                                     "Enter row 0 to scroll.",
+                                             renderer->firstRow + 1, renderer->firstRow + rows, game->heapCount,
+                                             renderer->firstPiece + 1))))
+        return 0;
+
+    // Let everything printed after the board scroll underneath it, and start it just below the board
+    return putText(renderer, status, sprintf(status, "\e[%d;%dr", rows + 2, renderer->height)) &&
+           moveCursor(renderer, rows + 2, 1);
+}
+
+static int changedFrame(Renderer *renderer, const Game *game) {
+    long long oldEmpty, newEmpty, from, to, count;
+    int rows = rowsInView(renderer, game), row, i;
+
+    if (!putText(renderer, "\e7", 2)) // Save the cursor, which is wherever the text under the board left it
+        return 0;
+    for (i = 0; i < rows; i++) {
+        row = renderer->firstRow + i;
+        oldEmpty = renderer->sizes[row] - renderer->shown[row];
+        newEmpty = game->sizes[row] - game->heaps[row];
+        if (oldEmpty == newEmpty)
+            continue;
+
+        // The pieces between the old and new edge of the empty spaces changed, as far as they are in view
+        count = piecesInView(renderer, row + 1, game->sizes[row]);
+        from = (oldEmpty < newEmpty ? oldEmpty : newEmpty) - renderer->firstPiece;
+        to = (oldEmpty < newEmpty ? newEmpty : oldEmpty) - renderer->firstPiece;
+        if (from < 0)
+            from = 0;
+        if (to > count)
+            to = count;
+        if (from >= to)
+            continue;
+        if (!moveCursor(renderer, i + 1, labelWidth(row + 1, game->sizes[row]) + 2 * from + 1) ||
+            !putPieces(renderer, newEmpty > oldEmpty ? EMPTY_PIECE : FULL_PIECE, to - from))
+            return 0;
+    }
+    return putText(renderer, "\e8", 2);
+}
+
+static int canUpdate(const Renderer *renderer, const Game *game) {
+    int i;
+
+    if (game->heapCount != renderer->heapCount || renderer->firstRow != renderer->shownFirstRow ||
+        renderer->firstPiece != renderer->shownFirstPiece || renderer->width != renderer->shownWidth ||
+        renderer->height != renderer->shownHeight)
+        return 0;
+    for (i = 0; i < game->heapCount; i++)
+        if (game->sizes[i] != renderer->sizes[i])
+            return 0;
+    return 1;
+}
+
+static int remember(Renderer *renderer, const Game *game) {
+    long long *sizes, *shown;
+
+    if (game->heapCount != renderer->heapCount) {
+        sizes = realloc(renderer->sizes, game->heapCount * sizeof(long long));
+        shown = realloc(renderer->shown, game->heapCount * sizeof(long long));
+        if (sizes != NULL)
+            renderer->sizes = sizes;
+        if (shown != NULL)
+            renderer->shown = shown;
+        if (sizes == NULL || shown == NULL)
+            return 0;
+        renderer->heapCount = game->heapCount;
+    }
+    memcpy(renderer->sizes, game->sizes, game->heapCount * sizeof(long long));
+    memcpy(renderer->shown, game->heaps, game->heapCount * sizeof(long long));
+    renderer->shownFirstRow = renderer->firstRow;
+    renderer->shownFirstPiece = renderer->firstPiece;
+    renderer->shownWidth = renderer->width;
+    renderer->shownHeight = renderer->height;
+    return 1;
+}
+
+static int writeFrame(Renderer *renderer) {
+    size_t written = 0;
+    ssize_t result;
+
+    fflush(stdout); // Text printed before the frame has to reach the screen before it
+    while (written < renderer->used) {
+        result = write(STDOUT_FILENO, renderer->buffer + written, renderer->used - written);
+        if (result < 0 && errno == EINTR)
+            continue;
+        if (result <= 0)
+            return 0;
+        written += result;
+    }
+    return 1;
+}
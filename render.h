@@ -0,0 +1,72 @@
+#ifndef NIM_RENDER_H
+#define NIM_RENDER_H
+
+#include <stddef.h>
+#include "game.h"
+
+// Color codes for the board
+#define BOARD_BG "\e[48;5;255m"
+#define EMPTY_PIECE "\e[1;38;2;200;200;240m"
+#define FULL_PIECE "\e[1;38;2;50;50;240m"
+#define RESET "\e[0;1;38;2;255;255;255m"
+#define ROW_LABEL "\e[1;38;5;161m"
+
+/**
+ * Draws the board a whole frame at a time. On a terminal the board stays at the top of the screen, text scrolls
+ * underneath it, and later frames only redraw the pieces that changed. Boards too big for the screen are shown
+ * through a viewport that can be scrolled.
+ */
+typedef struct {
+    int terminal; // 1 if output goes to a terminal, so frames can be updated in place
+    int width, height; // Size of the terminal, in columns and lines
+    int firstRow; // Index of the first row in view (0, 1, 2, ...)
+    long long firstPiece; // Index of the first piece in view in every row
+    int drawn; // 1 once a frame is on the screen that later frames can update
+    int heapCount; // Rows in the frame on the screen
+    long long *sizes; // Size of each row in the frame on the screen
+    long long *shown; // Pieces left in each row in the frame on the screen
+    int shownFirstRow; // Viewport and terminal size of the frame on the screen
+    long long shownFirstPiece;
+    int shownWidth, shownHeight;
+    char *buffer; // The frame being built, written out all at once
+    size_t used, capacity;
+} Renderer;
+
+/**
+ * Set up a renderer for standard output
+ * @param renderer address of the renderer to set up
+ */
+void newRenderer(Renderer *renderer);
+
+/**
+ * Give the terminal back its normal scrolling and release the memory held by a renderer
+ * @param renderer
+ */
+void freeRenderer(Renderer *renderer);
+
+/**
+ * Draw the board with a single write. The first frame, and any frame after the board, the viewport or the
+ * terminal size changed, is drawn in full; other frames only redraw the pieces that were taken since the last one.
+ * @param renderer
+ * @param game
+ * @return 1 if the frame was written, 0 if memory ran out or output failed
+ */
+int drawBoard(Renderer *renderer, const Game *game);
+
+/**
+ * Determine whether part of the board does not fit on the screen
+ * @param renderer
+ * @param game
+ * @return 1 if some rows or pieces are out of view, 0 if the whole board is shown
+ */
+int boardClipped(Renderer *renderer, const Game *game);
+
+/**
+ * Move the viewport; the next frame is drawn in full. Values past the end of the board are pulled back in.
+ * @param renderer
+ * @param firstRow human-friendly index of the row to show at the top (1, 2, 3, ...)
+ * @param firstPiece human-friendly index of the piece to show first in every row (1, 2, 3, ...)
+ */
+void scrollBoard(Renderer *renderer, int firstRow, long long firstPiece);
+
+#endif
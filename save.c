@@ -0,0 +1,303 @@
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "save.h"
+
+#define SAVE_MAGIC "NIMSAV" // Marks a binary save file; text saves always start with E, F, A or B
+#define SAVE_FLAG_PLAYER_B 1 // Set if player B is up next
+#define SAVE_FLAG_MISERE 2 // Set if whoever takes the last piece loses
+#define SAVE_FLAG_ANY_AMOUNT 4 // Set if any number of pieces can be taken
+#define SAVE_FLAG_MULTI_ROW 8 // Set if one move can take from more than one row; the limit follows the amounts
+#define SAVE_FLAG_OCTAL 16 // Set if the amounts are the digits of an octal code after the point instead
+
+/**
+ * The fixed start of a binary save file
+ */
+typedef struct {
+    char magic[6]; // SAVE_MAGIC, without the terminating zero
+    unsigned char version; // SAVE_VERSION when written
+    unsigned char flags; // SAVE_FLAG_* bits
+} SaveHeader;
+
+/**
+ * A board read from a save file, before it replaces the current game
+ */
+typedef struct {
+    int rows; // Number of rows
+    long long *sizes; // Number of pieces each row started with
+    long long *counts; // Number of pieces left in each row
+    int player; // Player who is up next
+    int haveRules; // 1 if the file had rules in it
+    Rules rules; // The rules from the file, if it had them
+} SavedGame;
+
+/**
+ * Read a binary save from memory
+ * @param data the file contents
+ * @param size number of bytes
+ * @param saved address to store the board
+ * @return 1 if the data is a valid save, 0 otherwise
+ */
+static int parseBinary(const unsigned char *data, size_t size, SavedGame *saved);
+
+/**
+ * Read a text save from memory. Each row is a line like "E,F,F." with an E for every empty space and an F for
+ * every piece left, and the last line is "A." or "B." for the player up next.
+ * @param data the file contents
+ * @param size number of bytes
+ * @param saved address to store the board
+ * @return 1 if the data is a valid save, 0 otherwise
+ */
+static int parseText(const unsigned char *data, size_t size, SavedGame *saved);
+
+int writeSave(const Game *game, int player, const char *fileName) {
+    unsigned char *buffer;
+    size_t size;
+    FILE *file;
+    int written;
+
+    buffer = encodeSave(game, player, &size);
+    if (buffer == NULL)
+        return 0;
+
+    file = fopen(fileName, "wb");
+    if (file == NULL) {
+        free(buffer);
+        return 0;
+    }
+    written = fwrite(buffer, 1, size, file) == size;
+    written = fclose(file) == 0 && written;
+    free(buffer);
+    return written;
+}
+
+unsigned char *encodeSave(const Game *game, int player, size_t *size) {
+    const Rules *rules = game->rules;
+    SaveHeader header;
+    unsigned char *buffer, *out;
+    unsigned int sum;
+    int amounts = rules->octal ? rules->moves[rules->moveCount - 1] : rules->moveCount; // Numbers for the rules
+    int i;
+
+    // Every number takes at most MAX_NUMBER_BYTES, so this is always enough room
+    buffer = malloc(sizeof(SaveHeader) + (2 + amounts + 2 * (size_t) game->heapCount) * MAX_NUMBER_BYTES + 4);
+    if (buffer == NULL)
+        return NULL;
+
+    memcpy(header.magic, SAVE_MAGIC, sizeof(header.magic));
+    header.version = SAVE_VERSION;
+    header.flags = (player ? SAVE_FLAG_PLAYER_B : 0) | (rules->misere ? SAVE_FLAG_MISERE : 0) |
+                   (rules->anyAmount ? SAVE_FLAG_ANY_AMOUNT : 0) | (rules->maxRows > 1 ? SAVE_FLAG_MULTI_ROW : 0) |
+                   (rules->octal ? SAVE_FLAG_OCTAL : 0);
+    memcpy(buffer, &header, sizeof(header));
+    out = buffer + sizeof(header);
+
+    out = putNumber(out, (unsigned long long) game->heapCount);
+    out = putNumber(out, rules->anyAmount ? 0 : (unsigned long long) amounts);
+    for (i = 0; !rules->anyAmount && i < amounts; i++) // An octal code's digits start after the point
+        out = putNumber(out, rules->octal ? rules->digits[i + 1] : (unsigned long long) rules->moves[i]);
+    if (rules->maxRows > 1)
+        out = putNumber(out, (unsigned long long) rules->maxRows);
+    for (i = 0; i < game->heapCount; i++) {
+        out = putNumber(out, (unsigned long long) game->sizes[i]);
+        out = putNumber(out, (unsigned long long) game->heaps[i]);
+    }
+
+    sum = checksum(buffer, out - buffer);
+    for (i = 0; i < 4; i++) // Little-endian, so the file reads the same on every machine
+        *out++ = (unsigned char) (sum >> (8 * i));
+    *size = out - buffer;
+    return buffer;
+}
+
+int readSave(Game *game, Rules *rules, int *player, const char *fileName) {
+    struct stat info;
+    void *mapping;
+    size_t size;
+    int file = open(fileName, O_RDONLY), valid;
+
+    if (file < 0)
+        return 0;
+    if (fstat(file, &info) != 0 || info.st_size == 0) {
+        close(file);
+        return 0;
+    }
+    size = info.st_size;
+    mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file); // The mapping stays valid after the file is closed
+    if (mapping == MAP_FAILED)
+        return 0;
+
+    valid = decodeSave(game, rules, player, mapping, size);
+    munmap(mapping, size);
+    return valid;
+}
+
+int decodeSave(Game *game, Rules *rules, int *player, const unsigned char *data, size_t size) {
+    SavedGame saved = {0};
+    int valid, i;
+    Game loaded;
+
+    if (size >= sizeof(SaveHeader) && memcmp(data, SAVE_MAGIC, sizeof(((SaveHeader *) 0)->magic)) == 0)
+        valid = parseBinary(data, size, &saved);
+    else
+        valid = parseText(data, size, &saved);
+
+    // Replace the board and rules only once the whole file has been read. The saved rules decide how much room the
+    // board needs, so the game is pointed at the rules it keeps only afterwards.
+    if (valid && newGame(&loaded, saved.rows, saved.sizes, saved.haveRules ? &saved.rules : rules)) {
+        loaded.rules = rules;
+        for (i = 0; i < loaded.heapCount; i++) // The file also says how many pieces are left in each row
+            removePieces(&loaded, i + 1, saved.sizes[i] - saved.counts[i]);
+        if (saved.haveRules) {
+            freeRules(rules);
+            *rules = saved.rules;
+            saved.haveRules = 0;
+        }
+        freeGame(game);
+        *game = loaded;
+        *player = saved.player;
+    } else {
+        valid = 0;
+    }
+
+    if (saved.haveRules)
+        freeRules(&saved.rules);
+    free(saved.sizes);
+    free(saved.counts);
+    return valid;
+}
+
+unsigned char *putNumber(unsigned char *out, unsigned long long value) {
+    while (value >= 0x80) {
+        *out++ = (unsigned char) (value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (unsigned char) value;
+    return out;
+}
+
+const unsigned char *getNumber(const unsigned char *in, const unsigned char *end, unsigned long long *value) {
+    int shift;
+    *value = 0;
+    for (shift = 0; in < end && shift < 7 * MAX_NUMBER_BYTES; shift += 7) {
+        *value |= (unsigned long long) (*in & 0x7F) << shift;
+        if (!(*in++ & 0x80))
+            return in;
+    }
+    return NULL;
+}
+
+unsigned int checksum(const unsigned char *data, size_t size) {
+    unsigned int sum = 2166136261u;
+    size_t i;
+    for (i = 0; i < size; i++)
+        sum = (sum ^ data[i]) * 16777619u;
+    return sum;
+}
+
+static int parseBinary(const unsigned char *data, size_t size, SavedGame *saved) {
+    const SaveHeader *header = (const SaveHeader *) data;
+    const unsigned char *in = data + sizeof(SaveHeader), *end = data + size - 4;
+    unsigned long long heapCount, moveCount, number, sizeValue, countValue, maxRows = 1;
+    unsigned char digits[MAX_RULE_MOVES + 1] = {0};
+    int moves[MAX_RULE_MOVES];
+    int octal = (header->flags & SAVE_FLAG_OCTAL) != 0;
+    long long largest = 0;
+    unsigned int sum = 0;
+    int i;
+
+    if (header->version < 1 || header->version > SAVE_VERSION || size < sizeof(SaveHeader) + 4)
+        return 0;
+    for (i = 0; i < 4; i++)
+        sum |= (unsigned int) end[i] << (8 * i);
+    if (sum != checksum(data, size - 4)) // Damaged or cut short
+        return 0;
+
+    // Every row takes at least 2 bytes, which caps the row count before anything is allocated
+    if ((in = getNumber(in, end, &heapCount)) == NULL || heapCount < 1 || heapCount > (unsigned long long) (end - in) / 2 ||
+        heapCount > INT_MAX || (in = getNumber(in, end, &moveCount)) == NULL || moveCount > MAX_RULE_MOVES)
+        return 0;
+    for (i = 0; i < (int) moveCount; i++) {
+        if ((in = getNumber(in, end, &number)) == NULL || number < !octal || number > (octal ? 7 : INT_MAX))
+            return 0;
+        moves[i] = (int) number;
+        digits[i + 1] = (unsigned char) number;
+    }
+    if ((header->flags & SAVE_FLAG_MULTI_ROW) &&
+        ((in = getNumber(in, end, &maxRows)) == NULL || !(header->flags & SAVE_FLAG_ANY_AMOUNT) || maxRows < 2 ||
+         maxRows > MAX_MOVE_ROWS))
+        return 0;
+    if (octal && (header->flags & (SAVE_FLAG_ANY_AMOUNT | SAVE_FLAG_MULTI_ROW | SAVE_FLAG_MISERE))) // Normal play only
+        return 0;
+    saved->player = (header->flags & SAVE_FLAG_PLAYER_B) != 0;
+
+    saved->rows = (int) heapCount;
+    saved->sizes = malloc(heapCount * sizeof(long long));
+    saved->counts = malloc(heapCount * sizeof(long long));
+    if (saved->sizes == NULL || saved->counts == NULL)
+        return 0;
+    for (i = 0; i < saved->rows; i++) {
+        if ((in = getNumber(in, end, &sizeValue)) == NULL || (in = getNumber(in, end, &countValue)) == NULL ||
+            sizeValue > LLONG_MAX || countValue > sizeValue)
+            return 0;
+        saved->sizes[i] = (long long) sizeValue;
+        saved->counts[i] = (long long) countValue;
+        if (saved->sizes[i] > largest)
+            largest = saved->sizes[i];
+    }
+    if (in != end) // Anything left over means the file is not what it claims to be
+        return 0;
+
+    // An octal code's values are only computed as far as the biggest row, so the rules come after the rows
+    if (octal) {
+        if (largest > OCTAL_MAX_HEAP || !newOctalDigitRules(&saved->rules, digits, (int) moveCount + 1, largest, NULL))
+            return 0;
+    } else if (header->flags & SAVE_FLAG_ANY_AMOUNT) {
+        newMooreRules(&saved->rules, (int) maxRows); // Plain Nim when maxRows is 1
+    } else if (!newSubtractionRules(&saved->rules, moves, (int) moveCount)) {
+        return 0;
+    }
+    saved->rules.misere = (header->flags & SAVE_FLAG_MISERE) != 0;
+    saved->haveRules = 1;
+    return 1;
+}
+
+static int parseText(const unsigned char *data, size_t size, SavedGame *saved) {
+    const unsigned char *in = data, *end = data + size;
+    long long count, rowSize;
+    size_t i, rows = 0;
+
+    // Every row ends with a period, so counting them gives enough room without growing the arrays
+    for (i = 0; i < size; i++)
+        rows += data[i] == '.';
+    saved->sizes = malloc((rows + 1) * sizeof(long long));
+    saved->counts = malloc((rows + 1) * sizeof(long long));
+    if (saved->sizes == NULL || saved->counts == NULL)
+        return 0;
+
+    // Rows start with a piece; anything else is the player marker at the end of the file
+    while (in < end && (*in == 'E' || *in == 'F')) {
+        count = 0;
+        rowSize = 0;
+        for (; in < end && *in != '.'; in++) { // As long as we do not reach the end marker, which is a period
+            count += *in == 'F'; // If F, the piece is still on the board
+            rowSize += *in == 'E' || *in == 'F'; // Commas only separate items, so they are not counted
+        }
+        if (in < end) // Skip the period, and the newline after it
+            in++;
+        if (in < end && *in == '\n')
+            in++;
+        saved->sizes[saved->rows] = rowSize;
+        saved->counts[saved->rows] = count;
+        saved->rows++;
+    }
+
+    saved->player = in < end && *in == 'B';
+    return saved->rows > 0;
+}
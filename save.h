@@ -0,0 +1,80 @@
+#ifndef NIM_SAVE_H
+#define NIM_SAVE_H
+
+#include "game.h"
+
+#define SAVE_VERSION 3 // Version written into new save files; older versions are still read
+#define MAX_NUMBER_BYTES 10 // Most bytes a 64-bit number takes as a variable-length number
+
+/**
+ * Save a game in the binary format: an 8-byte header (magic, version, player to move and rule flags), then the
+ * number of rows, the allowed amounts (or an octal code's digits), how many rows a move can take from (only if more
+ * than one), and each row's size and pieces left as variable-length numbers, then a 32-bit checksum of everything
+ * before it. The whole file is built in memory and written at once.
+ * @param game
+ * @param player the player who is up next
+ * @param fileName
+ * @return 1 if the game was written successfully, 0 otherwise
+ */
+int writeSave(const Game *game, int player, const char *fileName);
+
+/**
+ * Load a game with a single memory mapping of the file. Binary saves also bring back the rules they were played
+ * under. Text saves from older versions (rows of E and F, then the player) are still read, and keep the current
+ * rules. Nothing is changed unless the whole file is valid.
+ * @param game the game to load the board into; its old board is freed
+ * @param rules the rules the game points to, replaced by the saved rules if the file has them
+ * @param player address to store the player who is up next
+ * @param fileName
+ * @return 1 if the file was read successfully, 0 if it could not be opened or does not contain a valid game
+ */
+int readSave(Game *game, Rules *rules, int *player, const char *fileName);
+
+/**
+ * Build a save in memory, in the format writeSave writes
+ * @param game
+ * @param player the player who is up next
+ * @param size address to store the number of bytes
+ * @return the save, to be freed by the caller, or NULL if memory could not be allocated
+ */
+unsigned char *encodeSave(const Game *game, int player, size_t *size);
+
+/**
+ * Load a game from a save already in memory, in either format readSave reads. Nothing is changed unless the whole
+ * save is valid.
+ * @param game the game to load the board into; its old board is freed
+ * @param rules the rules the game points to, replaced by the saved rules if the save has them
+ * @param player address to store the player who is up next
+ * @param data the save
+ * @param size number of bytes
+ * @return 1 if the data is a valid game, 0 otherwise
+ */
+int decodeSave(Game *game, Rules *rules, int *player, const unsigned char *data, size_t size);
+
+/**
+ * Write a variable-length number: 7 bits at a time, low bits first, with the top bit of each byte set if more
+ * bytes follow. Small numbers take one byte, and none take more than MAX_NUMBER_BYTES.
+ * @param out where to write
+ * @param value
+ * @return the address just past the last byte written
+ */
+unsigned char *putNumber(unsigned char *out, unsigned long long value);
+
+/**
+ * Read a number written by putNumber
+ * @param in where to read
+ * @param end the end of the data
+ * @param value address to store the number
+ * @return the address just past the last byte read, or NULL if the number runs past the end or is too long
+ */
+const unsigned char *getNumber(const unsigned char *in, const unsigned char *end, unsigned long long *value);
+
+/**
+ * Calculate the 32-bit FNV-1a checksum of some data
+ * @param data
+ * @param size number of bytes
+ * @return the checksum
+ */
+unsigned int checksum(const unsigned char *data, size_t size);
+
+#endif
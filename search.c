@@ -0,0 +1,508 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <time.h>
+#include "search.h"
+
+#define SOLVED_DEPTH 0xFFFF // Depth stored for positions whose result is proven, which no search depth can beat
+#define CHECK_INTERVAL 4096 // Positions visited between clock reads
+#define ENTRY_USED (1ULL << 20) // Set in the data word of every entry that has been written
+
+enum {
+    BOUND_EXACT, // The stored score is the score of the position
+    BOUND_LOWER, // The position scores at least the stored score
+    BOUND_UPPER // The position scores at most the stored score
+};
+
+/**
+ * One slot in the transposition table. The three words are written separately, so a reader racing a writer can
+ * see halves of two different positions. The check word is the key XORed with the other two, so a torn slot fails
+ * the check and is treated as a miss instead of a wrong answer.
+ */
+struct TableEntry {
+    _Atomic unsigned long long check; // Zobrist key ^ data ^ move
+    _Atomic unsigned long long data; // Score + 1 in bits 0-1, depth in bits 2-17, bound in bits 18-19, ENTRY_USED
+    _Atomic unsigned long long move; // Best move packed by packMove, or 0 if there is none
+};
+
+/**
+ * The position being searched, changed in place as moves are made and undone
+ */
+typedef struct {
+    Searcher *searcher;
+    long long *heaps; // Number of pieces left in each row
+    int heapCount; // Number of rows
+    unsigned long long key; // Zobrist key of the position: the XOR of zobristKey for every row
+    double deadline; // Time the search has to stop by, or 0 for no limit
+    int aborted; // Set once the deadline passes; every search still running then returns right away
+} Position;
+
+/**
+ * Find the most pieces a row can give up in one move under the variant
+ * @param searcher
+ * @param row index of the row (0, 1, 2, ...)
+ * @return the limit, or LLONG_MAX if the row has none
+ */
+static long long rowLimit(const Searcher *searcher, int row);
+
+/**
+ * Make a move, updating the Zobrist key as each row changes
+ * @param position
+ * @param move
+ */
+static void playMove(Position *position, const Move *move);
+
+/**
+ * Take back a move made with playMove
+ * @param position
+ * @param move
+ */
+static void undoMove(Position *position, const Move *move);
+
+/**
+ * Score a position with alpha-beta negamax. Scores are from the point of view of the player to move: 1 is a proven
+ * win, -1 a proven loss, and 0 means the depth ran out first. Proven scores never change with depth, so they are
+ * stored as solved and reused by every later search.
+ * @param position
+ * @param depth moves left to search
+ * @param alpha the score the player to move is already sure of
+ * @param beta the score the other player is already sure of holding them to
+ * @return the score
+ */
+static int negamax(Position *position, int depth, int alpha, int beta);
+
+/**
+ * Score every move in the root position and pick the best one
+ * @param position
+ * @param depth moves to search
+ * @param best address to store the best move
+ * @return the score of the position
+ */
+static int searchRoot(Position *position, int depth, Move *best);
+
+/**
+ * Look a position up in the transposition table
+ * @param searcher
+ * @param key Zobrist key of the position
+ * @param data address to store the entry's data word
+ * @param move address to store the entry's best move (rows[0] is 0 if there is none)
+ * @return 1 if the position was found, 0 if not
+ */
+static int probeTable(const Searcher *searcher, unsigned long long key, unsigned long long *data, Move *move);
+
+/**
+ * Store a position in the transposition table, replacing whatever was in its slot
+ * @param searcher
+ * @param key Zobrist key of the position
+ * @param score
+ * @param depth how deep the score was searched, or SOLVED_DEPTH if it is proven
+ * @param bound BOUND_EXACT, BOUND_LOWER or BOUND_UPPER
+ * @param move the best move found
+ */
+static void storeTable(const Searcher *searcher, unsigned long long key, int score, int depth, int bound,
+                       const Move *move);
+
+/**
+ * Pack a move into 64 bits: 16 each for the two rows and the two amounts
+ * @param move
+ * @return the packed move, or 0 if a row or amount is too large to fit
+ */
+static unsigned long long packMove(const Move *move);
+
+/**
+ * Unpack a move packed by packMove
+ * @param packed
+ * @param move address to store the move
+ */
+static void unpackMove(unsigned long long packed, Move *move);
+
+/**
+ * Get the Zobrist key for a row holding a number of pieces. Keys are made by scrambling the row and count rather
+ * than read from a table, so rows of any size have one.
+ * @param row index of the row (0, 1, 2, ...)
+ * @param pieces number of pieces in the row
+ * @return the key
+ */
+static unsigned long long zobristKey(int row, long long pieces);
+
+/**
+ * Read the monotonic clock
+ * @return the time in seconds
+ */
+static double now(void);
+
+int newSearcher(Searcher *searcher, const Rules *rules, size_t tableBytes) {
+    size_t entries = 2; // One bucket of two slots at the least
+
+    searcher->rules = rules;
+    searcher->rowLimits = NULL;
+    searcher->rowLimitCount = 0;
+    searcher->forbidden = 0;
+    searcher->maxRowsPerMove = 1;
+    searcher->maxDepth = 1000;
+    searcher->timeLimit = 0;
+    searcher->score = 0;
+    searcher->depthReached = 0;
+    searcher->nodes = 0;
+    searcher->seconds = 0;
+
+    while (entries * 2 * sizeof(struct TableEntry) <= tableBytes)
+        entries *= 2;
+    searcher->table = calloc(entries, sizeof(struct TableEntry));
+    searcher->tableMask = entries - 1;
+    return searcher->table != NULL;
+}
+
+void freeSearcher(Searcher *searcher) {
+    free(searcher->table);
+    searcher->table = NULL;
+    searcher->tableMask = 0;
+}
+
+int searchAllowed(const Searcher *searcher, int chosenRow, long long pieces) {
+    if (pieces < 1 || pieces > rowLimit(searcher, chosenRow - 1))
+        return 0;
+    if (pieces < 64 && (searcher->forbidden >> pieces & 1))
+        return 0;
+    return allowedTake(searcher->rules, pieces);
+}
+
+int searchHasMove(const Searcher *searcher, const long long heaps[], int heapCount) {
+    MoveList list = {1, 0, 0, 0, 0};
+    Move move;
+    return searchNextMove(searcher, heaps, heapCount, &list, &move); // A two-row move needs two one-row moves to exist
+}
+
+int searchMove(Searcher *searcher, const long long heaps[], int heapCount, Move *best) {
+    MoveList list = {1, 0, 0, 0, 0};
+    Position position;
+    Move move;
+    double start = now();
+    long long total = 0;
+    int depth, score, i;
+
+    searcher->score = 0;
+    searcher->depthReached = 0;
+    searcher->nodes = 0;
+    searcher->seconds = 0;
+    if (!searchNextMove(searcher, heaps, heapCount, &list, best)) // Until a search finishes, any legal move will do
+        return 0;
+
+    position.searcher = searcher;
+    position.heapCount = heapCount;
+    position.heaps = malloc(heapCount * sizeof(long long));
+    position.key = 0;
+    position.deadline = searcher->timeLimit > 0 ? start + searcher->timeLimit : 0;
+    position.aborted = 0;
+    if (position.heaps == NULL)
+        return 1;
+    for (i = 0; i < heapCount; i++) {
+        position.heaps[i] = heaps[i];
+        position.key ^= zobristKey(i, heaps[i]);
+    }
+
+    // Every move takes at least one piece, so a search as deep as the pieces on the board always finishes with a
+    // proven answer. Without a time limit, go straight there. With one, search deeper each time, doubling the depth,
+    // so there is a move ready when time runs out. The table keeps the best moves from each search to try first in
+    // the next, and positions proven along the way are never searched again.
+    for (i = 0; i < heapCount; i++)
+        total += heaps[i];
+    for (depth = searcher->timeLimit > 0 ? 1 : searcher->maxDepth;; depth = depth > searcher->maxDepth / 2 ? searcher->maxDepth : depth * 2) {
+        if (depth > total)
+            depth = (int) total;
+        score = searchRoot(&position, depth, &move);
+        if (position.aborted)
+            break;
+        *best = move;
+        searcher->score = score;
+        searcher->depthReached = depth;
+        if (score != 0 || depth >= searcher->maxDepth || depth == total) // Solved, or as deep as allowed
+            break;
+    }
+
+    free(position.heaps);
+    searcher->seconds = now() - start;
+    return 1;
+}
+
+static long long rowLimit(const Searcher *searcher, int row) {
+    return searcher->rowLimits != NULL && row < searcher->rowLimitCount ? searcher->rowLimits[row] : LLONG_MAX;
+}
+
+long long searchNextAmount(const Searcher *searcher, const long long heaps[], int row, long long after) {
+    const Rules *rules = searcher->rules;
+    long long most = heaps[row] < rowLimit(searcher, row) ? heaps[row] : rowLimit(searcher, row);
+    int i;
+
+    if (rules->anyAmount) {
+        for (after++; after < 64 && (searcher->forbidden >> after & 1); after++) {/* none */}
+        return after <= most ? after : 0;
+    }
+    // The amounts are sorted, so the first one past after that is not forbidden is the next
+    for (i = 0; i < rules->moveCount && rules->moves[i] <= most; i++)
+        if (rules->moves[i] > after && !(rules->moves[i] < 64 && (searcher->forbidden >> rules->moves[i] & 1)))
+            return rules->moves[i];
+    return 0;
+}
+
+int searchNextMove(const Searcher *searcher, const long long heaps[], int heapCount, MoveList *list, Move *move) {
+    if (list->rows == 1) {
+        while (list->first < heapCount) {
+            list->firstPieces = searchNextAmount(searcher, heaps, list->first, list->firstPieces);
+            if (list->firstPieces != 0) {
+                move->rows[0] = list->first + 1;
+                move->pieces[0] = list->firstPieces;
+                move->rows[1] = 0;
+                move->pieces[1] = 0;
+                return 1;
+            }
+            list->first++;
+        }
+        if (searcher->maxRowsPerMove < 2)
+            return 0;
+
+        list->rows = 2;
+        list->first = 0;
+        list->firstPieces = heapCount > 0 ? searchNextAmount(searcher, heaps, 0, 0) : 0;
+        list->second = 1;
+        list->secondPieces = 0;
+    }
+
+    // Walk the second row's amounts fastest, then the second row, then the first row's amounts, then the first row
+    while (list->first < heapCount - 1) {
+        if (list->firstPieces == 0) {
+            list->first++;
+            list->firstPieces = searchNextAmount(searcher, heaps, list->first, 0);
+            list->second = list->first + 1;
+            continue;
+        }
+        while (list->second < heapCount) {
+            list->secondPieces = searchNextAmount(searcher, heaps, list->second, list->secondPieces);
+            if (list->secondPieces != 0) {
+                move->rows[0] = list->first + 1;
+                move->pieces[0] = list->firstPieces;
+                move->rows[1] = list->second + 1;
+                move->pieces[1] = list->secondPieces;
+                return 1;
+            }
+            list->second++;
+        }
+        list->firstPieces = searchNextAmount(searcher, heaps, list->first, list->firstPieces);
+        list->second = list->first + 1;
+    }
+    return 0;
+}
+
+static void playMove(Position *position, const Move *move) {
+    int i, row;
+    for (i = 0; i < SEARCH_MAX_ROWS && move->rows[i] != 0; i++) {
+        row = move->rows[i] - 1;
+        position->key ^= zobristKey(row, position->heaps[row]); // XOR the row's old key out and its new key in
+        position->heaps[row] -= move->pieces[i];
+        position->key ^= zobristKey(row, position->heaps[row]);
+    }
+}
+
+static void undoMove(Position *position, const Move *move) {
+    int i, row;
+    for (i = 0; i < SEARCH_MAX_ROWS && move->rows[i] != 0; i++) {
+        row = move->rows[i] - 1;
+        position->key ^= zobristKey(row, position->heaps[row]);
+        position->heaps[row] += move->pieces[i];
+        position->key ^= zobristKey(row, position->heaps[row]);
+    }
+}
+
+static int negamax(Position *position, int depth, int alpha, int beta) {
+    Searcher *searcher = position->searcher;
+    MoveList list = {1, 0, 0, 0, 0};
+    Move move, bestMove, tableMove;
+    unsigned long long data;
+    int score, bestScore = -2, originalAlpha = alpha, tried = 0, entryDepth, bound, i;
+
+    if (++searcher->nodes % CHECK_INTERVAL == 0 && position->deadline != 0 && now() > position->deadline)
+        position->aborted = 1;
+    if (position->aborted)
+        return 0;
+
+    tableMove.rows[0] = 0;
+    if (probeTable(searcher, position->key, &data, &tableMove)) {
+        score = (int) (data & 3) - 1;
+        entryDepth = (int) (data >> 2 & 0xFFFF);
+        bound = (int) (data >> 18 & 3);
+        if (entryDepth >= depth) {
+            if (bound == BOUND_EXACT)
+                return score;
+            if (bound == BOUND_LOWER && score > alpha)
+                alpha = score;
+            if (bound == BOUND_UPPER && score < beta)
+                beta = score;
+            if (alpha >= beta)
+                return score;
+        }
+        // The key could belong to another position that landed on the same value, so check the move fits
+        for (i = 0; i < SEARCH_MAX_ROWS && tableMove.rows[i] != 0; i++)
+            if (tableMove.rows[i] > position->heapCount ||
+                position->heaps[tableMove.rows[i] - 1] < tableMove.pieces[i])
+                tableMove.rows[0] = 0;
+    }
+
+    if (depth == 0) { // Out of depth: the score is unknown unless the game is already over
+        if (searchHasMove(searcher, position->heaps, position->heapCount))
+            return 0;
+        return searcher->rules->misere ? 1 : -1;
+    }
+
+    for (;;) {
+        if (!tried && tableMove.rows[0] != 0) { // The move that was best last time is the most likely to cut off
+            move = tableMove;
+        } else if (!searchNextMove(searcher, position->heaps, position->heapCount, &list, &move)) {
+            break;
+        } else if (tableMove.rows[0] != 0 && move.rows[0] == tableMove.rows[0] &&
+                   move.pieces[0] == tableMove.pieces[0] && move.rows[1] == tableMove.rows[1] &&
+                   move.pieces[1] == tableMove.pieces[1]) {
+            continue; // Already tried first
+        }
+        tried++;
+
+        playMove(position, &move);
+        score = -negamax(position, depth - 1, -beta, -alpha);
+        undoMove(position, &move);
+        if (position->aborted)
+            return 0;
+
+        if (score > bestScore) {
+            bestScore = score;
+            bestMove = move;
+        }
+        if (score > alpha)
+            alpha = score;
+        if (alpha >= beta)
+            break;
+    }
+
+    if (tried == 0) { // No moves: in normal play the player to move has lost, in misère play they have won
+        score = searcher->rules->misere ? 1 : -1;
+        move.rows[0] = 0;
+        storeTable(searcher, position->key, score, SOLVED_DEPTH, BOUND_EXACT, &move);
+        return score;
+    }
+
+    if (bestScore != 0) // A win needs one move to a proven loss, and a loss needs every move to be a proven win
+        storeTable(searcher, position->key, bestScore, SOLVED_DEPTH, BOUND_EXACT, &bestMove);
+    else
+        storeTable(searcher, position->key, bestScore, depth,
+                   bestScore <= originalAlpha ? BOUND_UPPER : bestScore >= beta ? BOUND_LOWER : BOUND_EXACT,
+                   &bestMove);
+    return bestScore;
+}
+
+static int searchRoot(Position *position, int depth, Move *best) {
+    Searcher *searcher = position->searcher;
+    MoveList list = {1, 0, 0, 0, 0};
+    Move move, tableMove;
+    unsigned long long data;
+    int score, bestScore = -2, tried = 0;
+
+    if (!probeTable(searcher, position->key, &data, &tableMove))
+        tableMove.rows[0] = 0;
+
+    for (;;) {
+        if (!tried && tableMove.rows[0] != 0) {
+            move = tableMove;
+        } else if (!searchNextMove(searcher, position->heaps, position->heapCount, &list, &move)) {
+            break;
+        } else if (tableMove.rows[0] != 0 && move.rows[0] == tableMove.rows[0] &&
+                   move.pieces[0] == tableMove.pieces[0] && move.rows[1] == tableMove.rows[1] &&
+                   move.pieces[1] == tableMove.pieces[1]) {
+            continue;
+        }
+        tried++;
+
+        playMove(position, &move);
+        score = -negamax(position, depth - 1, -1, bestScore > -1 ? -bestScore : 1);
+        undoMove(position, &move);
+        if (position->aborted)
+            return 0;
+
+        if (score > bestScore) {
+            bestScore = score;
+            *best = move;
+        }
+        if (bestScore == 1) // Nothing beats a proven win
+            break;
+    }
+
+    storeTable(searcher, position->key, bestScore, bestScore != 0 ? SOLVED_DEPTH : depth, BOUND_EXACT, best);
+    return bestScore;
+}
+
+static int probeTable(const Searcher *searcher, unsigned long long key, unsigned long long *data, Move *move) {
+    const struct TableEntry *entry = &searcher->table[key & searcher->tableMask & ~1ULL];
+    unsigned long long check, packed;
+    int i;
+
+    for (i = 0; i < 2; i++, entry++) {
+        check = atomic_load_explicit(&entry->check, memory_order_relaxed);
+        *data = atomic_load_explicit(&entry->data, memory_order_relaxed);
+        packed = atomic_load_explicit(&entry->move, memory_order_relaxed);
+        if ((check ^ *data ^ packed) == key && (*data & ENTRY_USED)) {
+            unpackMove(packed, move);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void storeTable(const Searcher *searcher, unsigned long long key, int score, int depth, int bound,
+                       const Move *move) {
+    struct TableEntry *entry = &searcher->table[key & searcher->tableMask & ~1ULL];
+    unsigned long long data = (unsigned long long) (score + 1) | (unsigned long long) depth << 2 |
+                              (unsigned long long) bound << 18 | ENTRY_USED;
+    unsigned long long packed = packMove(move);
+    unsigned long long oldData = atomic_load_explicit(&entry->data, memory_order_relaxed);
+    unsigned long long oldKey = atomic_load_explicit(&entry->check, memory_order_relaxed) ^ oldData ^
+                                atomic_load_explicit(&entry->move, memory_order_relaxed);
+
+    // Each key has two slots. The first keeps whichever position was searched deepest, so solved positions stay
+    // put; everything else goes in the second, which always takes the newest position.
+    if (oldKey != key && (int) (oldData >> 2 & 0xFFFF) > depth)
+        entry++;
+    atomic_store_explicit(&entry->check, key ^ data ^ packed, memory_order_relaxed);
+    atomic_store_explicit(&entry->data, data, memory_order_relaxed);
+    atomic_store_explicit(&entry->move, packed, memory_order_relaxed);
+}
+
+static unsigned long long packMove(const Move *move) {
+    unsigned long long packed = 0;
+    int i;
+    for (i = 0; i < SEARCH_MAX_ROWS && move->rows[i] != 0; i++) {
+        if (move->rows[i] > 0xFFFF || move->pieces[i] > 0xFFFF)
+            return 0;
+        packed |= ((unsigned long long) move->rows[i] | (unsigned long long) move->pieces[i] << 16) << (32 * i);
+    }
+    return packed;
+}
+
+static void unpackMove(unsigned long long packed, Move *move) {
+    int i;
+    for (i = 0; i < SEARCH_MAX_ROWS; i++) {
+        move->rows[i] = (int) (packed >> (32 * i) & 0xFFFF);
+        move->pieces[i] = (long long) (packed >> (32 * i + 16) & 0xFFFF);
+    }
+}
+
+static unsigned long long zobristKey(int row, long long pieces) {
+    unsigned long long z = ((unsigned long long) row << 48 ^ (unsigned long long) pieces) + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL; // splitmix64's scrambler, as in nextRandom in game.c
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static double now(void) {
+    struct timespec spec;
+    clock_gettime(CLOCK_MONOTONIC, &spec);
+    return spec.tv_sec + spec.tv_nsec / 1e9;
+}
@@ -0,0 +1,121 @@
+#ifndef NIM_SEARCH_H
+#define NIM_SEARCH_H
+
+#include <stddef.h>
+#include "grundy.h"
+
+#define SEARCH_MAX_ROWS 2 // The most rows a searched move can take from
+
+/**
+ * A move that takes pieces from one or more rows at once
+ */
+typedef struct {
+    int rows[SEARCH_MAX_ROWS]; // Rows taken from (1, 2, 3, ...); unused entries are 0
+    long long pieces[SEARCH_MAX_ROWS]; // Pieces taken from each of those rows
+} Move;
+
+/**
+ * Where the move generator is in its walk through a position's moves: one-row moves first, then two-row moves.
+ * A walk starts from {1, 0, 0, 0, 0}.
+ */
+typedef struct {
+    int rows; // How many rows the moves being walked take from
+    int first, second; // Rows being taken from (0, 1, 2, ...)
+    long long firstPieces, secondPieces; // Amounts last taken from them, or 0 to start over with the smallest
+} MoveList;
+
+struct TableEntry;
+
+/**
+ * A game-tree solver for rule variants that have no closed-form strategy. On top of the amounts allowed by the
+ * rules, a variant can cap how many pieces each row gives up per move, forbid some amounts outright, and allow a
+ * move to take from two rows at once. Positions are remembered in a fixed-size transposition table keyed by
+ * Zobrist hashes. The table is read and written without locks, so threads can each search with their own copy of
+ * a searcher and share what the others learn (only the original should be freed).
+ */
+typedef struct {
+    const Rules *rules; // Amounts that can be taken from a row, and whether taking the last piece wins
+    const long long *rowLimits; // Most pieces each row can give up in one move, or NULL for no limits
+    int rowLimitCount; // Number of rows with a limit; rows past these have none
+    unsigned long long forbidden; // Bit n is set if taking exactly n pieces from a row is not allowed (n < 64)
+    int maxRowsPerMove; // How many rows one move can take from: 1 or 2
+    int maxDepth; // Deepest the search goes, in moves
+    double timeLimit; // Seconds a search may take, or 0 for no limit
+
+    struct TableEntry *table; // The transposition table
+    unsigned long long tableMask; // Number of table slots minus 1 (the count is a power of 2, in buckets of 2)
+
+    // Results of the last search
+    int score; // 1 if the player to move wins, -1 if they lose, 0 if the search ran out of depth or time first
+    int depthReached; // Deepest search that finished
+    long long nodes; // Positions visited
+    double seconds; // Time taken
+} Searcher;
+
+/**
+ * Set up a searcher with no extra restrictions, a depth limit of 1000 moves, and no time limit
+ * @param searcher address of the searcher to set up
+ * @param rules the rules to search under
+ * @param tableBytes memory to give the transposition table; rounded down to a power of 2 slots
+ * @return 1 if successful, 0 if memory could not be allocated
+ */
+int newSearcher(Searcher *searcher, const Rules *rules, size_t tableBytes);
+
+/**
+ * Release the memory held by a searcher
+ * @param searcher
+ */
+void freeSearcher(Searcher *searcher);
+
+/**
+ * Determine whether the variant allows taking the given number of pieces from a row (ignoring how many are left)
+ * @param searcher
+ * @param chosenRow human-friendly index of the row (1, 2, 3, ...)
+ * @param pieces
+ * @return 1 if the amount is allowed, 0 if not
+ */
+int searchAllowed(const Searcher *searcher, int chosenRow, long long pieces);
+
+/**
+ * Determine whether the player to move has any move at all
+ * @param searcher
+ * @param heaps number of pieces left in each row
+ * @param heapCount number of rows
+ * @return 1 if there is a legal move, 0 if the game is over
+ */
+int searchHasMove(const Searcher *searcher, const long long heaps[], int heapCount);
+
+/**
+ * Find the next amount that can be taken from a row
+ * @param searcher
+ * @param heaps number of pieces left in each row
+ * @param row index of the row (0, 1, 2, ...)
+ * @param after the amount last tried, or 0 to get the smallest
+ * @return the smallest legal amount greater than after, or 0 if there is none
+ */
+long long searchNextAmount(const Searcher *searcher, const long long heaps[], int row, long long after);
+
+/**
+ * Get the next move in a position. Only the variant's restrictions and rules are used, so a searcher set up without
+ * a table can walk moves too.
+ * @param searcher
+ * @param heaps number of pieces left in each row
+ * @param heapCount number of rows
+ * @param list the generator state, which starts out all zero except rows = 1
+ * @param move address to store the move
+ * @return 1 if there was another move, 0 if every move has been given out
+ */
+int searchNextMove(const Searcher *searcher, const long long heaps[], int heapCount, MoveList *list, Move *move);
+
+/**
+ * Search for the best move with iterative deepening and alpha-beta negamax. Each deeper search starts from what
+ * the table learned in the last one, and the search stops early once the position is solved.
+ * @param searcher
+ * @param heaps number of pieces left in each row
+ * @param heapCount number of rows
+ * @param best address to store the best move found
+ * @return 1 if a move was found, 0 if there are no legal moves
+ */
+int searchMove(Searcher *searcher, const long long heaps[], int heapCount, Move *best);
+
+#endif
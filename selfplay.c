@@ -0,0 +1,273 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "game.h"
+
+#define MAX_THREADS 256
+
+/**
+ * The work given to one thread and the results it reports back
+ */
+typedef struct {
+    const Rules *rules; // Rules every game is played by
+    const long long *sizes; // Starting size of each row
+    int heapCount; // Number of rows
+    int againstRandom; // 1 if the AI plays against random moves, 0 if it plays against itself
+    const Searcher *variant; // Variant to search under, copied by each thread, or NULL to use the Grundy AI
+    long long games; // Number of games this thread plays
+    unsigned long long seed; // Random number generator state owned by this thread
+    int failed; // Set if the thread could not allocate its board
+
+    long long moves; // Total moves made over every game
+    long long firstPlayerWins; // Games won by whoever moved first
+    long long aiFirstGames, aiFirstWins; // Games where the AI moved first, and how many it won
+    long long aiSecondGames, aiSecondWins; // Games where the AI moved second, and how many it won
+    long long searches, nodes; // AI moves searched under the variant, and positions visited doing it
+    double searchSeconds, slowestSearch; // Time spent searching in total, and on the slowest move
+} Worker;
+
+/**
+ * Play a batch of games without any terminal input or output
+ * @param arg address of the Worker describing the batch
+ * @return NULL
+ */
+static void *playGames(void *arg);
+
+/**
+ * Read the monotonic clock
+ * @return the time in seconds
+ */
+static double now(void);
+
+int main(int argc, char *argv[]) {
+    long long sizes[4096] = {3, 5, 7}; // The standard board unless another one is given
+    long long limits[4096], forbidden[64];
+    int heapCount = 3, limitCount = 0, forbiddenCount = 0, search = 0, i, option;
+    int threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    int againstRandom = 1;
+    int normalPlay = 0;
+    long long games = 1000000;
+    unsigned long long seed = (unsigned long long) time(NULL);
+    const char *ruleText = "1,2,3";
+    pthread_t ids[MAX_THREADS];
+    Worker workers[MAX_THREADS];
+    Worker total = {0};
+    Rules rules;
+    Searcher variant;
+    double start, elapsed, megabytes = 16, timeLimit = 0;
+
+    while ((option = getopt(argc, argv, "g:t:b:r:s:anl:f:Sm:T:")) != -1) {
+        switch (option) {
+            case 'g':
+                games = atoll(optarg);
+                break;
+            case 't':
+                threads = atoi(optarg);
+                break;
+            case 'b':
+                heapCount = parseList(optarg, sizes, sizeof(sizes) / sizeof(sizes[0]));
+                break;
+            case 'r':
+                ruleText = optarg;
+                break;
+            case 's':
+                seed = strtoull(optarg, NULL, 10);
+                break;
+            case 'a':
+                againstRandom = 0;
+                break;
+            case 'n':
+                normalPlay = 1;
+                break;
+            case 'l':
+                limitCount = parseList(optarg, limits, sizeof(limits) / sizeof(limits[0]));
+                search = 1;
+                break;
+            case 'f':
+                forbiddenCount = parseList(optarg, forbidden, sizeof(forbidden) / sizeof(forbidden[0]));
+                search = 1;
+                break;
+            case 'S':
+                search = 1;
+                break;
+            case 'm':
+                megabytes = atof(optarg);
+                break;
+            case 'T':
+                timeLimit = atof(optarg) / 1000;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-g games] [-t threads] [-b 3,5,7] [-r 1,2,3|any] [-s seed] [-a] [-n]\n"
+                                "       [-l 3,2,1] [-f 2,5] [-S] [-m megabytes] [-T milliseconds]\n"
+                                "  -a  AI plays against itself instead of against random moves\n"
+                                "  -n  normal play: whoever takes the last piece wins (default: they lose)\n"
+                                "  -l  most pieces each row can give up in one move (searched)\n"
+                                "  -f  amounts that can never be taken, below 64 (searched)\n"
+                                "  -S  search even without -l or -f, to check the search against the Grundy AI\n"
+                                "  -m  transposition table size, shared by every thread\n"
+                                "  -T  time limit per searched move\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (!parseRules(&rules, ruleText)) {
+        fprintf(stderr, "Invalid rules: %s (1 must be one of the amounts)\n", ruleText);
+        return 1;
+    }
+    rules.misere = !normalPlay;
+    if (heapCount == 0 || games < 1) {
+        fprintf(stderr, "The board and the number of games must not be empty\n");
+        return 1;
+    }
+    if (search) {
+        if (!newSearcher(&variant, &rules, (size_t) (megabytes * 1024 * 1024))) {
+            fprintf(stderr, "Not enough memory for the transposition table\n");
+            return 1;
+        }
+        variant.rowLimits = limits;
+        variant.rowLimitCount = limitCount;
+        for (i = 0; i < forbiddenCount; i++)
+            if (forbidden[i] < 64)
+                variant.forbidden |= 1ULL << forbidden[i];
+        variant.timeLimit = timeLimit;
+    }
+    if (threads < 1)
+        threads = 1;
+    if (threads > MAX_THREADS)
+        threads = MAX_THREADS;
+
+    // Split the games evenly, giving the leftovers to the first few threads
+    for (i = 0; i < threads; i++) {
+        memset(&workers[i], 0, sizeof(Worker));
+        workers[i].rules = &rules;
+        workers[i].sizes = sizes;
+        workers[i].heapCount = heapCount;
+        workers[i].againstRandom = againstRandom;
+        workers[i].variant = search ? &variant : NULL;
+        workers[i].games = games / threads + (i < games % threads);
+        workers[i].seed = seed + i * 0x9E3779B97F4A7C15ULL; // nextRandom scrambles these into unrelated streams
+    }
+
+    start = now();
+    for (i = 0; i < threads; i++)
+        pthread_create(&ids[i], NULL, playGames, &workers[i]);
+    for (i = 0; i < threads; i++) {
+        pthread_join(ids[i], NULL);
+        if (workers[i].failed) {
+            fprintf(stderr, "Not enough memory for thread %d\n", i);
+            return 1;
+        }
+        total.games += workers[i].games;
+        total.moves += workers[i].moves;
+        total.firstPlayerWins += workers[i].firstPlayerWins;
+        total.aiFirstGames += workers[i].aiFirstGames;
+        total.aiFirstWins += workers[i].aiFirstWins;
+        total.aiSecondGames += workers[i].aiSecondGames;
+        total.aiSecondWins += workers[i].aiSecondWins;
+        total.searches += workers[i].searches;
+        total.nodes += workers[i].nodes;
+        total.searchSeconds += workers[i].searchSeconds;
+        if (workers[i].slowestSearch > total.slowestSearch)
+            total.slowestSearch = workers[i].slowestSearch;
+    }
+    elapsed = now() - start;
+
+    printf("threads: %d\n", threads);
+    printf("games: %lld\n", total.games);
+    printf("moves: %lld\n", total.moves);
+    printf("seconds: %.3f\n", elapsed);
+    printf("games/sec: %.0f\n", total.games / elapsed);
+    printf("moves/sec: %.0f\n", total.moves / elapsed);
+    printf("first player win rate: %.4f\n", (double) total.firstPlayerWins / total.games);
+    printf("second player win rate: %.4f\n", 1.0 - (double) total.firstPlayerWins / total.games);
+    if (againstRandom) {
+        printf("AI win rate moving first: %.4f\n", total.aiFirstGames ? (double) total.aiFirstWins / total.aiFirstGames : 0.0);
+        printf("AI win rate moving second: %.4f\n", total.aiSecondGames ? (double) total.aiSecondWins / total.aiSecondGames : 0.0);
+    }
+
+    if (search) {
+        printf("searches: %lld\n", total.searches);
+        printf("average search ms: %.3f\n", total.searches ? total.searchSeconds * 1000 / total.searches : 0.0);
+        printf("slowest search ms: %.3f\n", total.slowestSearch * 1000);
+        printf("average nodes per search: %.0f\n", total.searches ? (double) total.nodes / total.searches : 0.0);
+        freeSearcher(&variant);
+    }
+    freeRules(&rules);
+    return 0;
+}
+
+static void *playGames(void *arg) {
+    Worker *worker = arg;
+    Game game;
+    Searcher searcher;
+    long long g, moves = 0, firstPlayerWins = 0, aiFirstWins = 0, aiSecondWins = 0, searches = 0, nodes = 0;
+    double searchSeconds = 0, slowestSearch = 0;
+    unsigned long long seed = worker->seed; // Kept on this thread's stack so other threads never touch it
+    int player, aiPlayer, chosenRow, winner;
+    long long pieces;
+
+    if (!newGame(&game, worker->heapCount, worker->sizes, worker->rules)) {
+        worker->failed = 1;
+        return NULL;
+    }
+    if (worker->variant != NULL) { // A copy of its own for the statistics, sharing the lock-free table
+        searcher = *worker->variant;
+        game.searcher = &searcher;
+    }
+
+    for (g = 0; g < worker->games; g++) {
+        resetGame(&game); // Reuse the same board so the only allocation is the one above
+        player = 0;
+        aiPlayer = g % 2; // Alternate who moves first so both sides get measured
+
+        while (!gameWon(&game)) {
+            if (!worker->againstRandom || player == aiPlayer) {
+                getAIMove(&game, &chosenRow, &pieces);
+                if (game.searcher != NULL) {
+                    searches++;
+                    nodes += searcher.nodes;
+                    searchSeconds += searcher.seconds;
+                    if (searcher.seconds > slowestSearch)
+                        slowestSearch = searcher.seconds;
+                }
+            } else
+                randomMove(&game, &seed, &chosenRow, &pieces);
+            removePieces(&game, chosenRow, pieces);
+            moves++;
+            player = !player;
+        }
+
+        // The turn has already passed to whoever did not take the last piece
+        winner = gameWinner(&game, player);
+        firstPlayerWins += winner == 0;
+        if (aiPlayer == 0)
+            aiFirstWins += winner == aiPlayer;
+        else
+            aiSecondWins += winner == aiPlayer;
+    }
+
+    // Only write the shared results once, at the end, so threads never fight over the same cache lines
+    worker->moves = moves;
+    worker->firstPlayerWins = firstPlayerWins;
+    worker->aiFirstGames = (worker->games + 1) / 2;
+    worker->aiFirstWins = aiFirstWins;
+    worker->aiSecondGames = worker->games / 2;
+    worker->aiSecondWins = aiSecondWins;
+    worker->searches = searches;
+    worker->nodes = nodes;
+    worker->searchSeconds = searchSeconds;
+    worker->slowestSearch = slowestSearch;
+    freeGame(&game);
+    return NULL;
+}
+
+static double now(void) {
+    struct timespec spec;
+    clock_gettime(CLOCK_MONOTONIC, &spec);
+    return spec.tv_sec + spec.tv_nsec / 1e9;
+}
@@ -0,0 +1,788 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "game.h"
+#include "save.h"
+#include "stats.h"
+
+#define SOCKET_FILE "nim.sock" // Where the server listens unless another path is given
+#define MAX_EVENTS 256 // Most events handled per call to epoll_wait
+#define LINE_SIZE 4096 // Longest command a client can send, counting the newline
+#define MAX_ROWS 256 // Most rows a game started over the socket can have
+#define MAX_NAME 64 // Longest save file name a client can use
+#define MOVE_TEXT_SIZE (MAX_MOVE_ROWS * 33 + 24) // Longest turn in decimal: every row and amount, then the split
+#define REPLY_SIZE (MAX_ROWS * 21 + MOVE_TEXT_SIZE + 64) // Longest reply: a turn, every row's count and the words
+#define MAX_PENDING_OUTPUT (1 << 20) // Clients that stop reading are dropped once this much output waits for them
+
+/**
+ * One client connection and the game it is playing
+ */
+typedef struct Session {
+    int fd;
+    Game game; // The board; only valid if haveGame is set
+    Rules rules; // The rules the game is played by, owned by the session
+    int haveGame; // 1 once the client has started or loaded a game
+    int player; // Player who is up next (0 = A, 1 = B)
+    char input[LINE_SIZE]; // Bytes received that are not a whole command yet
+    size_t inputUsed;
+    char *output; // Replies the socket has not taken yet start at output + outputSent and end at output + outputUsed
+    size_t outputUsed, outputSent, outputCapacity;
+    int writing; // 1 while waiting for the socket to take more output
+    struct Session *previous, *next; // Every open session is in one list so they can be closed on shutdown
+} Session;
+
+/**
+ * State shared by every session: the event loop, the tablebase and the counters STATS reports
+ */
+typedef struct {
+    int epoll;
+    int spare; // Descriptor kept open to give up when they run out, so a waiting connection can be taken and dropped
+    const Tablebase *tablebase; // Solved positions used for any game with matching rules, or NULL
+    Session *sessions; // First open session
+    long long accepted, open, moves;
+    double started; // When the server started listening
+    Histogram latency; // Time from reading a MOVE or AI command to having its reply ready
+} Server;
+
+/**
+ * One simulated client in load mode
+ */
+typedef struct {
+    int fd;
+    char input[REPLY_SIZE]; // Bytes received that are not a whole reply yet
+    size_t inputUsed;
+    long long sentAt; // When the command now waiting for a reply was sent, in nanoseconds
+} Client;
+
+static volatile sig_atomic_t stopping; // Set by SIGINT or SIGTERM to shut the server down cleanly
+
+/**
+ * Create a listening socket
+ * @param path file name of the socket; any old socket file there is removed first
+ * @return the socket, or -1 if it could not be created
+ */
+static int listenOn(const char *path);
+
+/**
+ * Serve clients until SIGINT or SIGTERM, then print the statistics
+ * @param path file name of the socket
+ * @param tablebase solved positions to use for games with matching rules, or NULL
+ * @return 1 if the server ran and shut down cleanly, 0 if it could not start
+ */
+static int runServer(const char *path, const Tablebase *tablebase);
+
+/**
+ * Set up a session for a newly accepted connection and add it to the event loop
+ * @param server
+ * @param fd the connection
+ * @return 1 if successful, 0 if memory ran out (the connection is closed)
+ */
+static int openSession(Server *server, int fd);
+
+/**
+ * Close a connection and free its session
+ * @param server
+ * @param session
+ */
+static void closeSession(Server *server, Session *session);
+
+/**
+ * Read whatever a client has sent and run every whole command in it
+ * @param server
+ * @param session
+ * @return 1 if the session is still open, 0 if it should be closed
+ */
+static int readSession(Server *server, Session *session);
+
+/**
+ * Run one command and queue its reply
+ * @param server
+ * @param session
+ * @param line the command, without its newline
+ * @return 1 to keep reading commands, 0 if the client asked to quit
+ */
+static int runCommand(Server *server, Session *session, char *line);
+
+/**
+ * Start a new game for a session from the arguments of a NEW command
+ * @param server
+ * @param session
+ * @param ruleText the amounts that can be taken, like "1,2,3" or "any"
+ * @param mode "misere" or "normal"
+ * @param rowText the starting rows, like "3,5,7"
+ * @return 1 if the game was started, 0 if an argument is invalid or memory ran out
+ */
+static int startGame(Server *server, Session *session, const char *ruleText, const char *mode, const char *rowText);
+
+/**
+ * Read the turn in a MOVE command: "MOVE row pieces", with more row and pieces pairs under Moore's Nim_k, or the
+ * pieces to leave to the left of the ones taken after them under an octal code
+ * @param game the game the turn is for
+ * @param line the command
+ * @param turn address to store the turn
+ * @return 1 if the command is a well-formed turn with rows on the board, 0 if not; legalTurn decides the rest
+ */
+static int parseMove(const Game *game, const char *line, Turn *turn);
+
+/**
+ * Make a move in a session's game and describe the result: "MOVED row pieces player rows..." or, if the move ends
+ * the game, "OVER row pieces winner". A turn from several rows lists each row and its pieces, and under an octal
+ * code the pieces left to the left of the ones taken follow the pieces.
+ * @param server
+ * @param session
+ * @param turn the move
+ * @param reply where to write the reply, at least REPLY_SIZE bytes
+ * @return length of the reply
+ */
+static int makeMove(Server *server, Session *session, const Turn *turn, char *reply);
+
+/**
+ * Describe a session's board after a heading: "heading player rows..."
+ * @param session
+ * @param heading the start of the reply, such as "BOARD"
+ * @param reply where to write the reply, at least REPLY_SIZE bytes
+ * @return length of the reply
+ */
+static int describeBoard(const Session *session, const char *heading, char *reply);
+
+/**
+ * Check that a save file name is a plain name in the server's directory, so clients cannot write elsewhere
+ * @param name
+ * @return 1 if the name is allowed, 0 if not
+ */
+static int validName(const char *name);
+
+/**
+ * Add a line to a session's output
+ * @param session
+ * @param text the line, without its newline
+ * @param length
+ * @return 1 if successful, 0 if memory ran out or the client is too far behind
+ */
+static int queueReply(Session *session, const char *text, size_t length);
+
+/**
+ * Send as much queued output as the socket takes, and watch for room for the rest
+ * @param server
+ * @param session
+ * @return 1 if the session is still open, 0 if it should be closed
+ */
+static int flushSession(Server *server, Session *session);
+
+/**
+ * Simulate clients that each play whole games of AI moves against the server, one connection per game
+ * @param path file name of the server's socket
+ * @param clients number of connections open at once
+ * @param games number of games to play in total
+ * @param newCommand the NEW command each game starts with, including the newline
+ * @return 1 if every game finished, 0 otherwise
+ */
+static int runLoad(const char *path, int clients, long long games, const char *newCommand);
+
+/**
+ * Connect a simulated client and send the command that starts its game
+ * @param epoll
+ * @param client
+ * @param path file name of the server's socket
+ * @param newCommand
+ * @return 1 if successful, 0 if the server could not be reached
+ */
+static int startClient(int epoll, Client *client, const char *path, const char *newCommand);
+
+/**
+ * Send a whole command from a simulated client and note when it went out
+ * @param client
+ * @param text
+ * @return 1 if successful, 0 if the connection failed
+ */
+static int sendCommand(Client *client, const char *text);
+
+/**
+ * Ask the server loop to stop
+ * @param number the signal received
+ */
+static void stopServer(int number);
+
+/**
+ * Raise the limit on open descriptors as far as the system lets this process, since every session or client holds
+ * one
+ */
+static void raiseFileLimit(void);
+
+int main(int argc, char *argv[]) {
+    const char *path = SOCKET_FILE, *tablebaseFile = NULL, *ruleText = "1,2,3", *rowText = "3,5,7";
+    char newCommand[LINE_SIZE];
+    long long games = 10000;
+    int clients = 0, normalPlay = 0, option, ran;
+    Tablebase tablebase;
+
+    while ((option = getopt(argc, argv, "s:T:L:g:b:r:n")) != -1) {
+        switch (option) {
+            case 's':
+                path = optarg;
+                break;
+            case 'T':
+                tablebaseFile = optarg;
+                break;
+            case 'L':
+                clients = atoi(optarg);
+                break;
+            case 'g':
+                games = atoll(optarg);
+                break;
+            case 'b':
+                rowText = optarg;
+                break;
+            case 'r':
+                ruleText = optarg;
+                break;
+            case 'n':
+                normalPlay = 1;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-s nim.sock] [-T nim.tb]\n"
+                                "       %s -L clients [-s nim.sock] [-g games] [-b 3,5,7] [-r 1,2,3|any] [-n]\n"
+                                "Serves games over a Unix domain socket, one game per connection. Commands, one per line:\n"
+                                "  NEW 1,2,3|any misere|normal 3,5,7   MOVE row pieces [row pieces...|left]   AI   SHOW\n"
+                                "  SAVE name   LOAD name   STATS   QUIT\n"
+                                "  -T  look positions up in a tablebase for games with the same rules\n"
+                                "  -L  instead of serving, connect that many clients at once to a running server and\n"
+                                "      play games of AI moves to measure connections per second and move latency\n",
+                        argv[0], argv[0]);
+                return 1;
+        }
+    }
+
+    raiseFileLimit();
+    if (clients > 0) {
+        if (games < 1 || strlen(ruleText) + strlen(rowText) + 16 > sizeof(newCommand)) {
+            fprintf(stderr, "Invalid load settings\n");
+            return 1;
+        }
+        sprintf(newCommand, "NEW %s %s %s\n", ruleText, normalPlay ? "normal" : "misere", rowText);
+        return !runLoad(path, clients, games, newCommand);
+    }
+
+    if (tablebaseFile != NULL && !openTablebase(&tablebase, tablebaseFile)) {
+        fprintf(stderr, "%s is not a tablebase\n", tablebaseFile);
+        return 1;
+    }
+    ran = runServer(path, tablebaseFile != NULL ? &tablebase : NULL);
+    if (tablebaseFile != NULL)
+        closeTablebase(&tablebase);
+    return !ran;
+}
+
+static int listenOn(const char *path) {
+    struct sockaddr_un address;
+    int fd;
+
+    if (strlen(path) >= sizeof(address.sun_path))
+        return -1;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    unlink(path); // A socket file left behind by a server that was killed would block the bind
+    if (bind(fd, (struct sockaddr *) &address, sizeof(address)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int runServer(const char *path, const Tablebase *tablebase) {
+    struct epoll_event events[MAX_EVENTS], event;
+    struct sigaction action;
+    Server server = {0};
+    Session *session;
+    double seconds;
+    int listener, count, fd, i;
+
+    listener = listenOn(path);
+    server.epoll = epoll_create1(EPOLL_CLOEXEC);
+    server.spare = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (listener < 0 || server.epoll < 0 || server.spare < 0) {
+        fprintf(stderr, "Cannot listen on %s\n", path);
+        return 0;
+    }
+    server.tablebase = tablebase;
+    server.started = nanoseconds() / 1e9;
+
+    event.events = EPOLLIN;
+    event.data.ptr = NULL; // The listener is the only entry without a session
+    epoll_ctl(server.epoll, EPOLL_CTL_ADD, listener, &event);
+
+    // No SA_RESTART, so a signal wakes epoll_wait up and the loop sees stopping
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stopServer;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    fprintf(stderr, "Listening on %s\n", path);
+
+    while (!stopping) {
+        count = epoll_wait(server.epoll, events, MAX_EVENTS, -1);
+        for (i = 0; i < count; i++) {
+            session = events[i].data.ptr;
+            if (session == NULL) { // Take every waiting connection at once
+                while ((fd = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+                    openSession(&server, fd);
+                // The listener stays ready while connections wait, so with no descriptor left to take one, epoll_wait
+                // would return at once forever. Give up the spare to take the first one and drop it.
+                if (errno == EMFILE || errno == ENFILE) {
+                    close(server.spare);
+                    fd = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+                    if (fd >= 0)
+                        close(fd);
+                    server.spare = open("/dev/null", O_RDONLY | O_CLOEXEC);
+                }
+                continue;
+            }
+            if (events[i].events & (EPOLLERR | EPOLLHUP) && !(events[i].events & EPOLLIN)) {
+                closeSession(&server, session);
+                continue;
+            }
+            if ((events[i].events & EPOLLOUT && !flushSession(&server, session)) ||
+                (events[i].events & EPOLLIN && !readSession(&server, session)))
+                closeSession(&server, session);
+        }
+    }
+
+    seconds = nanoseconds() / 1e9 - server.started;
+    fprintf(stderr, "%lld connections in %.1f s (%.1f per second), %lld moves, move latency p50 %.1f us, p99 %.1f us\n",
+            server.accepted, seconds, server.accepted / seconds, server.moves, percentile(&server.latency, 0.5),
+            percentile(&server.latency, 0.99));
+    while (server.sessions != NULL)
+        closeSession(&server, server.sessions);
+    close(listener);
+    close(server.epoll);
+    close(server.spare);
+    unlink(path);
+    return 1;
+}
+
+static int openSession(Server *server, int fd) {
+    struct epoll_event event;
+    Session *session = calloc(1, sizeof(Session));
+
+    if (session == NULL || !parseRules(&session->rules, "1,2,3")) { // Text saves keep the rules the session has
+        free(session);
+        close(fd);
+        return 0;
+    }
+    session->rules.misere = 1;
+    session->fd = fd;
+
+    event.events = EPOLLIN;
+    event.data.ptr = session;
+    if (epoll_ctl(server->epoll, EPOLL_CTL_ADD, fd, &event) != 0) {
+        freeRules(&session->rules);
+        free(session);
+        close(fd);
+        return 0;
+    }
+
+    session->next = server->sessions;
+    if (server->sessions != NULL)
+        server->sessions->previous = session;
+    server->sessions = session;
+    server->accepted++;
+    server->open++;
+    return 1;
+}
+
+static void closeSession(Server *server, Session *session) {
+    if (session->previous != NULL)
+        session->previous->next = session->next;
+    else
+        server->sessions = session->next;
+    if (session->next != NULL)
+        session->next->previous = session->previous;
+    server->open--;
+
+    close(session->fd); // Closing also takes it out of the event loop
+    freeGame(&session->game);
+    freeRules(&session->rules);
+    free(session->output);
+    free(session);
+}
+
+static int readSession(Server *server, Session *session) {
+    char *line, *newline;
+    ssize_t received;
+    size_t used;
+
+    while (1) {
+        received = read(session->fd, session->input + session->inputUsed, LINE_SIZE - session->inputUsed);
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return flushSession(server, session); // Everything sent so far has been handled
+        if (received <= 0)
+            return 0; // The client hung up
+        session->inputUsed += received;
+
+        // Run every whole line, then keep whatever is left of the last one for the next read
+        line = session->input;
+        used = 0;
+        while ((newline = memchr(line, '\n', session->inputUsed - used)) != NULL) {
+            *newline = '\0';
+            if (newline > line && newline[-1] == '\r')
+                newline[-1] = '\0';
+            used = newline + 1 - session->input;
+            if (!runCommand(server, session, line)) {
+                flushSession(server, session);
+                return 0;
+            }
+            line = newline + 1;
+        }
+        if (used == 0 && session->inputUsed == LINE_SIZE) { // Nothing that long is a command
+            queueReply(session, "ERR line too long", 17);
+            flushSession(server, session);
+            return 0;
+        }
+        memmove(session->input, session->input + used, session->inputUsed - used);
+        session->inputUsed -= used;
+        if (session->outputUsed - session->outputSent > MAX_PENDING_OUTPUT)
+            return 0;
+    }
+}
+
+static int runCommand(Server *server, Session *session, char *line) {
+    char command[16], first[LINE_SIZE], second[LINE_SIZE], third[LINE_SIZE], extra;
+    char reply[REPLY_SIZE];
+    long long started = nanoseconds();
+    int arguments, length, player;
+    Turn turn;
+
+    arguments = sscanf(line, "%15s %4095s %4095s %4095s %c", command, first, second, third, &extra);
+    if (arguments < 1) // Blank lines are ignored
+        return 1;
+
+    if (strcmp(command, "NEW") == 0 && arguments == 4) {
+        if (startGame(server, session, first, second, third))
+            length = describeBoard(session, "BOARD", reply);
+        else
+            length = sprintf(reply, "ERR invalid game");
+    } else if (strcmp(command, "MOVE") == 0 || strcmp(command, "AI") == 0) {
+        if (!session->haveGame || gameWon(&session->game)) {
+            length = sprintf(reply, "ERR no game in progress");
+        } else if (command[0] == 'A' && arguments == 1) {
+            getAITurn(&session->game, &turn); // A move can take from several rows, or from the middle of one
+            length = makeMove(server, session, &turn, reply);
+        } else if (command[0] == 'M' && parseMove(&session->game, line, &turn) && legalTurn(&session->game, &turn)) {
+            length = makeMove(server, session, &turn, reply);
+        } else {
+            length = sprintf(reply, "ERR illegal move");
+        }
+        recordTime(&server->latency, nanoseconds() - started);
+    } else if (strcmp(command, "SHOW") == 0 && arguments == 1) {
+        if (session->haveGame)
+            length = describeBoard(session, "BOARD", reply);
+        else
+            length = sprintf(reply, "ERR no game in progress");
+    } else if (strcmp(command, "SAVE") == 0 && arguments == 2) {
+        if (!session->haveGame || !validName(first) || !writeSave(&session->game, session->player, first))
+            length = sprintf(reply, "ERR cannot save");
+        else
+            length = sprintf(reply, "OK");
+    } else if (strcmp(command, "LOAD") == 0 && arguments == 2) {
+        if (validName(first) && readSave(&session->game, &session->rules, &player, first)) {
+            session->haveGame = 1;
+            session->player = player;
+            session->game.tablebase = server->tablebase != NULL &&
+                                      tablebaseMatches(server->tablebase, &session->rules) ? server->tablebase : NULL;
+            length = describeBoard(session, "BOARD", reply);
+        } else {
+            length = sprintf(reply, "ERR cannot load");
+        }
+    } else if (strcmp(command, "STATS") == 0 && arguments == 1) {
+        length = sprintf(reply, "STATS connections %lld open %lld per-second %.1f moves %lld p50-us %.1f p99-us %.1f",
+                         server->accepted, server->open, server->accepted / (nanoseconds() / 1e9 - server->started),
+                         server->moves, percentile(&server->latency, 0.5), percentile(&server->latency, 0.99));
+    } else if (strcmp(command, "QUIT") == 0 && arguments == 1) {
+        queueReply(session, "BYE", 3);
+        return 0;
+    } else {
+        length = sprintf(reply, "ERR unknown command");
+    }
+
+    if (!queueReply(session, reply, length))
+        return 0;
+    return 1;
+}
+
+static int startGame(Server *server, Session *session, const char *ruleText, const char *mode, const char *rowText) {
+    long long sizes[MAX_ROWS];
+    int heapCount;
+    Rules rules;
+
+    heapCount = parseList(rowText, sizes, MAX_ROWS);
+    if (heapCount == 0 || (strcmp(mode, "misere") != 0 && strcmp(mode, "normal") != 0) ||
+        !parseRules(&rules, ruleText))
+        return 0;
+    rules.misere = mode[0] == 'm';
+
+    // The old game points at the old rules, so it goes first
+    freeGame(&session->game);
+    freeRules(&session->rules);
+    session->rules = rules;
+    session->player = 0;
+    session->haveGame = newGame(&session->game, heapCount, sizes, &session->rules);
+    if (session->haveGame && server->tablebase != NULL && tablebaseMatches(server->tablebase, &session->rules))
+        session->game.tablebase = server->tablebase;
+    return session->haveGame;
+}
+
+static int parseMove(const Game *game, const char *line, Turn *turn) {
+    long long numbers[2 * MAX_MOVE_ROWS + 1];
+    int count = 0, used, i;
+
+    line += strspn(line, " \t") + strlen("MOVE");
+    for (; count < 2 * MAX_MOVE_ROWS + 1 && sscanf(line, "%lld%n", &numbers[count], &used) == 1; count++)
+        line += used;
+    if (line[strspn(line, " \t")] != '\0') // Something other than a number, or too many of them
+        return 0;
+    if (game->rules->octal ? count != 2 && count != 3 : count < 2 || count % 2 != 0 || count > 2 * MAX_MOVE_ROWS)
+        return 0;
+
+    turn->count = game->rules->octal ? 1 : count / 2;
+    turn->left = count == 3 ? numbers[2] : 0; // Only an octal turn has an odd count; it starts from the left end
+    for (i = 0; i < turn->count; i++) {
+        if (numbers[2 * i] < 1 || numbers[2 * i] > game->heapCount) // Before it is narrowed to an int
+            return 0;
+        turn->rows[i] = (int) numbers[2 * i];
+        turn->pieces[i] = numbers[2 * i + 1];
+    }
+    return 1;
+}
+
+static int makeMove(Server *server, Session *session, const Turn *turn, char *reply) {
+    char moveText[MOVE_TEXT_SIZE], heading[MOVE_TEXT_SIZE + 8];
+    int length = 0, i;
+
+    for (i = 0; i < turn->count; i++)
+        length += sprintf(moveText + length, " %d %lld", turn->rows[i], turn->pieces[i]);
+    if (session->game.rules->octal)
+        sprintf(moveText + length, " %lld", turn->left);
+    takeTurn(&session->game, turn);
+    session->player = !session->player;
+    server->moves++;
+    if (gameWon(&session->game))
+        return sprintf(reply, "OVER%s %c", moveText, gameWinner(&session->game, session->player) ? 'B' : 'A');
+    sprintf(heading, "MOVED%s", moveText);
+    return describeBoard(session, heading, reply);
+}
+
+static int describeBoard(const Session *session, const char *heading, char *reply) {
+    int length, i;
+
+    length = sprintf(reply, "%s %c", heading, session->player ? 'B' : 'A');
+    for (i = 0; i < session->game.heapCount && i < MAX_ROWS; i++)
+        length += sprintf(reply + length, " %lld", session->game.heaps[i]);
+    return length;
+}
+
+static int validName(const char *name) {
+    size_t i, length = strlen(name);
+
+    if (length == 0 || length > MAX_NAME || name[0] == '.')
+        return 0;
+    for (i = 0; i < length; i++)
+        if (strchr("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789._-", name[i]) == NULL)
+            return 0;
+    return 1;
+}
+
+static int queueReply(Session *session, const char *text, size_t length) {
+    char *grown;
+    size_t capacity;
+
+    if (session->outputSent == session->outputUsed) // Everything went out, so start from the front again
+        session->outputSent = session->outputUsed = 0;
+    if (session->outputUsed + length + 1 > session->outputCapacity) {
+        if (session->outputUsed - session->outputSent + length + 1 > MAX_PENDING_OUTPUT)
+            return 0;
+        capacity = session->outputCapacity ? session->outputCapacity * 2 : 256;
+        while (capacity < session->outputUsed + length + 1)
+            capacity *= 2;
+        grown = realloc(session->output, capacity);
+        if (grown == NULL)
+            return 0;
+        session->output = grown;
+        session->outputCapacity = capacity;
+    }
+    memcpy(session->output + session->outputUsed, text, length);
+    session->output[session->outputUsed + length] = '\n';
+    session->outputUsed += length + 1;
+    return 1;
+}
+
+static int flushSession(Server *server, Session *session) {
+    struct epoll_event event;
+    ssize_t sent;
+    int writing;
+
+    while (session->outputSent < session->outputUsed) {
+        sent = send(session->fd, session->output + session->outputSent, session->outputUsed - session->outputSent,
+                    MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (sent < 0)
+            return 0;
+        session->outputSent += sent;
+    }
+
+    // Only ask to hear about room in the socket while there is something waiting for it
+    writing = session->outputSent < session->outputUsed;
+    if (writing != session->writing) {
+        event.events = writing ? EPOLLIN | EPOLLOUT : EPOLLIN;
+        event.data.ptr = session;
+        if (epoll_ctl(server->epoll, EPOLL_CTL_MOD, session->fd, &event) != 0)
+            return 0;
+        session->writing = writing;
+    }
+    return 1;
+}
+
+static int runLoad(const char *path, int clients, long long games, const char *newCommand) {
+    struct epoll_event events[MAX_EVENTS];
+    Histogram latency = {{0}, 0};
+    Client *list = calloc(clients, sizeof(Client)), *client;
+    long long started = 0, finished = 0, failed = 0, moves = 0, begin, received;
+    char *line, *newline;
+    double seconds;
+    int epoll = epoll_create1(EPOLL_CLOEXEC), count, i, done;
+
+    if (list == NULL || epoll < 0) {
+        fprintf(stderr, "Not enough memory\n");
+        return 0;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    begin = nanoseconds();
+    for (i = 0; i < clients && started < games; i++, started++) {
+        if (!startClient(epoll, &list[i], path, newCommand)) {
+            fprintf(stderr, "Cannot connect to %s\n", path);
+            return 0;
+        }
+    }
+
+    while (finished + failed < started) {
+        count = epoll_wait(epoll, events, MAX_EVENTS, -1);
+        for (i = 0; i < count; i++) {
+            client = events[i].data.ptr;
+            received = read(client->fd, client->input + client->inputUsed, sizeof(client->input) - client->inputUsed);
+            if (received < 0 && (errno == EAGAIN || errno == EINTR))
+                continue;
+            done = received <= 0;
+            client->inputUsed += received > 0 ? received : 0;
+
+            // Each reply decides the next command: keep asking for AI moves until the game is over
+            line = client->input;
+            while (!done && (newline = memchr(line, '\n', client->input + client->inputUsed - line)) != NULL) {
+                *newline = '\0';
+                if (strncmp(line, "OVER", 4) == 0 || strncmp(line, "MOVED", 5) == 0) {
+                    recordTime(&latency, nanoseconds() - client->sentAt);
+                    moves++;
+                }
+                if (strncmp(line, "OVER", 4) == 0) {
+                    finished++;
+                    done = 2;
+                } else if (strncmp(line, "ERR", 3) == 0 || !sendCommand(client, "AI\n")) {
+                    fprintf(stderr, "Server replied: %s\n", line);
+                    done = 1;
+                }
+                line = newline + 1;
+            }
+            memmove(client->input, line, client->input + client->inputUsed - line);
+            client->inputUsed = client->input + client->inputUsed - line;
+
+            if (done) { // Hang up, and start the next game on a new connection
+                failed += done == 1;
+                close(client->fd);
+                if (started < games) {
+                    if (!startClient(epoll, client, path, newCommand)) {
+                        fprintf(stderr, "Cannot connect to %s\n", path);
+                        games = started;
+                    } else {
+                        started++;
+                    }
+                }
+            }
+        }
+    }
+
+    seconds = (nanoseconds() - begin) / 1e9;
+    printf("%lld games (%lld failed) over %d connections at a time in %.2f s: %.1f connections per second\n",
+           finished, failed, clients, seconds, started / seconds);
+    printf("%lld moves, round-trip latency p50 %.1f us, p99 %.1f us\n", moves, percentile(&latency, 0.5),
+           percentile(&latency, 0.99));
+    close(epoll);
+    free(list);
+    return failed == 0;
+}
+
+static int startClient(int epoll, Client *client, const char *path, const char *newCommand) {
+    struct sockaddr_un address;
+    struct epoll_event event;
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+
+    // Connect while blocking, so a full backlog waits for the server instead of failing
+    client->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (client->fd < 0)
+        return 0;
+    if (connect(client->fd, (struct sockaddr *) &address, sizeof(address)) != 0 ||
+        fcntl(client->fd, F_SETFL, O_NONBLOCK) != 0) {
+        close(client->fd);
+        return 0;
+    }
+    client->inputUsed = 0;
+
+    event.events = EPOLLIN;
+    event.data.ptr = client;
+    if (epoll_ctl(epoll, EPOLL_CTL_ADD, client->fd, &event) != 0 || !sendCommand(client, newCommand)) {
+        close(client->fd);
+        return 0;
+    }
+    return 1;
+}
+
+static int sendCommand(Client *client, const char *text) {
+    size_t length = strlen(text);
+    client->sentAt = nanoseconds();
+    return send(client->fd, text, length, MSG_NOSIGNAL) == (ssize_t) length; // Commands are far smaller than the socket buffer
+}
+
+static void stopServer(int number) {
+    (void) number;
+    stopping = 1;
+}
+
+static void raiseFileLimit(void) {
+    struct rlimit limit;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef NIM_STANDARD_H
+#define NIM_STANDARD_H
+
+// The standard board: rows of 3, 5 and 7 where 1, 2 or 3 pieces can be taken
+#define STANDARD_ROW_1 3
+#define STANDARD_ROW_2 5
+#define STANDARD_ROW_3 7
+#define STANDARD_STATES ((STANDARD_ROW_1 + 1) * (STANDARD_ROW_2 + 1) * (STANDARD_ROW_3 + 1))
+
+// How a position's entry packs the result: whether the player to move wins, then the move to make
+#define STANDARD_WINNING 0x10 // Set if the player to move wins against perfect play
+#define STANDARD_ROW(entry) (((entry) >> 2) & 3) // Row to take from (1, 2, 3), or 0 on an empty board
+#define STANDARD_PIECES(entry) ((entry) & 3) // Pieces to take (1, 2, 3), or 0 on an empty board
+
+/**
+ * Every position of the standard board, solved by nim-gentable when the game is built. The first index is 1 for
+ * misère play and 0 for normal play; the second is the position, found with standardIndex.
+ */
+extern const unsigned char standardTable[2][STANDARD_STATES];
+
+/**
+ * Find where a position of the standard board is in standardTable
+ * @param heaps pieces left in each of the three rows, each no bigger than the standard row
+ * @return the index
+ */
+static inline int standardIndex(const long long heaps[3]) {
+    return (int) ((heaps[0] * (STANDARD_ROW_2 + 1) + heaps[1]) * (STANDARD_ROW_3 + 1) + heaps[2]);
+}
+
+#endif
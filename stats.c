@@ -0,0 +1,156 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "stats.h"
+
+/**
+ * Everything recorded about one timed call
+ */
+typedef struct {
+    long long calls; // Times the call was made
+    long long totalTime; // Time spent in it, in nanoseconds
+    long long longest; // Longest single call, in nanoseconds
+    Histogram times; // Every call's time
+} Stat;
+
+static const char *statNames[STAT_COUNT] = {"getAITurn", "drawBoard", "getMove", "getExtraRow", "readGame",
+                                            "writeGame", "resumeGame", "journalTurn", "reply", "stopPondering"};
+static const char *counterNames[COUNTER_COUNT] = {"turns", "invalid_input", "compactions", "ponder_hits",
+                                                  "ponder_misses"};
+
+static Stat stats[STAT_COUNT];
+static long long counters[COUNTER_COUNT];
+static const char *statsFile; // Where dumpStats writes, or NULL before startStats
+static volatile sig_atomic_t dumpRequested; // Set by SIGUSR1; the dump itself waits for the next timed call
+
+/**
+ * Find the smallest time a histogram bucket holds
+ * @param bucket
+ * @return the time in nanoseconds
+ */
+static long long bucketStart(int bucket);
+
+/**
+ * Find a percentile of a timed call's times, no bigger than its longest call
+ * @param stat
+ * @param fraction 0.5 for the median, 0.99 for the 99th percentile, and so on
+ * @return the percentile in microseconds
+ */
+static double statPercentile(const Stat *stat, double fraction);
+
+/**
+ * Ask for the statistics to be written; installed for SIGUSR1
+ * @param number the signal
+ */
+static void requestDump(int number);
+
+/**
+ * Write the statistics before the program exits; registered with atexit
+ */
+static void dumpAtExit(void);
+
+void recordTime(Histogram *histogram, long long elapsed) {
+    int top;
+
+    if (elapsed < 8) {
+        histogram->counts[elapsed < 0 ? 0 : elapsed]++;
+    } else {
+        top = 63 - __builtin_clzll((unsigned long long) elapsed); // Highest set bit, at least 3
+        histogram->counts[(top - 2) * 8 + (int) (elapsed >> (top - 3) & 7)]++;
+    }
+    histogram->total++;
+}
+
+double percentile(const Histogram *histogram, double fraction) {
+    long long seen = 0;
+    int bucket;
+
+    for (bucket = 0; bucket < HISTOGRAM_BUCKETS - 1; bucket++) {
+        seen += histogram->counts[bucket];
+        if (seen > 0 && seen >= fraction * histogram->total)
+            return bucketStart(bucket + 1) / 1e3;
+    }
+    return histogram->total > 0 ? bucketStart(HISTOGRAM_BUCKETS - 1) / 1e3 : 0;
+}
+
+long long nanoseconds(void) {
+    struct timespec spec;
+    clock_gettime(CLOCK_MONOTONIC, &spec);
+    return spec.tv_sec * 1000000000LL + spec.tv_nsec;
+}
+
+void startStats(const char *fileName) {
+    struct sigaction action;
+
+    statsFile = fileName;
+    atexit(dumpAtExit);
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = requestDump;
+    action.sa_flags = SA_RESTART; // Reads waiting for the user carry on instead of failing
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGUSR1, &action, NULL);
+}
+
+void recordStat(int stat, long long started) {
+    long long elapsed = nanoseconds() - started;
+
+    stats[stat].calls++;
+    stats[stat].totalTime += elapsed;
+    if (elapsed > stats[stat].longest)
+        stats[stat].longest = elapsed;
+    recordTime(&stats[stat].times, elapsed);
+
+    if (dumpRequested) {
+        dumpRequested = 0;
+        dumpStats();
+    }
+}
+
+void countStat(int counter) {
+    counters[counter]++;
+}
+
+int dumpStats(void) {
+    const Stat *stat;
+    FILE *file;
+    int i;
+
+    if (statsFile == NULL || (file = fopen(statsFile, "w")) == NULL)
+        return 0;
+    fprintf(file, "{\n  \"calls\": [");
+    for (i = 0; i < STAT_COUNT; i++) {
+        stat = &stats[i];
+        fprintf(file, "%s\n    {\"function\": \"%s\", \"calls\": %lld, \"total_us\": %.3f, \"mean_us\": %.3f, "
+                      "\"p50_us\": %.3f, \"p90_us\": %.3f, \"p99_us\": %.3f, \"max_us\": %.3f}",
+                i > 0 ? "," : "", statNames[i], stat->calls, stat->totalTime / 1e3,
+                stat->calls > 0 ? stat->totalTime / 1e3 / stat->calls : 0, statPercentile(stat, 0.5),
+                statPercentile(stat, 0.9), statPercentile(stat, 0.99), stat->longest / 1e3);
+    }
+    fprintf(file, "\n  ],\n  \"counters\": {");
+    for (i = 0; i < COUNTER_COUNT; i++)
+        fprintf(file, "%s\"%s\": %lld", i > 0 ? ", " : "", counterNames[i], counters[i]);
+    fprintf(file, "}\n}\n");
+    return fclose(file) == 0;
+}
+
+static long long bucketStart(int bucket) {
+    if (bucket < 8)
+        return bucket;
+    return (long long) (8 + bucket % 8) << (bucket / 8 - 1);
+}
+
+static double statPercentile(const Stat *stat, double fraction) {
+    double time = percentile(&stat->times, fraction);
+    return time < stat->longest / 1e3 ? time : stat->longest / 1e3; // Buckets report their upper end
+}
+
+static void requestDump(int number) {
+    (void) number;
+    dumpRequested = 1;
+}
+
+static void dumpAtExit(void) {
+    dumpStats();
+}
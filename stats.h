@@ -0,0 +1,99 @@
+#ifndef NIM_STATS_H
+#define NIM_STATS_H
+
+#define HISTOGRAM_BUCKETS 512 // 8 buckets for every power of 2 of nanoseconds, enough for any 63-bit time
+
+// Calls that are timed when the game is built with NIM_STATS
+#define STAT_AI_TURN 0 // getAITurn
+#define STAT_DRAW_BOARD 1 // drawBoard
+#define STAT_GET_MOVE 2 // getMove, including the wait for the user to type
+#define STAT_GET_EXTRA_ROW 3 // getExtraRow, including the wait for the user to type
+#define STAT_READ_GAME 4 // readGame
+#define STAT_WRITE_GAME 5 // writeGame
+#define STAT_RESUME_GAME 6 // resumeGame
+#define STAT_JOURNAL_TURN 7 // journalTurn
+#define STAT_REPLY 8 // From the user's move being entered to the computer's reply being ready, board drawing included
+#define STAT_STOP_PONDERING 9 // stopPondering
+#define STAT_COUNT 10
+
+// Events that are only counted
+#define COUNTER_TURNS 0 // Turns played
+#define COUNTER_INVALID_INPUT 1 // Rows and amounts that were not legal and had to be asked for again
+#define COUNTER_COMPACTIONS 2 // Times the journal was compacted
+#define COUNTER_PONDER_HITS 3 // Replies to the user that were worked out while they were choosing their move
+#define COUNTER_PONDER_MISSES 4 // Replies to the user that had to be worked out after they moved
+#define COUNTER_COUNT 5
+
+/**
+ * Counts of times, in buckets that are never more than 1/8 wider than the times in them
+ */
+typedef struct {
+    long long counts[HISTOGRAM_BUCKETS];
+    long long total;
+} Histogram;
+
+/**
+ * Count a time in a histogram
+ * @param histogram
+ * @param elapsed time in nanoseconds
+ */
+void recordTime(Histogram *histogram, long long elapsed);
+
+/**
+ * Find a percentile of the times in a histogram
+ * @param histogram
+ * @param fraction 0.5 for the median, 0.99 for the 99th percentile, and so on
+ * @return the upper end of the bucket the percentile falls in, in microseconds, or 0 if nothing was counted
+ */
+double percentile(const Histogram *histogram, double fraction);
+
+/**
+ * Get a monotonic time stamp
+ * @return nanoseconds since some fixed point
+ */
+long long nanoseconds(void);
+
+/**
+ * Start collecting statistics. They are written to the file when the program exits, and also after the next timed
+ * call whenever the process gets SIGUSR1. Only one thread may record statistics.
+ * @param fileName where to write the statistics, as JSON
+ */
+void startStats(const char *fileName);
+
+/**
+ * Count a timed call
+ * @param stat which call (STAT_*)
+ * @param started time stamp from nanoseconds taken when the call started
+ */
+void recordStat(int stat, long long started);
+
+/**
+ * Count an event
+ * @param counter which event (COUNTER_*)
+ */
+void countStat(int counter);
+
+/**
+ * Write the statistics collected so far: for every timed call, how many times it was made and its total, mean,
+ * median, 90th percentile, 99th percentile and longest time, and then every counter
+ * @return 1 if the file was written, 0 otherwise
+ */
+int dumpStats(void);
+
+// With NIM_STATS the game times its hot paths; without it these compile to the plain calls and nothing else.
+// STATS_MARK takes a time stamp and STATS_SINCE records the time from it, for spans that are not a single call.
+#ifdef NIM_STATS
+#define STATS_START(fileName) startStats(fileName)
+#define STATS_SPAN(stat, call) do { long long statsStarted = nanoseconds(); call; recordStat(stat, statsStarted); } while (0)
+#define STATS_COUNT(counter) countStat(counter)
+#define STATS_MARK(mark) ((mark) = nanoseconds())
+#define STATS_SINCE(stat, mark) recordStat(stat, mark)
+#else
+#define STATS_START(fileName) ((void) 0)
+#define STATS_SPAN(stat, call) do { call; } while (0)
+#define STATS_COUNT(counter) ((void) 0)
+#define STATS_MARK(mark) ((void) (mark))
+#define STATS_SINCE(stat, mark) ((void) (mark))
+#endif
+
+#endif
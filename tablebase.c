@@ -0,0 +1,530 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "tablebase.h"
+
+#define TABLEBASE_MAGIC "NIMTB02" // Marks the start of a tablebase file; the digits are the format version
+#define ENTRY_WIN 0x8000 // Set if the player to move wins
+#define ENTRY_SLOT_SHIFT 10 // Where the sorted row of the winning move starts in an entry
+#define ENTRY_AMOUNT_MASK 0x3FF // The pieces the winning move takes
+#define BATCH_SIZE 1024 // Positions handed out at a time when building with threads
+#define MAX_BUILD_THREADS 256
+
+/**
+ * The start of a tablebase file. The entries follow right after it.
+ */
+typedef struct {
+    char magic[8];
+    int misere;
+    int heapSlots;
+    int maxHeap;
+    int anyAmount;
+    int moveCount;
+    int moves[MAX_RULE_MOVES];
+    long long entryCount;
+} TablebaseHeader;
+
+/**
+ * What all the threads building a tablebase share
+ */
+typedef struct {
+    Tablebase *tablebase;
+    unsigned short *entries; // The entries being filled in
+    const unsigned int *order; // Entry numbers sorted by layer (pieces left)
+    const long long *layerStarts; // Where each layer begins in order; one extra at the end
+    int layerCount;
+    int threads;
+    pthread_barrier_t barrier; // Keeps every thread on the same layer
+    _Atomic unsigned long long ranges[MAX_BUILD_THREADS]; // Each thread's batches left: first << 32 | end
+} Builder;
+
+/**
+ * One thread building a tablebase
+ */
+typedef struct {
+    Builder *builder;
+    int id;
+    BuildStats stats;
+} BuildThread;
+
+/**
+ * Solve every layer's share of positions, in step with the other threads
+ * @param arg address of the BuildThread
+ * @return NULL
+ */
+static void *buildLayers(void *arg);
+
+/**
+ * Take the next batch from a thread's own range
+ * @param range the range to take from
+ * @param batch address to store the batch number
+ * @return 1 if a batch was taken, 0 if the range is empty
+ */
+static int takeBatch(_Atomic unsigned long long *range, long long *batch);
+
+/**
+ * Take the back half of another thread's range
+ * @param range the other thread's range
+ * @param first address to store the first batch taken
+ * @param end address to store one past the last batch taken
+ * @return 1 if anything was taken, 0 if the range is empty
+ */
+static int stealBatches(_Atomic unsigned long long *range, long long *first, long long *end);
+
+/**
+ * Turn an entry number back into its sorted position
+ * @param tablebase
+ * @param rank the entry number
+ * @param sorted array to store the position in, smallest row first
+ */
+static void unrankPosition(const Tablebase *tablebase, long long rank, int sorted[]);
+
+/**
+ * Read the monotonic clock
+ * @return the time in seconds
+ */
+static double now(void);
+
+/**
+ * Work out the binomial coefficients and the number of positions for a tablebase size
+ * @param tablebase address of the tablebase whose heapSlots and maxHeap are already set
+ * @return 1 if successful, 0 if memory could not be allocated
+ */
+static int setUpIndex(Tablebase *tablebase);
+
+/**
+ * Turn a sorted position into its entry number. Adding i to the i-th smallest row makes the rows strictly
+ * increasing, and strictly increasing lists are numbered by the combinatorial number system.
+ * @param tablebase
+ * @param sorted number of pieces in each slot, smallest first, with empty slots at the start
+ * @return the entry number
+ */
+static long long rankPosition(const Tablebase *tablebase, const int sorted[]);
+
+/**
+ * Move to the next sorted position in entry order
+ * @param tablebase
+ * @param sorted the position to change, smallest row first
+ */
+static void nextPosition(const Tablebase *tablebase, int sorted[]);
+
+/**
+ * Solve one position, given that every position it can move to has already been solved
+ * @param tablebase
+ * @param entries the entries solved so far
+ * @param sorted the position, smallest row first
+ * @return the entry for the position
+ */
+static unsigned short solvePosition(const Tablebase *tablebase, const unsigned short *entries, const int sorted[]);
+
+int buildTablebase(Tablebase *tablebase, const Rules *rules, int heapSlots, int maxHeap, int threads,
+                   BuildStats stats[]) {
+    unsigned short *entries;
+    int sorted[TABLEBASE_MAX_SLOTS] = {0}; // Starts at the empty board, which is entry 0
+    long long rank, *layerStarts = NULL;
+    unsigned int *order = NULL;
+    int i, layer, pieces;
+    Builder builder;
+    BuildThread workers[MAX_BUILD_THREADS];
+    pthread_t ids[MAX_BUILD_THREADS];
+    double start;
+
+    if (heapSlots < 1 || heapSlots > TABLEBASE_MAX_SLOTS || maxHeap < 1 || maxHeap > TABLEBASE_MAX_HEAP ||
+        threads < 1 || threads > MAX_BUILD_THREADS)
+        return 0;
+    memset(tablebase, 0, sizeof(Tablebase));
+    tablebase->heapSlots = heapSlots;
+    tablebase->maxHeap = maxHeap;
+    tablebase->rules = *rules;
+    tablebase->rules.table = NULL; // Moves are checked directly, so the Grundy values are not needed
+    if (!setUpIndex(tablebase))
+        return 0;
+
+    entries = malloc(tablebase->entryCount * sizeof(unsigned short));
+    if (entries == NULL) {
+        closeTablebase(tablebase);
+        return 0;
+    }
+    tablebase->entries = entries;
+
+    if (threads == 1) {
+        // Every move makes the sorted position smaller in entry order, so a single pass in that order is enough
+        start = now();
+        for (rank = 0; rank < tablebase->entryCount; rank++) {
+            entries[rank] = solvePosition(tablebase, entries, sorted);
+            nextPosition(tablebase, sorted);
+        }
+        if (stats != NULL) {
+            stats[0].positions = tablebase->entryCount;
+            stats[0].steals = 0;
+            stats[0].seconds = now() - start;
+        }
+        return 1;
+    }
+
+    // Sort the entry numbers by layer with a counting sort: count each layer, then place each entry
+    builder.layerCount = heapSlots * maxHeap + 1;
+    layerStarts = calloc(builder.layerCount + 1, sizeof(long long));
+    order = tablebase->entryCount <= UINT_MAX ? malloc(tablebase->entryCount * sizeof(unsigned int)) : NULL;
+    if (layerStarts == NULL || order == NULL) {
+        free(layerStarts);
+        free(order);
+        closeTablebase(tablebase);
+        return 0;
+    }
+    for (rank = 0; rank < tablebase->entryCount; rank++) {
+        for (pieces = 0, i = 0; i < heapSlots; i++)
+            pieces += sorted[i];
+        layerStarts[pieces + 1]++;
+        nextPosition(tablebase, sorted);
+    }
+    for (layer = 0; layer < builder.layerCount; layer++)
+        layerStarts[layer + 1] += layerStarts[layer];
+    memset(sorted, 0, sizeof(sorted));
+    for (rank = 0; rank < tablebase->entryCount; rank++) {
+        for (pieces = 0, i = 0; i < heapSlots; i++)
+            pieces += sorted[i];
+        order[layerStarts[pieces]++] = (unsigned int) rank;
+        nextPosition(tablebase, sorted);
+    }
+    for (layer = builder.layerCount; layer > 0; layer--) // Placing moved each start to the next one; move back
+        layerStarts[layer] = layerStarts[layer - 1];
+    layerStarts[0] = 0;
+
+    builder.tablebase = tablebase;
+    builder.entries = entries;
+    builder.order = order;
+    builder.layerStarts = layerStarts;
+    builder.threads = threads;
+    pthread_barrier_init(&builder.barrier, NULL, threads);
+    for (i = 0; i < threads; i++) {
+        atomic_init(&builder.ranges[i], 0);
+        workers[i].builder = &builder;
+        workers[i].id = i;
+        memset(&workers[i].stats, 0, sizeof(BuildStats));
+        pthread_create(&ids[i], NULL, buildLayers, &workers[i]);
+    }
+    for (i = 0; i < threads; i++) {
+        pthread_join(ids[i], NULL);
+        if (stats != NULL)
+            stats[i] = workers[i].stats;
+    }
+    pthread_barrier_destroy(&builder.barrier);
+
+    free(layerStarts);
+    free(order);
+    return 1;
+}
+
+int writeTablebase(const Tablebase *tablebase, const char *fileName) {
+    TablebaseHeader header;
+    FILE *file = fopen(fileName, "wb");
+    int written;
+
+    if (file == NULL)
+        return 0;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TABLEBASE_MAGIC, sizeof(header.magic));
+    header.heapSlots = tablebase->heapSlots;
+    header.maxHeap = tablebase->maxHeap;
+    header.misere = tablebase->rules.misere;
+    header.anyAmount = tablebase->rules.anyAmount;
+    header.moveCount = tablebase->rules.moveCount;
+    memcpy(header.moves, tablebase->rules.moves, sizeof(header.moves));
+    header.entryCount = tablebase->entryCount;
+
+    written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(tablebase->entries, sizeof(unsigned short), tablebase->entryCount, file) ==
+              (size_t) tablebase->entryCount;
+    return fclose(file) == 0 && written;
+}
+
+int openTablebase(Tablebase *tablebase, const char *fileName) {
+    const TablebaseHeader *header;
+    struct stat info;
+    int file = open(fileName, O_RDONLY);
+
+    memset(tablebase, 0, sizeof(Tablebase));
+    if (file < 0)
+        return 0;
+    if (fstat(file, &info) != 0 || (size_t) info.st_size < sizeof(TablebaseHeader)) {
+        close(file);
+        return 0;
+    }
+    tablebase->mappingSize = info.st_size;
+    tablebase->mapping = mmap(NULL, tablebase->mappingSize, PROT_READ, MAP_SHARED, file, 0);
+    close(file); // The mapping stays valid after the file is closed
+    if (tablebase->mapping == MAP_FAILED) {
+        tablebase->mapping = NULL;
+        return 0;
+    }
+
+    header = tablebase->mapping;
+    tablebase->heapSlots = header->heapSlots;
+    tablebase->maxHeap = header->maxHeap;
+    if (memcmp(header->magic, TABLEBASE_MAGIC, sizeof(header->magic)) != 0 || header->heapSlots < 1 ||
+        header->heapSlots > TABLEBASE_MAX_SLOTS || header->maxHeap < 1 || header->maxHeap > TABLEBASE_MAX_HEAP ||
+        header->moveCount < 0 || header->moveCount > MAX_RULE_MOVES || !setUpIndex(tablebase) ||
+        tablebase->entryCount != header->entryCount ||
+        tablebase->mappingSize != sizeof(TablebaseHeader) + tablebase->entryCount * sizeof(unsigned short)) {
+        closeTablebase(tablebase); // Not a tablebase, or one that was cut short
+        return 0;
+    }
+
+    tablebase->rules.misere = header->misere;
+    tablebase->rules.anyAmount = header->anyAmount;
+    tablebase->rules.maxRows = 1;
+    tablebase->rules.moveCount = header->moveCount;
+    memcpy(tablebase->rules.moves, header->moves, sizeof(header->moves));
+    tablebase->entries = (const unsigned short *) (header + 1);
+    return 1;
+}
+
+void closeTablebase(Tablebase *tablebase) {
+    if (tablebase->mapping != NULL)
+        munmap(tablebase->mapping, tablebase->mappingSize);
+    else
+        free((void *) tablebase->entries);
+    free(tablebase->choose);
+    memset(tablebase, 0, sizeof(Tablebase));
+}
+
+int tablebaseMatches(const Tablebase *tablebase, const Rules *rules) {
+    if (tablebase->rules.misere != rules->misere || rules->maxRows != 1 || rules->octal) // Only taking from an end
+        return 0;
+    if (tablebase->rules.anyAmount || rules->anyAmount)
+        return tablebase->rules.anyAmount == rules->anyAmount;
+    return tablebase->rules.moveCount == rules->moveCount &&
+           memcmp(tablebase->rules.moves, rules->moves, rules->moveCount * sizeof(int)) == 0;
+}
+
+int tablebaseLookup(const Tablebase *tablebase, const long long heaps[], int heapCount, int *winning, int *chosenRow,
+                    long long *pieces) {
+    int sorted[TABLEBASE_MAX_SLOTS] = {0};
+    int rows[TABLEBASE_MAX_SLOTS]; // Which row each sorted slot came from
+    int first = tablebase->heapSlots; // Slots from here on hold the non-empty rows
+    int i, j, slot;
+    unsigned short entry;
+
+    // Sort the non-empty rows into the last slots, smallest first, remembering where each one came from
+    for (i = 0; i < heapCount; i++) {
+        if (heaps[i] == 0)
+            continue;
+        if (heaps[i] > tablebase->maxHeap || first == 0)
+            return 0;
+        first--;
+        for (j = first; j < tablebase->heapSlots - 1 && sorted[j + 1] < heaps[i]; j++) {
+            sorted[j] = sorted[j + 1];
+            rows[j] = rows[j + 1];
+        }
+        sorted[j] = (int) heaps[i];
+        rows[j] = i;
+    }
+
+    entry = tablebase->entries[rankPosition(tablebase, sorted)];
+    *winning = (entry & ENTRY_WIN) != 0;
+    slot = (entry & ~ENTRY_WIN) >> ENTRY_SLOT_SHIFT;
+    if (*winning && slot >= first) { // The empty board is a win with no move to make
+        *chosenRow = rows[slot] + 1;
+        *pieces = entry & ENTRY_AMOUNT_MASK;
+    }
+    return 1;
+}
+
+static void *buildLayers(void *arg) {
+    BuildThread *worker = arg;
+    Builder *builder = worker->builder;
+    const Tablebase *tablebase = builder->tablebase;
+    int sorted[TABLEBASE_MAX_SLOTS];
+    long long layerFirst, layerSize, batches, batch, first, end, position, last;
+    int layer, victim, found;
+    double start;
+
+    for (layer = 0; layer < builder->layerCount; layer++) {
+        layerFirst = builder->layerStarts[layer];
+        layerSize = builder->layerStarts[layer + 1] - layerFirst;
+        batches = (layerSize + BATCH_SIZE - 1) / BATCH_SIZE;
+
+        // Start every thread with an even share of the layer's batches
+        first = batches * worker->id / builder->threads;
+        end = batches * (worker->id + 1) / builder->threads;
+        atomic_store(&builder->ranges[worker->id], (unsigned long long) first << 32 | (unsigned long long) end);
+        pthread_barrier_wait(&builder->barrier); // Wait until every share is set before anyone can steal
+
+        start = now();
+        while (1) {
+            found = takeBatch(&builder->ranges[worker->id], &batch);
+            for (victim = (worker->id + 1) % builder->threads; !found && victim != worker->id;
+                 victim = (victim + 1) % builder->threads) {
+                if (stealBatches(&builder->ranges[victim], &first, &end)) {
+                    // Keep the stolen batches in this thread's own range so they can be stolen again
+                    atomic_store(&builder->ranges[worker->id], (unsigned long long) first << 32 | (unsigned long long) end);
+                    worker->stats.steals++;
+                    found = takeBatch(&builder->ranges[worker->id], &batch);
+                }
+            }
+            if (!found) // Every range is empty, so this layer is done
+                break;
+
+            last = (batch + 1) * BATCH_SIZE < layerSize ? (batch + 1) * BATCH_SIZE : layerSize;
+            for (position = batch * BATCH_SIZE; position < last; position++) {
+                unrankPosition(tablebase, builder->order[layerFirst + position], sorted);
+                builder->entries[builder->order[layerFirst + position]] =
+                        solvePosition(tablebase, builder->entries, sorted);
+            }
+            worker->stats.positions += last - batch * BATCH_SIZE;
+        }
+        worker->stats.seconds += now() - start;
+
+        pthread_barrier_wait(&builder->barrier); // The next layer needs every answer from this one
+    }
+    return NULL;
+}
+
+static int takeBatch(_Atomic unsigned long long *range, long long *batch) {
+    unsigned long long current = atomic_load(range);
+    long long first, end;
+
+    do {
+        first = (long long) (current >> 32);
+        end = (long long) (current & 0xFFFFFFFFULL);
+        if (first >= end)
+            return 0;
+    } while (!atomic_compare_exchange_weak(range, &current, (unsigned long long) (first + 1) << 32 | end));
+    *batch = first;
+    return 1;
+}
+
+static int stealBatches(_Atomic unsigned long long *range, long long *first, long long *end) {
+    unsigned long long current = atomic_load(range);
+    long long start, stop, middle;
+
+    do {
+        start = (long long) (current >> 32);
+        stop = (long long) (current & 0xFFFFFFFFULL);
+        if (start >= stop)
+            return 0;
+        middle = stop - (stop - start + 1) / 2;
+    } while (!atomic_compare_exchange_weak(range, &current, (unsigned long long) start << 32 | middle));
+    *first = middle;
+    *end = stop;
+    return 1;
+}
+
+static void unrankPosition(const Tablebase *tablebase, long long rank, int sorted[]) {
+    int stride = tablebase->heapSlots + 1;
+    int i, low, high, middle;
+
+    // Undo rankPosition from the largest row down: each row is the biggest one whose term still fits
+    high = tablebase->maxHeap + tablebase->heapSlots - 1;
+    for (i = tablebase->heapSlots - 1; i >= 0; i--) {
+        low = i;
+        while (low < high) {
+            middle = (low + high + 1) / 2;
+            if (tablebase->choose[middle * stride + i + 1] <= rank)
+                low = middle;
+            else
+                high = middle - 1;
+        }
+        sorted[i] = low - i;
+        rank -= tablebase->choose[low * stride + i + 1];
+        high = low - 1;
+    }
+}
+
+static double now(void) {
+    struct timespec spec;
+    clock_gettime(CLOCK_MONOTONIC, &spec);
+    return spec.tv_sec + spec.tv_nsec / 1e9;
+}
+
+static int setUpIndex(Tablebase *tablebase) {
+    int slots = tablebase->heapSlots;
+    int n, r, top = tablebase->maxHeap + slots; // Strictly increasing lists use numbers below top
+
+    tablebase->choose = calloc((top + 1) * (slots + 1), sizeof(long long));
+    if (tablebase->choose == NULL)
+        return 0;
+
+    // Pascal's triangle, capped so huge sizes are caught below instead of overflowing
+    for (n = 0; n <= top; n++) {
+        tablebase->choose[n * (slots + 1)] = 1;
+        for (r = 1; r <= slots && r <= n; r++) {
+            tablebase->choose[n * (slots + 1) + r] = tablebase->choose[(n - 1) * (slots + 1) + r - 1] +
+                                                     tablebase->choose[(n - 1) * (slots + 1) + r];
+            if (tablebase->choose[n * (slots + 1) + r] > 1LL << 40)
+                tablebase->choose[n * (slots + 1) + r] = 1LL << 40;
+        }
+    }
+
+    tablebase->entryCount = tablebase->choose[top * (slots + 1) + slots];
+    if (tablebase->entryCount >= 1LL << 40) { // Far more than could ever fit in memory
+        free(tablebase->choose);
+        tablebase->choose = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+static long long rankPosition(const Tablebase *tablebase, const int sorted[]) {
+    long long rank = 0;
+    int i, stride = tablebase->heapSlots + 1;
+    for (i = 0; i < tablebase->heapSlots; i++)
+        rank += tablebase->choose[(sorted[i] + i) * stride + i + 1];
+    return rank;
+}
+
+static void nextPosition(const Tablebase *tablebase, int sorted[]) {
+    int i, j;
+    // Find the smallest slot that can grow without passing the slot above it, grow it, and reset the ones below
+    for (i = 0; i < tablebase->heapSlots - 1 && sorted[i] == sorted[i + 1]; i++) {/* none */}
+    sorted[i]++;
+    for (j = 0; j < i; j++)
+        sorted[j] = 0;
+}
+
+static unsigned short solvePosition(const Tablebase *tablebase, const unsigned short *entries, const int sorted[]) {
+    const Rules *rules = &tablebase->rules;
+    int child[TABLEBASE_MAX_SLOTS];
+    int slots = tablebase->heapSlots;
+    int i, j, k, amount, moveCount;
+
+    for (i = 0; i < slots; i++) {
+        if (sorted[i] == 0 || (i < slots - 1 && sorted[i] == sorted[i + 1]))
+            continue; // Empty, or the same as the next row, which gives the same positions
+        moveCount = rules->anyAmount ? sorted[i] : rules->moveCount;
+
+        for (j = 0; j < moveCount; j++) {
+            amount = rules->anyAmount ? j + 1 : rules->moves[j];
+            if (amount > sorted[i])
+                break;
+
+            // Take the pieces and slide the row down until the position is sorted again
+            memcpy(child, sorted, slots * sizeof(int));
+            child[i] -= amount;
+            for (k = i; k > 0 && child[k - 1] > child[k]; k--) {
+                child[k] = child[k - 1];
+                child[k - 1] = sorted[i] - amount;
+            }
+
+            if (!(entries[rankPosition(tablebase, child)] & ENTRY_WIN)) // Leave the other player lost
+                return ENTRY_WIN | i << ENTRY_SLOT_SHIFT | amount;
+        }
+    }
+
+    // No move leaves the other player lost. On the empty board that is because the other player took the last
+    // piece, which wins in misère play and loses in normal play.
+    for (i = 0; i < slots && sorted[i] == 0; i++) {/* none */}
+    return i == slots && rules->misere ? ENTRY_WIN : 0;
+}
@@ -0,0 +1,96 @@
+#ifndef NIM_TABLEBASE_H
+#define NIM_TABLEBASE_H
+
+#include <stddef.h>
+#include "grundy.h"
+
+#define TABLEBASE_MAX_SLOTS 32 // The most non-empty rows a tablebase can cover
+#define TABLEBASE_MAX_HEAP 1023 // The most pieces a row can have and still be covered
+
+/**
+ * Every position up to a number of non-empty rows and a row size, solved ahead of time. Rows are sorted before
+ * looking a position up, so positions that only differ in the order of their rows share one entry. Each entry is
+ * 16 bits: the top bit says whether the player to move wins, the next 5 bits say which sorted row the winning move
+ * takes from, and the low 10 bits say how many pieces it takes.
+ */
+typedef struct {
+    int heapSlots; // Most non-empty rows covered
+    int maxHeap; // Most pieces a covered row can have
+    Rules rules; // Rules the positions were solved for (the Grundy table is not kept)
+    long long entryCount; // Number of positions stored
+    const unsigned short *entries; // One entry per position, in the order given by rankPosition in tablebase.c
+    long long *choose; // Binomial coefficients used to turn a sorted position into its entry number
+    void *mapping; // The memory-mapped file, or NULL if the table was built in memory
+    size_t mappingSize; // Size of the mapping in bytes
+} Tablebase;
+
+/**
+ * How much work one thread did while building a tablebase
+ */
+typedef struct {
+    long long positions; // Positions this thread solved
+    long long steals; // Batches of positions this thread took over from other threads
+    double seconds; // Time this thread spent solving, not counting waiting for other threads
+} BuildStats;
+
+/**
+ * Solve every position up to the given size by working up from the empty board, so each position's answers are
+ * already known by the time a position that can move to them is reached. With more than one thread, positions are
+ * solved in layers by the number of pieces left: every move lands in a smaller layer, so a whole layer can be
+ * split across threads, and threads that run out of work take half of what another thread has left. Every
+ * position is solved the same way no matter which thread gets it, so the result is identical for any thread count.
+ * @param tablebase address of the tablebase to build
+ * @param rules the rules to solve for
+ * @param heapSlots most non-empty rows to cover
+ * @param maxHeap most pieces a row can have
+ * @param threads number of threads to solve with
+ * @param stats array of one BuildStats per thread to fill in, or NULL
+ * @return 1 if the tablebase was built, 0 if the size is out of range or memory could not be allocated
+ */
+int buildTablebase(Tablebase *tablebase, const Rules *rules, int heapSlots, int maxHeap, int threads,
+                   BuildStats stats[]);
+
+/**
+ * Save a tablebase to a file in the format openTablebase reads
+ * @param tablebase
+ * @param fileName
+ * @return 1 if the file was written successfully, 0 otherwise
+ */
+int writeTablebase(const Tablebase *tablebase, const char *fileName);
+
+/**
+ * Memory-map a tablebase file. Nothing is read up front; the operating system pages entries in as they are used.
+ * @param tablebase address of the tablebase to open
+ * @param fileName
+ * @return 1 if the file was opened and is a valid tablebase, 0 otherwise
+ */
+int openTablebase(Tablebase *tablebase, const char *fileName);
+
+/**
+ * Release a tablebase, whether it was built or opened from a file
+ * @param tablebase
+ */
+void closeTablebase(Tablebase *tablebase);
+
+/**
+ * Determine whether a tablebase was solved for the given rules
+ * @param tablebase
+ * @param rules
+ * @return 1 if the rules are the same, 0 if not
+ */
+int tablebaseMatches(const Tablebase *tablebase, const Rules *rules);
+
+/**
+ * Look up a position
+ * @param tablebase
+ * @param heaps number of pieces left in each row
+ * @param heapCount number of rows
+ * @param winning address to store whether the player to move wins
+ * @param chosenRow address to store the row of the winning move (1, 2, 3, ...), if there is one
+ * @param pieces address to store the number of pieces the winning move takes, if there is one
+ * @return 1 if the position is covered by the tablebase, 0 if it has too many rows or too many pieces in a row
+ */
+int tablebaseLookup(const Tablebase *tablebase, const long long heaps[], int heapCount, int *winning, int *chosenRow,
+                    long long *pieces);
+
+#endif
@@ -0,0 +1,92 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "tablebase.h"
+
+/**
+ * Read the monotonic clock
+ * @return the time in seconds
+ */
+static double now(void);
+
+int main(int argc, char *argv[]) {
+    const char *ruleText = "1,2,3";
+    const char *fileName = "nim.tb";
+    int heapSlots = 3, maxHeap = 7, normalPlay = 0, option, i;
+    int threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    double start, elapsed;
+    BuildStats stats[256];
+    Tablebase tablebase;
+    Rules rules;
+
+    while ((option = getopt(argc, argv, "k:n:r:o:t:N")) != -1) {
+        switch (option) {
+            case 'k':
+                heapSlots = atoi(optarg);
+                break;
+            case 'n':
+                maxHeap = atoi(optarg);
+                break;
+            case 'r':
+                ruleText = optarg;
+                break;
+            case 'o':
+                fileName = optarg;
+                break;
+            case 't':
+                threads = atoi(optarg);
+                break;
+            case 'N':
+                normalPlay = 1;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-k rows] [-n pieces per row] [-r 1,2,3|any] [-t threads] [-N] [-o nim.tb]\n"
+                                "  -N  normal play: whoever takes the last piece wins (default: they lose)\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (!parseRules(&rules, ruleText)) {
+        fprintf(stderr, "Invalid rules: %s (1 must be one of the amounts)\n", ruleText);
+        return 1;
+    }
+
+    rules.misere = !normalPlay;
+    if (threads < 1)
+        threads = 1;
+    if (threads > 256)
+        threads = 256;
+
+    start = now();
+    if (!buildTablebase(&tablebase, &rules, heapSlots, maxHeap, threads, stats)) {
+        fprintf(stderr, "Cannot build a tablebase for %d rows of up to %d pieces (limits are %d and %d)\n",
+                heapSlots, maxHeap, TABLEBASE_MAX_SLOTS, TABLEBASE_MAX_HEAP);
+        return 1;
+    }
+    elapsed = now() - start;
+
+    if (!writeTablebase(&tablebase, fileName)) {
+        fprintf(stderr, "Could not write %s\n", fileName);
+        return 1;
+    }
+    printf("positions: %lld\n", tablebase.entryCount);
+    printf("seconds: %.3f\n", elapsed);
+    printf("positions/sec: %.0f\n", tablebase.entryCount / elapsed);
+    for (i = 0; i < threads; i++)
+        printf("thread %d: %lld positions, %lld steals, %.0f positions/sec\n", i, stats[i].positions,
+               stats[i].steals, stats[i].seconds > 0 ? stats[i].positions / stats[i].seconds : 0.0);
+    printf("written to %s\n", fileName);
+
+    closeTablebase(&tablebase);
+    freeRules(&rules);
+    return 0;
+}
+
+static double now(void) {
+    struct timespec spec;
+    clock_gettime(CLOCK_MONOTONIC, &spec);
+    return spec.tv_sec + spec.tv_nsec / 1e9;
+}
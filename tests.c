@@ -0,0 +1,473 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "journal.h"
+#include "save.h"
+
+#define TEST_ROWS 4 // Rows on the boards solved by exhaustive search
+#define TEST_HEAP 7 // Most pieces a row of those boards has
+#define TEST_POSITIONS 4096 // Boards of TEST_ROWS rows of 0 to TEST_HEAP pieces: (TEST_HEAP + 1) ^ TEST_ROWS
+#define OCTAL_TEST_HEAP 300 // Heap sizes the octal Grundy values are checked up to
+#define OCTAL_MOVE_HEAP 12 // Most pieces a row of the boards octalMove is checked on has
+#define SAVE_FILE "nim-test.sav" // Scratch files, in the directory the tests run in
+#define JOURNAL_FILE "nim-test.journal"
+
+/**
+ * Whether the player to move wins each board, worked out by trying every move
+ */
+typedef struct {
+    const Rules *rules; // The rules to play by; maxRows says how many rows a move can take from
+    signed char known[TEST_POSITIONS]; // 1 if the player to move wins, 0 if not, -1 if not worked out yet
+} Solver;
+
+/**
+ * Set up a solver with nothing worked out yet
+ * @param solver address of the solver to set up
+ * @param rules
+ */
+static void newSolver(Solver *solver, const Rules *rules);
+
+/**
+ * Determine whether the player to move wins, by trying every move
+ * @param solver
+ * @param heaps TEST_ROWS rows of at most TEST_HEAP pieces each
+ * @return 1 if the player to move wins against perfect play, 0 if not
+ */
+static int solve(Solver *solver, long long heaps[]);
+
+/**
+ * Try every move that takes from the given row or rows after it, on top of what has been taken already
+ * @param solver
+ * @param heaps the board, with what has been taken so far already taken
+ * @param row first row that can still be taken from
+ * @param taken number of rows taken from so far
+ * @return 1 if one of the moves leaves the other player lost, 0 if not
+ */
+static int winningMoveFrom(Solver *solver, long long heaps[], int row, int taken);
+
+/**
+ * Turn a board of TEST_ROWS rows into its solver index
+ * @param heaps
+ * @return the index
+ */
+static int positionIndex(const long long heaps[]);
+
+/**
+ * Turn a solver index back into its board
+ * @param index
+ * @param heaps TEST_ROWS rows to store the board in
+ */
+static void positionHeaps(int index, long long heaps[]);
+
+/**
+ * Check that a move the code found is legal and leaves the other player lost
+ * @param solver
+ * @param heaps the board before the move
+ * @param rows rows taken from (1, 2, 3, ...)
+ * @param pieces pieces taken from each of those rows
+ * @param count number of rows taken from
+ * @return 1 if the move is good, 0 if not
+ */
+static int checkMove(Solver *solver, const long long heaps[], const int rows[], const long long pieces[], int count);
+
+/**
+ * Compare grundyMove and misereMove with exhaustive search under subtraction rules and under any-amount rules
+ * @return number of mismatches
+ */
+static int testGrundy(void);
+
+/**
+ * Compare mooreMove with exhaustive search for k from 1 to 3 in both kinds of play
+ * @return number of mismatches
+ */
+static int testMoore(void);
+
+/**
+ * Compare the octal Grundy values with a mex over every move, and check octalMove on small boards
+ * @return number of mismatches
+ */
+static int testOctal(void);
+
+/**
+ * Compare tablebaseLookup with exhaustive search for a tablebase built with two threads
+ * @return number of mismatches
+ */
+static int testTablebase(void);
+
+/**
+ * Save games under each kind of rules part way through and read them back, through memory and through a file, and
+ * check that a damaged save is turned down
+ * @return number of mismatches
+ */
+static int testSave(void);
+
+/**
+ * Record turns in a journal, replay it and compare the games, including one under an octal code
+ * @return number of mismatches
+ */
+static int testJournal(void);
+
+/**
+ * Compare two games' boards and rules
+ * @param expected
+ * @param actual
+ * @return 1 if they are the same, 0 if not
+ */
+static int sameGame(const Game *expected, const Game *actual);
+
+int main(int argc, char *argv[]) {
+    const struct {
+        const char *name;
+        int (*run)(void);
+    } tests[] = {
+            {"grundy", testGrundy},
+            {"moore", testMoore},
+            {"octal", testOctal},
+            {"tablebase", testTablebase},
+            {"save", testSave},
+            {"journal", testJournal},
+    };
+    int count = sizeof(tests) / sizeof(tests[0]), failures = 0, ran = 0, errors, i;
+
+    for (i = 0; i < count; i++) {
+        if (argc > 1 && strcmp(argv[1], tests[i].name) != 0) // With a name, run only that test
+            continue;
+        errors = tests[i].run();
+        printf("%s: %s\n", tests[i].name, errors == 0 ? "ok" : "FAILED");
+        failures += errors;
+        ran++;
+    }
+    if (ran == 0) {
+        fprintf(stderr, "Usage: %s [grundy|moore|octal|tablebase|save|journal]\n", argv[0]);
+        return 1;
+    }
+    return failures != 0;
+}
+
+static void newSolver(Solver *solver, const Rules *rules) {
+    solver->rules = rules;
+    memset(solver->known, -1, sizeof(solver->known));
+}
+
+static int solve(Solver *solver, long long heaps[]) {
+    int index = positionIndex(heaps), moves = 0, i;
+
+    if (solver->known[index] < 0) {
+        for (i = 0; i < TEST_ROWS; i++)
+            moves += heaps[i] > 0;
+        // With no pieces left, the player to move wins in misère play, since the other player took the last one
+        solver->known[index] = (signed char) (moves == 0 ? solver->rules->misere : winningMoveFrom(solver, heaps, 0, 0));
+    }
+    return solver->known[index];
+}
+
+static int winningMoveFrom(Solver *solver, long long heaps[], int row, int taken) {
+    long long amount;
+    int wins = 0;
+
+    for (; row < TEST_ROWS && !wins; row++) {
+        for (amount = 1; amount <= heaps[row] && !wins; amount++) {
+            if (!allowedTake(solver->rules, amount))
+                continue;
+            heaps[row] -= amount;
+            wins = !solve(solver, heaps) ||
+                   (taken + 1 < solver->rules->maxRows && winningMoveFrom(solver, heaps, row + 1, taken + 1));
+            heaps[row] += amount;
+        }
+    }
+    return wins;
+}
+
+static int positionIndex(const long long heaps[]) {
+    int index = 0, i;
+    for (i = TEST_ROWS - 1; i >= 0; i--)
+        index = index * (TEST_HEAP + 1) + (int) heaps[i];
+    return index;
+}
+
+static void positionHeaps(int index, long long heaps[]) {
+    int i;
+    for (i = 0; i < TEST_ROWS; i++, index /= TEST_HEAP + 1)
+        heaps[i] = index % (TEST_HEAP + 1);
+}
+
+static int checkMove(Solver *solver, const long long heaps[], const int rows[], const long long pieces[], int count) {
+    long long after[TEST_ROWS];
+    int used[TEST_ROWS] = {0}, i;
+
+    memcpy(after, heaps, sizeof(after));
+    if (count < 1 || count > solver->rules->maxRows)
+        return 0;
+    for (i = 0; i < count; i++) { // Each row at most once, in any order
+        if (rows[i] < 1 || rows[i] > TEST_ROWS || used[rows[i] - 1]++ || pieces[i] < 1 ||
+            pieces[i] > after[rows[i] - 1] || (count == 1 && !allowedTake(solver->rules, pieces[i])))
+            return 0;
+        after[rows[i] - 1] -= pieces[i];
+    }
+    return !solve(solver, after);
+}
+
+static int testGrundy(void) {
+    const int amounts[][3] = {{1, 2, 3}, {1, 3, 4}, {1, 2, 5}, {1, 4, 0}};
+    const int amountCounts[] = {3, 3, 3, 2};
+    long long heaps[TEST_ROWS], pieces;
+    int errors = 0, misere, set, winning, row, i;
+    Solver solver;
+    Rules rules;
+
+    for (set = 0; set <= 4; set++) { // The subtraction sets, then any amount
+        if (set < 4 && !newSubtractionRules(&rules, amounts[set], amountCounts[set]))
+            return 1;
+        if (set == 4)
+            newAnyAmountRules(&rules);
+        for (misere = 0; misere <= 1; misere++) {
+            rules.misere = misere;
+            newSolver(&solver, &rules);
+            for (i = 0; i < TEST_POSITIONS; i++) {
+                positionHeaps(i, heaps);
+                winning = misere ? misereMove(&rules, heaps, TEST_ROWS, &row, &pieces)
+                                 : grundyMove(&rules, heaps, TEST_ROWS, &row, &pieces);
+                if (positionIndex(heaps) == 0) // An empty board has no move to check
+                    continue;
+                if (winning != solve(&solver, heaps) || (winning && !checkMove(&solver, heaps, &row, &pieces, 1))) {
+                    fprintf(stderr, "grundy: set %d, %s, %lld %lld %lld %lld: got %d (%d %lld), expected %d\n", set,
+                            misere ? "misère" : "normal", heaps[0], heaps[1], heaps[2], heaps[3], winning, row,
+                            pieces, solve(&solver, heaps));
+                    errors++;
+                }
+            }
+        }
+        freeRules(&rules);
+    }
+    return errors;
+}
+
+static int testMoore(void) {
+    long long heaps[TEST_ROWS], pieces[MAX_MOVE_ROWS];
+    int rows[MAX_MOVE_ROWS], errors = 0, k, misere, count, winning, i;
+    Solver solver;
+    Rules rules;
+
+    for (k = 1; k <= 3; k++) {
+        if (!newMooreRules(&rules, k))
+            return 1;
+        for (misere = 0; misere <= 1; misere++) {
+            rules.misere = misere;
+            newSolver(&solver, &rules);
+            for (i = 1; i < TEST_POSITIONS; i++) {
+                positionHeaps(i, heaps);
+                winning = mooreMove(&rules, heaps, TEST_ROWS, rows, pieces, &count);
+                if (winning != solve(&solver, heaps) || (winning && !checkMove(&solver, heaps, rows, pieces, count))) {
+                    fprintf(stderr, "moore: k %d, %s, %lld %lld %lld %lld: got %d, expected %d\n", k,
+                            misere ? "misère" : "normal", heaps[0], heaps[1], heaps[2], heaps[3], winning,
+                            solve(&solver, heaps));
+                    errors++;
+                }
+            }
+        }
+        freeRules(&rules);
+    }
+    return errors;
+}
+
+static int testOctal(void) {
+    const char *codes[] = {"0.77", "0.07", "0.137", "0.6", "0.16", "0.4", "0.007", "0.33", "0.156", "0.51"};
+    unsigned char seen[OCTAL_TEST_HEAP + 2];
+    int values[OCTAL_TEST_HEAP + 1];
+    long long heaps[3], pieces, left, n, k, part, sum, rest;
+    int codeCount = sizeof(codes) / sizeof(codes[0]), errors = 0, c, value, mex, row, winning, i;
+    Rules rules;
+
+    for (c = 0; c < codeCount; c++) {
+        if (!newOctalRules(&rules, codes[c], OCTAL_TEST_HEAP, NULL))
+            return 1;
+
+        // Every move straight from the definition: the mex of the values it can leave, a split row worth the nim sum
+        for (n = 0; n <= OCTAL_TEST_HEAP; n++) {
+            memset(seen, 0, sizeof(seen));
+            for (k = 1; k <= n && k <= MAX_RULE_MOVES; k++) {
+                for (part = 0; part <= n - k; part++) {
+                    if (!octalAllowed(&rules, n, k, part))
+                        continue;
+                    value = values[part] ^ values[n - k - part]; // Empty parts are worth 0
+                    if (value <= OCTAL_TEST_HEAP)
+                        seen[value] = 1;
+                }
+            }
+            for (mex = 0; seen[mex]; mex++) {/* none */}
+            values[n] = mex;
+            if (grundyValue(&rules, n) != mex) {
+                fprintf(stderr, "octal: %s, heap %lld: got %lld, expected %d\n", codes[c], n, grundyValue(&rules, n),
+                        mex);
+                errors++;
+            }
+        }
+
+        // A move is winning exactly when the values sum to something other than 0, and it leaves them at 0
+        for (i = 0; i < (OCTAL_MOVE_HEAP + 1) * (OCTAL_MOVE_HEAP + 1) * (OCTAL_MOVE_HEAP + 1); i++) {
+            heaps[0] = i % (OCTAL_MOVE_HEAP + 1);
+            heaps[1] = i / (OCTAL_MOVE_HEAP + 1) % (OCTAL_MOVE_HEAP + 1);
+            heaps[2] = i / ((OCTAL_MOVE_HEAP + 1) * (OCTAL_MOVE_HEAP + 1));
+            sum = values[heaps[0]] ^ values[heaps[1]] ^ values[heaps[2]];
+            winning = octalMove(&rules, heaps, 3, &row, &pieces, &left);
+            if (winning) { // What the move leaves in the row must balance the other two rows
+                n = heaps[row - 1];
+                rest = sum ^ values[n];
+                if (!octalAllowed(&rules, n, pieces, left) || (rest ^ values[left] ^ values[n - pieces - left]) != 0)
+                    winning = -1;
+            }
+            if (winning != (sum != 0)) {
+                fprintf(stderr, "octal: %s, %lld %lld %lld: got %d, expected %d\n", codes[c], heaps[0], heaps[1],
+                        heaps[2], winning, sum != 0);
+                errors++;
+            }
+        }
+        freeRules(&rules);
+    }
+    return errors;
+}
+
+static int testTablebase(void) {
+    long long heaps[TEST_ROWS], pieces;
+    int errors = 0, misere, winning, row, i;
+    const int amounts[] = {1, 2, 3};
+    Tablebase tablebase;
+    Solver solver;
+    Rules rules;
+
+    if (!newSubtractionRules(&rules, amounts, 3))
+        return 1;
+    for (misere = 0; misere <= 1; misere++) {
+        rules.misere = misere;
+        if (!buildTablebase(&tablebase, &rules, TEST_ROWS, TEST_HEAP, 2, NULL))
+            return 1;
+        newSolver(&solver, &rules);
+        for (i = 1; i < TEST_POSITIONS; i++) {
+            positionHeaps(i, heaps);
+            if (!tablebaseLookup(&tablebase, heaps, TEST_ROWS, &winning, &row, &pieces) ||
+                winning != solve(&solver, heaps) || (winning && !checkMove(&solver, heaps, &row, &pieces, 1))) {
+                fprintf(stderr, "tablebase: %s, %lld %lld %lld %lld: got %d (%d %lld), expected %d\n",
+                        misere ? "misère" : "normal", heaps[0], heaps[1], heaps[2], heaps[3], winning, row, pieces,
+                        solve(&solver, heaps));
+                errors++;
+            }
+        }
+        closeTablebase(&tablebase);
+    }
+    freeRules(&rules);
+    return errors;
+}
+
+static int testSave(void) {
+    const long long sizes[] = {3, 5, 7, 9};
+    const int amounts[] = {1, 3, 4};
+    unsigned char *data;
+    size_t size;
+    Rules rules[4], loadedRules;
+    Game game, loaded;
+    Turn turn = {0};
+    int errors = 0, player, r;
+
+    if (!newSubtractionRules(&rules[0], amounts, 3) || !newMooreRules(&rules[2], 2) ||
+        !newOctalRules(&rules[3], "0.77", 9, NULL))
+        return 1;
+    newAnyAmountRules(&rules[1]);
+    rules[1].misere = 0;
+
+    for (r = 0; r < 4; r++) {
+        if (!newGame(&game, 4, sizes, &rules[r]) || !parseRules(&loadedRules, "1,2,3") ||
+            !newGame(&loaded, 1, sizes, &loadedRules))
+            return 1;
+        turn.count = r == 2 ? 2 : 1; // Moore's Nim_k takes from two rows; an octal code splits the row
+        turn.rows[0] = 2;
+        turn.pieces[0] = r == 0 ? 4 : 1;
+        turn.rows[1] = 4;
+        turn.pieces[1] = 5;
+        turn.left = r == 3 ? 2 : 0;
+        if (!legalTurn(&game, &turn)) {
+            fprintf(stderr, "save: rules %d: the test turn is not legal\n", r);
+            errors++;
+        }
+        takeTurn(&game, &turn);
+
+        // Through memory, then through a file
+        data = encodeSave(&game, 1, &size);
+        if (data == NULL || !decodeSave(&loaded, &loadedRules, &player, data, size) || player != 1 ||
+            !sameGame(&game, &loaded)) {
+            fprintf(stderr, "save: rules %d: the game read back from memory is different\n", r);
+            errors++;
+        }
+        data[size / 2] ^= 1; // A damaged save must be turned down, and leave the game as it was
+        if (decodeSave(&loaded, &loadedRules, &player, data, size) || !sameGame(&game, &loaded)) {
+            fprintf(stderr, "save: rules %d: a damaged save was read\n", r);
+            errors++;
+        }
+        free(data);
+        if (!writeSave(&game, 0, SAVE_FILE) || !readSave(&loaded, &loadedRules, &player, SAVE_FILE) || player != 0 ||
+            !sameGame(&game, &loaded)) {
+            fprintf(stderr, "save: rules %d: the game read back from a file is different\n", r);
+            errors++;
+        }
+        remove(SAVE_FILE);
+        freeGame(&game);
+        freeGame(&loaded);
+        freeRules(&loadedRules);
+    }
+    for (r = 0; r < 4; r++)
+        freeRules(&rules[r]);
+    return errors;
+}
+
+static int testJournal(void) {
+    const long long sizes[] = {3, 5, 7, 12};
+    const int amounts[] = {1, 2, 3};
+    Rules rules[2], loadedRules;
+    Game game, loaded;
+    Journal journal;
+    Turn turn = {0};
+    long long moves;
+    int errors = 0, player, aiPlayer, r, i;
+
+    if (!newSubtractionRules(&rules[0], amounts, 3) || !newOctalRules(&rules[1], "0.07", 12, NULL))
+        return 1;
+    for (r = 0; r < 2; r++) {
+        if (!newGame(&game, 4, sizes, &rules[r]) || !parseRules(&loadedRules, "1,2,3") ||
+            !newGame(&loaded, 1, sizes, &loadedRules) || !openJournal(&journal, JOURNAL_FILE, &game, 0, 1))
+            return 1;
+        player = 0;
+        for (i = 0; i < 5 && !gameWon(&game); i++) { // The computer's moves are as good as any to record
+            getAITurn(&game, &turn);
+            if (!legalTurn(&game, &turn) || !journalTurn(&journal, &turn))
+                errors++;
+            takeTurn(&game, &turn);
+            player = !player;
+            if (i == 2 && !compactJournal(&journal, &game, player)) // Moves after a compaction are kept too
+                errors++;
+        }
+        if (!closeJournal(&journal) || !replayJournal(&loaded, &loadedRules, &player, &aiPlayer, JOURNAL_FILE, &moves) ||
+            player != i % 2 || aiPlayer != 1 || moves != i - 3 || !sameGame(&game, &loaded)) {
+            fprintf(stderr, "journal: rules %d: the replayed game is different\n", r);
+            errors++;
+        }
+        remove(JOURNAL_FILE);
+        freeGame(&game);
+        freeGame(&loaded);
+        freeRules(&loadedRules);
+        freeRules(&rules[r]);
+    }
+    return errors;
+}
+
+static int sameGame(const Game *expected, const Game *actual) {
+    const Rules *a = expected->rules, *b = actual->rules;
+
+    if (expected->heapCount != actual->heapCount || expected->total != actual->total ||
+        memcmp(expected->heaps, actual->heaps, expected->heapCount * sizeof(long long)) != 0 ||
+        memcmp(expected->sizes, actual->sizes, expected->heapCount * sizeof(long long)) != 0)
+        return 0;
+    if (a->misere != b->misere || a->anyAmount != b->anyAmount || a->maxRows != b->maxRows || a->octal != b->octal ||
+        a->moveCount != b->moveCount || memcmp(a->moves, b->moves, a->moveCount * sizeof(a->moves[0])) != 0)
+        return 0;
+    return !a->octal || memcmp(a->digits, b->digits, sizeof(a->digits)) == 0;
+}
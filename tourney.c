@@ -0,0 +1,482 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "game.h"
+
+#define MAX_THREADS 256
+#define MAX_STRATEGIES 16
+#define MAX_ROWS 64 // Most rows on a board, fixed or random
+
+#define STRATEGY_AI 0 // getAIMove
+#define STRATEGY_FIRST 1 // firstAvailableMove
+#define STRATEGY_RANDOM 2 // randomMove
+#define STRATEGY_SEARCH 3 // searchMove, down to a depth
+#define STRATEGY_MCTS 4 // mctsMove, with a number of playouts per move
+
+/**
+ * A way of picking moves that can take part in the tournament
+ */
+typedef struct {
+    char name[32]; // As given on the command line
+    int kind; // STRATEGY_*
+    int depth; // Deepest a STRATEGY_SEARCH strategy looks, in moves
+    long long playouts; // Playouts a STRATEGY_MCTS strategy runs per move
+} Strategy;
+
+/**
+ * Everything the threads playing one pairing share: its settings, the running score and the test that stops it
+ */
+typedef struct {
+    const Rules *rules;
+    const Strategy *sides[2]; // The two strategies; the score is kept for the first
+    const Searcher *searcher; // Table for search strategies, copied by each thread so they all share it
+    const long long *sizes; // The board, or NULL for a new random board for every pair of games
+    int heapCount; // Rows on the board, or the most rows on a random board
+    long long maxPieces; // Most pieces in a row of a random board
+    unsigned long long seed; // Every pair of games gets its own generator from this, so runs repeat exactly
+    long long maxPairs; // Pairs of games to play if the test never decides
+
+    // The sequential probability ratio test: each win adds winWeight to the log-likelihood ratio and each loss
+    // adds lossWeight, and the pairing stops once the ratio leaves the bounds
+    double winWeight, lossWeight, lowerBound, upperBound;
+
+    atomic_llong nextPair; // Next pair of games for a thread to claim
+    atomic_llong wins, losses; // Games won and lost by the first strategy
+    atomic_llong moves;
+    atomic_llong playouts, playoutMicros; // Playouts run by Monte Carlo strategies, and the time they took
+    atomic_int stopped; // Set once the test has decided
+    atomic_int failed; // Set if a thread could not allocate its board
+} Match;
+
+/**
+ * Read a comma-separated list of strategies such as "ai,first,random,search4,mcts1000"
+ * @param text the list
+ * @param strategies array to store the strategies in, MAX_STRATEGIES long
+ * @return number of strategies, or 0 if one of them is unknown
+ */
+static int parseStrategies(const char *text, Strategy strategies[]);
+
+/**
+ * Play pairs of games for a pairing until the test decides or the pairs run out. In each pair the two strategies
+ * play the same board twice, taking turns moving first.
+ * @param arg address of the Match
+ * @return NULL
+ */
+static void *playPairs(void *arg);
+
+/**
+ * Pick a move for one side
+ * @param strategy
+ * @param game
+ * @param searcher this thread's copy of the searcher, for search strategies
+ * @param mcts this thread's Monte Carlo player, for Monte Carlo strategies
+ * @param seed address of this pair's random number generator, for random play
+ * @param chosenRow address to store the chosen row
+ * @param pieces address to store the chosen number of pieces to take
+ */
+static void strategyMove(const Strategy *strategy, Game *game, Searcher *searcher, Mcts *mcts,
+                         unsigned long long *seed, int *chosenRow, long long *pieces);
+
+/**
+ * Convert a score to an Elo difference
+ * @param score fraction of the points won, strictly between 0 and 1
+ * @return the Elo difference that predicts the score
+ */
+static double eloFromScore(double score);
+
+/**
+ * Fit one rating to each strategy from every result at once (the Bradley-Terry model, by minorization-maximization).
+ * Each pairing counts half a win and half a loss extra, so strategies that won or lost every game still get a
+ * finite rating.
+ * @param count number of strategies
+ * @param wins wins[i * count + j] is how many games strategy i won against strategy j
+ * @param ratings array to store the ratings in, in Elo, averaging 0
+ */
+static void fitRatings(int count, const long long wins[], double ratings[]);
+
+/**
+ * Read the monotonic clock
+ * @return the time in seconds
+ */
+static double now(void);
+
+int main(int argc, char *argv[]) {
+    const char *strategyText = "ai,first,random,search2", *ruleText = "1,2,3";
+    long long sizes[MAX_ROWS], *wins;
+    long long maxGames = 20000, maxPieces = 12, games, totalGames = 0;
+    int threads = (int) sysconf(_SC_NPROCESSORS_ONLN), strategyCount, maxRows = 4, heapCount = 0, normalPlay = 0;
+    int option, a, b, i, j, order[MAX_STRATEGIES], swap, search = 0;
+    unsigned long long seed = (unsigned long long) time(NULL);
+    double elo0 = 0, elo1 = 50, alpha = 0.05, megabytes = 16, p0, p1, llr, score, low, high, start, elapsed;
+    double ratings[MAX_STRATEGIES];
+    Strategy strategies[MAX_STRATEGIES];
+    pthread_t ids[MAX_THREADS];
+    Searcher searcher;
+    Rules rules;
+    Match match;
+
+    while ((option = getopt(argc, argv, "s:t:g:b:k:p:r:ne:a:S:m:")) != -1) {
+        switch (option) {
+            case 's':
+                strategyText = optarg;
+                break;
+            case 't':
+                threads = atoi(optarg);
+                break;
+            case 'g':
+                maxGames = atoll(optarg);
+                break;
+            case 'b':
+                heapCount = parseList(optarg, sizes, MAX_ROWS);
+                if (heapCount == 0) {
+                    fprintf(stderr, "Invalid board: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'k':
+                maxRows = atoi(optarg);
+                break;
+            case 'p':
+                maxPieces = atoll(optarg);
+                break;
+            case 'r':
+                ruleText = optarg;
+                break;
+            case 'n':
+                normalPlay = 1;
+                break;
+            case 'e':
+                if (sscanf(optarg, "%lf,%lf", &elo0, &elo1) != 2 || elo0 >= elo1) {
+                    fprintf(stderr, "Invalid Elo bounds: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'a':
+                alpha = atof(optarg);
+                break;
+            case 'S':
+                seed = strtoull(optarg, NULL, 10);
+                break;
+            case 'm':
+                megabytes = atof(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-s ai,first,random,search2] [-t threads] [-g games] [-b 3,5,7 | -k rows -p pieces]\n"
+                                "       [-r 1,2,3|any] [-n] [-e elo0,elo1] [-a alpha] [-S seed] [-m megabytes]\n"
+                                "Plays every pair of strategies against each other until a sequential probability ratio\n"
+                                "test decides whether the first is elo1 rather than elo0 Elo stronger, then rates them all.\n"
+                                "  -s  strategies: ai (getAIMove), first (firstAvailableMove), random, searchN\n"
+                                "      (alpha-beta search N moves deep; search alone searches to the end), or mctsN\n"
+                                "      (Monte Carlo tree search with N playouts per move)\n"
+                                "  -g  most games per pairing if the test has not decided by then\n"
+                                "  -b  play every game on this board (default: random boards of up to -k rows of -p pieces)\n"
+                                "  -n  normal play: whoever takes the last piece wins (default: they lose)\n"
+                                "  -a  chance of each kind of wrong decision (default 0.05)\n"
+                                "  -m  memory shared by the search strategies' transposition table\n", argv[0]);
+                return 1;
+        }
+    }
+
+    strategyCount = parseStrategies(strategyText, strategies);
+    if (strategyCount < 2) {
+        fprintf(stderr, "Give at least two strategies from ai, first, random, searchN and mctsN: %s\n", strategyText);
+        return 1;
+    }
+    if (!parseRules(&rules, ruleText)) {
+        fprintf(stderr, "Invalid rules: %s (1 must be one of the amounts)\n", ruleText);
+        return 1;
+    }
+    rules.misere = !normalPlay;
+    if (threads < 1)
+        threads = 1;
+    if (threads > MAX_THREADS)
+        threads = MAX_THREADS;
+    if (maxRows < 1 || maxRows > MAX_ROWS || maxPieces < 1 || maxGames < 2 || alpha <= 0 || alpha >= 0.5) {
+        fprintf(stderr, "Invalid settings\n");
+        return 1;
+    }
+    for (i = 0; i < strategyCount; i++)
+        search |= strategies[i].kind == STRATEGY_SEARCH;
+    if (search && !newSearcher(&searcher, &rules, (size_t) (megabytes * 1024 * 1024))) {
+        fprintf(stderr, "Not enough memory for the search table\n");
+        return 1;
+    }
+    wins = calloc(strategyCount * strategyCount, sizeof(long long));
+    if (wins == NULL) {
+        fprintf(stderr, "Not enough memory\n");
+        return 1;
+    }
+
+    // Under each hypothesis the first strategy wins a game with the chance its Elo lead predicts
+    p0 = 1 / (1 + pow(10, -elo0 / 400));
+    p1 = 1 / (1 + pow(10, -elo1 / 400));
+
+    printf("%d threads, %s, SPRT elo0 %.0f elo1 %.0f alpha = beta = %.3f, seed %llu\n", threads,
+           heapCount ? "fixed board" : "random boards", elo0, elo1, alpha, seed);
+    start = now();
+    for (a = 0; a < strategyCount; a++) {
+        for (b = a + 1; b < strategyCount; b++) {
+            memset(&match, 0, sizeof(match));
+            match.rules = &rules;
+            match.sides[0] = &strategies[a];
+            match.sides[1] = &strategies[b];
+            match.searcher = search ? &searcher : NULL;
+            match.sizes = heapCount ? sizes : NULL;
+            match.heapCount = heapCount ? heapCount : maxRows;
+            match.maxPieces = maxPieces;
+            match.seed = seed;
+            match.maxPairs = maxGames / 2;
+            match.winWeight = log(p1 / p0);
+            match.lossWeight = log((1 - p1) / (1 - p0));
+            match.lowerBound = log(alpha / (1 - alpha));
+            match.upperBound = log((1 - alpha) / alpha);
+
+            for (i = 0; i < threads; i++)
+                pthread_create(&ids[i], NULL, playPairs, &match);
+            for (i = 0; i < threads; i++)
+                pthread_join(ids[i], NULL);
+            if (match.failed) {
+                fprintf(stderr, "Not enough memory for a board or a Monte Carlo tree\n");
+                return 1;
+            }
+
+            wins[a * strategyCount + b] = match.wins;
+            wins[b * strategyCount + a] = match.losses;
+            games = match.wins + match.losses;
+            totalGames += games;
+
+            // Half a point each way keeps the estimate finite when one side won every game
+            score = (match.wins + 0.5) / (games + 1.0);
+            low = score - 1.96 * sqrt(score * (1 - score) / (games + 1.0));
+            high = score + 1.96 * sqrt(score * (1 - score) / (games + 1.0));
+            llr = match.wins * match.winWeight + match.losses * match.lossWeight;
+            printf("%s vs %s: %lld games, %lld-%lld, Elo %+.0f (%+.0f to %+.0f), LLR %.2f [%.2f, %.2f]: %s\n",
+                   strategies[a].name, strategies[b].name, games, (long long) match.wins, (long long) match.losses,
+                   eloFromScore(score), eloFromScore(low > 0.0001 ? low : 0.0001),
+                   eloFromScore(high < 0.9999 ? high : 0.9999), llr, match.lowerBound, match.upperBound,
+                   llr >= match.upperBound ? "H1 accepted" : llr <= match.lowerBound ? "H0 accepted" : "inconclusive");
+            if (match.playouts > 0)
+                printf("  %lld playouts at %.0f playouts/sec per thread\n", (long long) match.playouts,
+                       match.playouts / (match.playoutMicros / 1e6 + 1e-9));
+        }
+    }
+    elapsed = now() - start;
+
+    fitRatings(strategyCount, wins, ratings);
+    for (i = 0; i < strategyCount; i++) // Sort by rating, best first
+        order[i] = i;
+    for (i = 1; i < strategyCount; i++)
+        for (j = i; j > 0 && ratings[order[j]] > ratings[order[j - 1]]; j--) {
+            swap = order[j];
+            order[j] = order[j - 1];
+            order[j - 1] = swap;
+        }
+    printf("Ratings (Elo, averaging 0):\n");
+    for (i = 0; i < strategyCount; i++)
+        printf("%3d. %-16s %+7.0f\n", i + 1, strategies[order[i]].name, ratings[order[i]]);
+    printf("%lld games in %.2f s (%.0f games/sec)\n", totalGames, elapsed, totalGames / elapsed);
+
+    if (search)
+        freeSearcher(&searcher);
+    free(wins);
+    freeRules(&rules);
+    return 0;
+}
+
+static int parseStrategies(const char *text, Strategy strategies[]) {
+    int count = 0, length;
+    char *end;
+
+    while (*text != '\0' && count < MAX_STRATEGIES) {
+        length = (int) strcspn(text, ",");
+        if (length == 0 || length >= (int) sizeof(strategies[count].name))
+            return 0;
+        memcpy(strategies[count].name, text, length);
+        strategies[count].name[length] = '\0';
+        strategies[count].depth = 1000;
+
+        if (strcmp(strategies[count].name, "ai") == 0) {
+            strategies[count].kind = STRATEGY_AI;
+        } else if (strcmp(strategies[count].name, "first") == 0) {
+            strategies[count].kind = STRATEGY_FIRST;
+        } else if (strcmp(strategies[count].name, "random") == 0) {
+            strategies[count].kind = STRATEGY_RANDOM;
+        } else if (strncmp(strategies[count].name, "search", 6) == 0) {
+            strategies[count].kind = STRATEGY_SEARCH;
+            if (strategies[count].name[6] != '\0') {
+                strategies[count].depth = (int) strtol(strategies[count].name + 6, &end, 10);
+                if (*end != '\0' || strategies[count].depth < 1)
+                    return 0;
+            }
+        } else if (strncmp(strategies[count].name, "mcts", 4) == 0) {
+            strategies[count].kind = STRATEGY_MCTS;
+            strategies[count].playouts = strtoll(strategies[count].name + 4, &end, 10);
+            if (*end != '\0' || strategies[count].playouts < 1 || strategies[count].playouts >= INT_MAX)
+                return 0;
+        } else {
+            return 0;
+        }
+        count++;
+        text += length;
+        if (*text == ',')
+            text++;
+    }
+    return *text == '\0' ? count : 0;
+}
+
+static void *playPairs(void *arg) {
+    Match *match = arg;
+    long long sizes[MAX_ROWS], pair, pieces, moves = 0, wins, losses, playouts = 0, capacity = 0;
+    unsigned long long seed;
+    int heapCount, firstSide, player, chosenRow, winner, pairWins, i;
+    double llr, playoutTime = 0;
+    Searcher searcher;
+    Mcts mcts;
+    Game game;
+
+    if (match->searcher != NULL) // A copy of its own for the depth, sharing the lock-free table
+        searcher = *match->searcher;
+    // A tree of its own, on one thread since the games are already spread over every core
+    for (i = 0; i < 2; i++)
+        if (match->sides[i]->kind == STRATEGY_MCTS && match->sides[i]->playouts + 1 > capacity)
+            capacity = match->sides[i]->playouts + 1;
+    if (capacity > 0) {
+        if (!newMcts(&mcts, match->rules, (int) capacity)) {
+            atomic_store(&match->failed, 1);
+            atomic_store(&match->stopped, 1);
+            return NULL;
+        }
+        mcts.threads = 1;
+    }
+
+    while (!atomic_load(&match->stopped) && (pair = atomic_fetch_add(&match->nextPair, 1)) < match->maxPairs) {
+        // The pair's generator depends only on the pair, so which thread plays it does not matter
+        seed = match->seed ^ (unsigned long long) pair * 0x9E3779B97F4A7C15ULL;
+        nextRandom(&seed);
+        if (match->sizes != NULL) {
+            heapCount = match->heapCount;
+            memcpy(sizes, match->sizes, heapCount * sizeof(long long));
+        } else {
+            heapCount = 1 + (int) (nextRandom(&seed) % (unsigned long long) match->heapCount);
+            for (i = 0; i < heapCount; i++)
+                sizes[i] = 1 + (long long) (nextRandom(&seed) % (unsigned long long) match->maxPieces);
+        }
+        if (!newGame(&game, heapCount, sizes, match->rules)) {
+            atomic_store(&match->failed, 1);
+            atomic_store(&match->stopped, 1);
+            return NULL;
+        }
+
+        if (capacity > 0)
+            mcts.seed = nextRandom(&seed);
+
+        pairWins = 0;
+        for (firstSide = 0; firstSide < 2; firstSide++) { // Same board, each side moving first once
+            resetGame(&game);
+            player = 0;
+            while (!gameWon(&game)) {
+                strategyMove(match->sides[player ^ firstSide], &game, &searcher, &mcts, &seed, &chosenRow, &pieces);
+                if (match->sides[player ^ firstSide]->kind == STRATEGY_MCTS) {
+                    playouts += mcts.playouts;
+                    playoutTime += mcts.seconds;
+                }
+                removePieces(&game, chosenRow, pieces);
+                moves++;
+                player = !player;
+            }
+            // The turn has already passed to whoever did not take the last piece
+            winner = gameWinner(&game, player) ^ firstSide;
+            pairWins += winner == 0;
+        }
+        freeGame(&game);
+
+        // Add the pair to the score, and stop everyone once the test has decided
+        wins = atomic_fetch_add(&match->wins, pairWins) + pairWins;
+        losses = atomic_fetch_add(&match->losses, 2 - pairWins) + 2 - pairWins;
+        llr = wins * match->winWeight + losses * match->lossWeight;
+        if (llr >= match->upperBound || llr <= match->lowerBound)
+            atomic_store(&match->stopped, 1);
+    }
+    atomic_fetch_add(&match->moves, moves);
+    atomic_fetch_add(&match->playouts, playouts);
+    atomic_fetch_add(&match->playoutMicros, (long long) (playoutTime * 1e6));
+    if (capacity > 0)
+        freeMcts(&mcts);
+    return NULL;
+}
+
+static void strategyMove(const Strategy *strategy, Game *game, Searcher *searcher, Mcts *mcts,
+                         unsigned long long *seed, int *chosenRow, long long *pieces) {
+    Move move;
+
+    switch (strategy->kind) {
+        case STRATEGY_AI:
+            getAIMove(game, chosenRow, pieces);
+            break;
+        case STRATEGY_FIRST:
+            firstAvailableMove(game, chosenRow, pieces);
+            break;
+        case STRATEGY_RANDOM:
+            randomMove(game, seed, chosenRow, pieces);
+            break;
+        case STRATEGY_MCTS:
+            mcts->playoutLimit = strategy->playouts;
+            mctsMove(mcts, game->heaps, game->heapCount, &move);
+            *chosenRow = move.rows[0];
+            *pieces = move.pieces[0];
+            break;
+        default:
+            searcher->maxDepth = strategy->depth;
+            searchMove(searcher, game->heaps, game->heapCount, &move);
+            *chosenRow = move.rows[0];
+            *pieces = move.pieces[0];
+            break;
+    }
+}
+
+static double eloFromScore(double score) {
+    return 400 * log10(score / (1 - score));
+}
+
+static void fitRatings(int count, const long long wins[], double ratings[]) {
+    double strength[MAX_STRATEGIES], next[MAX_STRATEGIES], won, weight, games, logSum;
+    int round, i, j;
+
+    for (i = 0; i < count; i++)
+        strength[i] = 1;
+    for (round = 0; round < 1000; round++) {
+        for (i = 0; i < count; i++) {
+            won = 0;
+            weight = 0;
+            for (j = 0; j < count; j++) {
+                if (j == i)
+                    continue;
+                games = wins[i * count + j] + wins[j * count + i] + 1.0;
+                won += wins[i * count + j] + 0.5;
+                weight += games / (strength[i] + strength[j]);
+            }
+            next[i] = won / weight;
+        }
+        logSum = 0;
+        for (i = 0; i < count; i++)
+            logSum += log(next[i]);
+        for (i = 0; i < count; i++) // Keep the geometric mean at 1, so the ratings average 0
+            strength[i] = next[i] / exp(logSum / count);
+    }
+    for (i = 0; i < count; i++)
+        ratings[i] = 400 * log10(strength[i]);
+}
+
+static double now(void) {
+    struct timespec spec;
+    clock_gettime(CLOCK_MONOTONIC, &spec);
+    return spec.tv_sec + spec.tv_nsec / 1e9;
+}